@@ -1,16 +1,124 @@
 #include <vector>
 
+#include <cstdio>
 #include <iostream>
+#include <unistd.h>
 
 #include "br.h"
+#include "predictors.h"
 
-void initCPP()
+// Configurations instantiated ahead of time:
+//   model, log2 counters, history bits, counter bits, direction predictor
+#define PREDICTOR_CONFIGS(X)              \
+    X(DEFAULT, 10, 0, 2, BimodalOf)       \
+    X(DEFAULT, 12, 0, 2, BimodalOf)       \
+    X(DEFAULT, 14, 0, 2, BimodalOf)       \
+    X(DEFAULT, 16, 0, 2, BimodalOf)       \
+    X(DEFAULT, 10, 0, 3, BimodalOf)       \
+    X(DEFAULT, 14, 0, 3, BimodalOf)       \
+    X(GSHARE, 10, 8, 2, bp::GShare)       \
+    X(GSHARE, 10, 10, 2, bp::GShare)      \
+    X(GSHARE, 12, 8, 2, bp::GShare)       \
+    X(GSHARE, 12, 12, 2, bp::GShare)      \
+    X(GSHARE, 14, 8, 2, bp::GShare)       \
+    X(GSHARE, 14, 14, 2, bp::GShare)      \
+    X(GSHARE, 16, 12, 2, bp::GShare)      \
+    X(GSHARE, 16, 16, 2, bp::GShare)      \
+    X(GSHARE, 14, 14, 3, bp::GShare)      \
+    X(GSELECT, 7, 2, 2, bp::GSelect)      \
+    X(GSELECT, 10, 2, 2, bp::GSelect)     \
+    X(GSELECT, 10, 4, 2, bp::GSelect)     \
+    X(GSELECT, 12, 4, 2, bp::GSelect)     \
+    X(GSELECT, 12, 6, 2, bp::GSelect)     \
+    X(GSELECT, 14, 2, 2, bp::GSelect)     \
+    X(GSELECT, 14, 6, 2, bp::GSelect)     \
+    X(GSELECT, 16, 8, 2, bp::GSelect)
+
+namespace {
+
+struct Instantiation {
+    int model;
+    int logSize;
+    int historyBits;
+    int counterBits;
+    bp::Predictor* (*create)();
+};
+
+// Bimodal with the history parameter of the others, which it ignores
+template <unsigned LogSize, unsigned HistBits, unsigned CounterBits>
+using BimodalOf = bp::Bimodal<LogSize, CounterBits>;
+
+template <class Direction, unsigned LogSize>
+bp::Predictor* createPredictor()
+{
+    return new bp::CompletePredictor<Direction, LogSize>();
+}
+
+#define INSTANTIATION(model, s, b, c, Direction) \
+    {model, s, b, c, createPredictor<Direction<s, b, c>, s>},
+
+const Instantiation instantiations[] = {PREDICTOR_CONFIGS(INSTANTIATION)};
+
+#undef INSTANTIATION
+
+std::vector<bp::Predictor*> predictors;
+
+} // namespace
+
+int initCPP(int model, int logSize, int historyBits, int counterBits,
+            int processors)
 {
-    std::cout << "INIT\n" << std::endl;
+    // History does not apply to bimodal tables
+    if (model == DEFAULT) {
+        historyBits = 0;
+    }
+
+    for (const Instantiation& in : instantiations) {
+        if (in.model == model && in.logSize == logSize
+            && in.historyBits == historyBits && in.counterBits == counterBits) {
+            for (int i = 0; i < processors; i++) {
+                predictors.push_back(in.create());
+            }
+            return 1;
+        }
+    }
+
+    std::cerr << "branchCPP: no predictor instantiated for -g " << model
+              << " -s " << logSize << " -b " << historyBits << " -w "
+              << counterBits << ", available:\n";
+    for (const Instantiation& in : instantiations) {
+        std::cerr << "  -g " << in.model << " -s " << in.logSize << " -b "
+                  << in.historyBits << " -w " << in.counterBits << "\n";
+    }
+    return 0;
 }
 
 uint64_t branchRequestCPP(trace_op* op, int processorNum)
 {
-    std::cout << "TEST\n" << std::endl;
-    return 1;
-}
\ No newline at end of file
+    return predictors[processorNum]->request(op);
+}
+
+void finishCPP(int outFd)
+{
+    char buf[160];
+
+    for (size_t i = 0; i < predictors.size(); i++) {
+        const bp::Stats& s = predictors[i]->stats();
+        double accuracy = s.branches
+                              ? 100.0 * (s.branches - s.mispredicts) / s.branches
+                              : 0.0;
+        int len = snprintf(buf, sizeof(buf),
+                           "Core %zu branches - %lu, mispredicts - %lu (direction %lu, target %lu), accuracy - %.2f%%\n",
+                           i, s.branches, s.mispredicts, s.directionMispredicts,
+                           s.targetMispredicts, accuracy);
+        (void)!write(outFd, buf, len);
+    }
+}
+
+void destroyCPP()
+{
+    for (bp::Predictor* p : predictors) {
+        delete p;
+    }
+    predictors.clear();
+}
@@ -9,8 +9,13 @@ extern "C" {
  
 uint64_t branchRequestCPP(trace_op* op, int processorNum);
 
-void initCPP();
+// Choose the pre-instantiated predictor matching the configuration, one per
+//   processor.  Returns 0 if there is no such instantiation.
+int initCPP(int model, int logSize, int historyBits, int counterBits,
+            int processors);
+void finishCPP(int outFd);
+void destroyCPP();
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
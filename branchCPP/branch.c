@@ -7,6 +7,8 @@
 
 #include "br.h"
 
+int processorCount = 1;
+
 branch* self = NULL;
 
 uint64_t branchRequest(trace_op* op, int processorNum);
@@ -14,9 +16,13 @@ uint64_t branchRequest(trace_op* op, int processorNum);
 branch* init(branch_sim_args* csa)
 {
     int op;
+    int model = DEFAULT;
+    int logSize = 10;
+    int historyBits = 0;
+    int counterBits = 2;
     
-    // TODO - get argument list from assignment
-    while ((op = getopt(csa->arg_count, csa->arg_list, "p:")) != -1)
+    // Same options as branchSim, plus -w for counter bits
+    while ((op = getopt(csa->arg_count, csa->arg_list, "p:s:b:g:w:")) != -1)
     {
         switch (op)
         {
@@ -24,17 +30,40 @@ branch* init(branch_sim_args* csa)
             case 'p':
                 
                 break;
+
+                // predictor size
+            case 's':
+                logSize = atoi(optarg);
+                break;
+
+                // BHR size
+            case 'b':
+                historyBits = atoi(optarg);
+                break;
+
+                // predictor model
+            case 'g':
+                model = atoi(optarg);
+                break;
+
+                // counter width
+            case 'w':
+                counterBits = atoi(optarg);
+                break;
         }
     }
     
+    if (!initCPP(model, logSize, historyBits, counterBits, processorCount))
+    {
+        return NULL;
+    }
+
     self = malloc(sizeof(branch));
     self->branchRequest = branchRequestCPP;
     self->si.tick = tick;
     self->si.finish = finish;
     self->si.destroy = destroy;
     
-    initCPP();
-    
     return self;
 }
 
@@ -46,11 +75,14 @@ int tick()
 
 int finish(int outFd)
 {
+    finishCPP(outFd);
     return 0;
 }
 
 int destroy(void)
 {
     // free any internally allocated memory here
+    destroyCPP();
+    free(self);
     return 0;
 }
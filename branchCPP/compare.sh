@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# compare.sh ENGINE - run branchSim and branchCPP on the same generated trace
+#   and check that their statistics agree.  Run from the build directory,
+#   where the components are found as <name>/lib<name>.so.
+#
+# Only the direction predictors are meant to match: branchCPP has a direct
+#   mapped BTB while branchSim has a set associative one, a return stack and
+#   an indirect predictor.  Every branch in the trace has one target and the
+#   branches fit in both BTBs, so the targets agree as well.
+#
+
+ENGINE=$1
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# 300 branches 8 bytes apart, some biased, some patterned, some random
+awk 'BEGIN {
+    srand(7)
+    for (i = 0; i < 20000; i++) {
+        k = int(rand() * 300)
+        pc = 4194304 + 8 * k
+        r = rand()
+        if (k % 3 == 0)
+            taken = (i % 3 != 0)
+        else if (k % 4 == 1)
+            taken = (r < 0.9)
+        else
+            taken = (r < 0.4)
+        printf "B 0x%x 0x%x\n", pc, taken ? pc + 64 + 8 * (k % 5) : pc + 4
+        if (i % 4 == 0)
+            printf "A 0x%x 1, 2, 3\n", pc + 4
+    }
+}' > "$DIR/p0.trace"
+
+status=0
+for options in "-s 12 -g 0" "-s 16 -g 0" "-s 12 -b 8 -g 1" \
+               "-s 14 -b 14 -g 1" "-s 10 -b 4 -g 2"
+do
+    printf -- "__processor -f 4 -d 2 -m 2 -j 3 -k 2 -c 2\n__cache\n__branch %s\n__coherence\n__interconnect\n__memory\n" \
+        "$options" > "$DIR/test.config"
+    for component in branchSim branchCPP
+    do
+        "$ENGINE" -n 1 -s "$DIR/test.config" -t "$DIR" -p simProcessor \
+            -c simpleCache -b $component -i interconnectProj 2> /dev/null \
+            | grep "^Core 0 branches" > "$DIR/$component.out"
+    done
+
+    if [ ! -s "$DIR/branchSim.out" ] ||
+       ! cmp -s "$DIR/branchSim.out" "$DIR/branchCPP.out"
+    then
+        echo "Mismatch with $options:"
+        echo "  branchSim: $(cat "$DIR/branchSim.out")"
+        echo "  branchCPP: $(cat "$DIR/branchCPP.out")"
+        status=1
+    fi
+done
+exit $status
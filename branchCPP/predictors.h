@@ -0,0 +1,283 @@
+#ifndef PREDICTORS_H
+#define PREDICTORS_H
+
+//
+// Header-only branch predictor library.  Every size and width is a template
+//   parameter, so index masks, counter limits and history widths are
+//   compile time constants in each instantiation.  br.cpp instantiates the
+//   common configurations and picks one at init.
+//
+
+#include <array>
+#include <cstdint>
+
+#include <trace.h>
+
+namespace bp {
+
+// Unsigned saturating counter, predicting taken in its upper half
+template <unsigned Bits>
+class SatCounter
+{
+    static_assert(Bits >= 1 && Bits <= 8, "counter must fit in a byte");
+
+public:
+    static constexpr uint8_t max = (1u << Bits) - 1;
+    static constexpr uint8_t weakNotTaken = (1u << (Bits - 1)) - 1;
+
+    constexpr bool predict() const { return value > weakNotTaken; }
+
+    constexpr void update(bool taken)
+    {
+        if (taken) {
+            value += (value < max);
+        }
+        else {
+            value -= (value > 0);
+        }
+    }
+
+    uint8_t value = weakNotTaken;
+};
+
+// Shift register of the most recent Bits outcomes, newest in bit 0
+template <unsigned Bits>
+class HistoryRegister
+{
+    static_assert(Bits <= 64, "history must fit in 64 bits");
+
+public:
+    static constexpr uint64_t mask = (Bits == 64) ? ~0ull : (1ull << Bits) - 1;
+
+    constexpr uint64_t value() const { return bits; }
+
+    constexpr void push(bool taken) { bits = ((bits << 1) | taken) & mask; }
+
+private:
+    uint64_t bits = 0;
+};
+
+// Power of two table of entries selected by a masked index
+template <unsigned LogEntries, class Entry>
+class Table
+{
+    static_assert(LogEntries <= 24, "table too large");
+
+public:
+    static constexpr uint64_t entries = 1ull << LogEntries;
+    static constexpr uint64_t mask = entries - 1;
+
+    Entry& operator[](uint64_t index) { return table[index & mask]; }
+
+private:
+    std::array<Entry, entries> table{};
+};
+
+// Branch addresses are word aligned; like branchSim, drop the low bits
+inline uint64_t pcBits(uint64_t pc)
+{
+    return pc >> 3;
+}
+
+//
+// Direction predictors.  Each has predict(pc) followed by update(pc, taken)
+//   for the same branch.
+//
+
+template <unsigned LogSize, unsigned CounterBits = 2>
+class Bimodal
+{
+public:
+    bool predict(uint64_t pc)
+    {
+        counter = &counters[pcBits(pc)];
+        return counter->predict();
+    }
+
+    void update(uint64_t, bool taken) { counter->update(taken); }
+
+private:
+    Table<LogSize, SatCounter<CounterBits>> counters;
+    SatCounter<CounterBits>* counter = nullptr;
+};
+
+template <unsigned LogSize, unsigned HistBits, unsigned CounterBits = 2>
+class GShare
+{
+    static_assert(HistBits <= LogSize, "history wider than the index");
+
+public:
+    bool predict(uint64_t pc)
+    {
+        counter = &counters[pcBits(pc) ^ history.value()];
+        return counter->predict();
+    }
+
+    void update(uint64_t, bool taken)
+    {
+        counter->update(taken);
+        history.push(taken);
+    }
+
+private:
+    Table<LogSize, SatCounter<CounterBits>> counters;
+    HistoryRegister<HistBits> history;
+    SatCounter<CounterBits>* counter = nullptr;
+};
+
+template <unsigned LogSize, unsigned HistBits, unsigned CounterBits = 2>
+class GSelect
+{
+    static_assert(HistBits < LogSize, "history leaves no pc bits");
+
+public:
+    bool predict(uint64_t pc)
+    {
+        counter = &counters[(pcBits(pc) << HistBits) | history.value()];
+        return counter->predict();
+    }
+
+    void update(uint64_t, bool taken)
+    {
+        counter->update(taken);
+        history.push(taken);
+    }
+
+private:
+    Table<LogSize, SatCounter<CounterBits>> counters;
+    HistoryRegister<HistBits> history;
+    SatCounter<CounterBits>* counter = nullptr;
+};
+
+// Direct mapped BTB tagged with the whole pc; a miss falls through.  It is
+//   simpler than branchSim's set associative BTB with its return stack and
+//   indirect predictor, so only the direction predictions match branchSim.
+template <unsigned LogEntries>
+class BTB
+{
+public:
+    uint64_t lookup(uint64_t pc)
+    {
+        const Entry& e = entries[pcBits(pc)];
+        return (e.pc == pc) ? e.target : 0;
+    }
+
+    void update(uint64_t pc, uint64_t target)
+    {
+        entries[pcBits(pc)] = Entry{pc, target};
+    }
+
+private:
+    struct Entry {
+        uint64_t pc;
+        uint64_t target;
+    };
+    Table<LogEntries, Entry> entries;
+};
+
+struct Stats {
+    uint64_t branches = 0;
+    uint64_t mispredicts = 0;
+    uint64_t directionMispredicts = 0;
+    uint64_t targetMispredicts = 0;
+};
+
+// Runtime face of a predictor, so that init can choose an instantiation
+class Predictor
+{
+public:
+    virtual ~Predictor() = default;
+    // Predict the next pc after the branch op, then train on its outcome
+    virtual uint64_t request(const trace_op* op) = 0;
+
+    const Stats& stats() const { return counts; }
+
+protected:
+    Stats counts;
+};
+
+template <class Direction, unsigned LogBTB>
+class CompletePredictor final : public Predictor
+{
+public:
+    uint64_t request(const trace_op* op) override
+    {
+        uint64_t pc = op->pcAddress;
+        uint64_t next = op->nextPCAddress;
+        bool actual = next != pc + 4;
+
+        bool taken = direction.predict(pc);
+        uint64_t target = btb.lookup(pc);
+        uint64_t predicted = (taken && target != 0) ? target : pc + 4;
+
+        counts.branches++;
+        if (predicted != next) {
+            counts.mispredicts++;
+            if (taken != actual) {
+                counts.directionMispredicts++;
+            }
+            else {
+                counts.targetMispredicts++;
+            }
+        }
+
+        direction.update(pc, actual);
+        if (actual) {
+            btb.update(pc, next);
+        }
+        return predicted;
+    }
+
+private:
+    Direction direction;
+    BTB<LogBTB> btb;
+};
+
+// Compile time checks of the building blocks
+namespace checks {
+
+constexpr bool counterSaturates()
+{
+    SatCounter<2> c;
+    for (int i = 0; i < 5; i++) {
+        c.update(true);
+    }
+    if (c.value != 3 || !c.predict()) {
+        return false;
+    }
+    for (int i = 0; i < 5; i++) {
+        c.update(false);
+    }
+    return c.value == 0 && !c.predict();
+}
+
+constexpr bool counterStartsWeak()
+{
+    SatCounter<3> c;
+    if (c.predict()) {
+        return false;
+    }
+    c.update(true);
+    return c.predict();
+}
+
+constexpr bool historyMasks()
+{
+    HistoryRegister<3> h;
+    for (int i = 0; i < 5; i++) {
+        h.push(true);
+    }
+    h.push(false);
+    return h.value() == 6;
+}
+
+static_assert(counterSaturates(), "2 bit counter must saturate at 0 and 3");
+static_assert(counterStartsWeak(), "counters start weakly not taken");
+static_assert(historyMasks(), "history keeps only its newest bits");
+static_assert(Table<10, SatCounter<2>>::mask == 1023, "table mask");
+
+} // namespace checks
+
+} // namespace bp
+
+#endif
@@ -0,0 +1,255 @@
+#include <trace.h>
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "predictor.h"
+
+//
+// branchEval - evaluate many predictor configurations in one trace pass
+//
+//   Branches are read from the trace a chunk at a time and each chunk is
+//   run through every predictor before the next is read, so the chunk stays
+//   in cache while the predictors take turns.  With -j the predictors are
+//   split over worker threads that run each chunk in parallel.
+//
+
+#define CHUNK_BRANCHES (1 << 14)
+#define MAX_CONFIGS 256
+#define MAX_CONFIG_ARGS 64
+
+typedef struct _evalConfig {
+    char* text;
+    predictor* bp;
+    bool profiled;
+} evalConfig;
+
+evalConfig configs[MAX_CONFIGS];
+int configCount = 0;
+
+trace_op chunk[CHUNK_BRANCHES];
+int chunkSize = 0;
+bool traceDone = false;
+
+int threadCount = 1;
+pthread_barrier_t chunkReady;
+pthread_barrier_t chunkDone;
+
+void printHelp(char* prog)
+{
+    printf("%s \n", prog);
+    printf("  -h            \t Help message\n");
+    printf("  -t <file>     \t Trace file / directory\n");
+    printf("  -p <num>      \t Processor whose trace to read, default 0\n");
+    printf("  -j <num>      \t Worker threads, default 1\n");
+    printf("  -c \"<opts>\"   \t Predictor options as given to branchSim,\n"
+           "                \t  repeat for each configuration to compare\n");
+}
+
+// Split a configuration into an argument list and build its predictor
+static predictor* buildPredictor(char* text, bool* profiled)
+{
+    char* argv[MAX_CONFIG_ARGS + 1] = {"branchEval"};
+    int argc = 1;
+    char* copy = strdup(text);
+    predictorConfig cfg;
+    int op;
+
+    for (char* tok = strtok(copy, " \t"); tok != NULL && argc < MAX_CONFIG_ARGS;
+         tok = strtok(NULL, " \t")) {
+        argv[argc++] = tok;
+    }
+
+    predictorDefaultConfig(&cfg);
+    optind = 1;
+    while ((op = getopt(argc, argv, PREDICTOR_OPTIONS)) != -1) {
+        if (!predictorParseOption(&cfg, op, optarg)) {
+            fprintf(stderr, "Invalid predictor option in \"%s\"\n", text);
+            free(copy);
+            return NULL;
+        }
+    }
+    free(copy);
+
+    *profiled = cfg.profileTop > 0;
+    return predictorCreate(&cfg, NULL);
+}
+
+static void runChunk(int first, int stride)
+{
+    for (int c = first; c < configCount; c += stride) {
+        predictor* bp = configs[c].bp;
+        for (int i = 0; i < chunkSize; i++) {
+            predictorRequest(bp, &chunk[i]);
+        }
+    }
+}
+
+static void* worker(void* arg)
+{
+    int id = (int)(intptr_t)arg;
+
+    while (true) {
+        pthread_barrier_wait(&chunkReady);
+        if (traceDone && chunkSize == 0) {
+            return NULL;
+        }
+        runChunk(id, threadCount);
+        pthread_barrier_wait(&chunkDone);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    char* trace = NULL;
+    int proc = 0;
+    int op;
+
+    while ((op = getopt(argc, argv, "ht:p:j:c:")) != -1) {
+        switch (op) {
+            case 't':
+                trace = optarg;
+                break;
+            case 'p':
+                proc = atoi(optarg);
+                break;
+            case 'j':
+                threadCount = atoi(optarg);
+                break;
+            case 'c':
+                if (configCount == MAX_CONFIGS) {
+                    fprintf(stderr, "At most %d configurations\n", MAX_CONFIGS);
+                    return 1;
+                }
+                configs[configCount++].text = optarg;
+                break;
+            case 'h':
+            default:
+                printHelp(argv[0]);
+                return (op == 'h') ? 0 : 1;
+        }
+    }
+    if (trace == NULL) {
+        printHelp(argv[0]);
+        return 1;
+    }
+    if (configCount == 0) {
+        configs[configCount++].text = "";
+    }
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+
+    for (int c = 0; c < configCount; c++) {
+        configs[c].bp = buildPredictor(configs[c].text, &configs[c].profiled);
+        if (configs[c].bp == NULL) {
+            return 1;
+        }
+    }
+
+    // Read the trace through the trace component, as the engine does
+    void* handle = dlopen("trace/libtrace.so", RTLD_LAZY);
+    if (handle == NULL) {
+        fprintf(stderr, "Failed to load trace component: %s\n", dlerror());
+        return 1;
+    }
+    trace_reader* (*traceInit)(trace_sim_args*) = dlsym(handle, "init");
+    int (*traceDestroy)(void) = dlsym(handle, "destroy");
+    int* pCount = dlsym(handle, "processorCount");
+    if (traceInit == NULL || traceDestroy == NULL) {
+        fprintf(stderr, "Failed to load interface for trace component\n");
+        return 1;
+    }
+    if (pCount != NULL) {
+        *pCount = proc + 1;
+    }
+    char* traceArgs[] = {"trace", "-t", trace, NULL};
+    trace_sim_args tsa = {3, traceArgs};
+    optind = 1;
+    trace_reader* tr = traceInit(&tsa);
+    if (tr == NULL) {
+        return 1;
+    }
+
+    pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+    if (threadCount > 1) {
+        pthread_barrier_init(&chunkReady, NULL, threadCount + 1);
+        pthread_barrier_init(&chunkDone, NULL, threadCount + 1);
+        for (int t = 0; t < threadCount; t++) {
+            pthread_create(&threads[t], NULL, worker, (void*)(intptr_t)t);
+        }
+    }
+
+    uint64_t instructions = 0;
+    while (!traceDone) {
+        chunkSize = 0;
+        while (chunkSize < CHUNK_BRANCHES) {
+            trace_op* nextOp = tr->getNextOp(proc);
+            if (nextOp == NULL) {
+                traceDone = true;
+                break;
+            }
+            instructions++;
+            if (nextOp->op == BRANCH) {
+                chunk[chunkSize++] = *nextOp;
+            }
+            free(nextOp);
+        }
+        if (chunkSize == 0) {
+            break;
+        }
+
+        if (threadCount > 1) {
+            pthread_barrier_wait(&chunkReady);
+            pthread_barrier_wait(&chunkDone);
+        }
+        else {
+            runChunk(0, 1);
+        }
+    }
+
+    if (threadCount > 1) {
+        chunkSize = 0;
+        pthread_barrier_wait(&chunkReady);
+        for (int t = 0; t < threadCount; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        pthread_barrier_destroy(&chunkReady);
+        pthread_barrier_destroy(&chunkDone);
+    }
+    free(threads);
+    traceDestroy();
+    free(tr);
+    dlclose(handle);
+
+    printf("Instructions - %lu\n", instructions);
+    printf("%-36s %10s %11s %9s %9s %9s %8s\n", "Configuration", "Branches",
+           "Mispredicts", "Direction", "Target", "Accuracy", "MPKI");
+    for (int c = 0; c < configCount; c++) {
+        const predictorStats* ps = predictorGetStats(configs[c].bp);
+        double accuracy = ps->branches
+                              ? 100.0 * (ps->branches - ps->mispredicts) / ps->branches
+                              : 0.0;
+        printf("%-36s %10lu %11lu %9lu %9lu %8.2f%% %8.3f\n",
+               configs[c].text[0] ? configs[c].text : "(default)",
+               ps->branches, ps->mispredicts, ps->directionMispredicts,
+               ps->targetMispredicts, accuracy,
+               instructions ? 1000.0 * ps->mispredicts / instructions : 0.0);
+    }
+    for (int c = 0; c < configCount; c++) {
+        if (configs[c].profiled) {
+            printf("\n%s:\n", configs[c].text[0] ? configs[c].text : "(default)");
+            fflush(stdout);
+            predictorPrintProfile(configs[c].bp, instructions, STDOUT_FILENO);
+        }
+        predictorFree(configs[c].bp);
+    }
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+#include "perceptron.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Weight rows are padded to whole vectors, the padding weights stay zero
+#define VECTOR_BYTES 16
+#define HIST_WINDOW (MAX_PERCEPTRON_HIST + VECTOR_BYTES)
+
+// Weights and training state, shared by every perceptron created from the
+//   same one
+typedef struct _perceptronTables {
+    perceptronConfig cfg;
+    int users;
+    int histLength[MAX_PERCEPTRON_TABLES];
+    int rowLength[MAX_PERCEPTRON_TABLES];
+    int8_t* weights[MAX_PERCEPTRON_TABLES];
+    int8_t* bias[MAX_PERCEPTRON_TABLES];
+    uint8_t* touched[MAX_PERCEPTRON_TABLES];
+    int theta;
+
+    perceptronTableStats stats[MAX_PERCEPTRON_TABLES];
+} perceptronTables;
+
+struct _perceptron {
+    perceptronTables* tb;
+
+    // Global history as byte masks, 0x00 for taken and 0xff for not taken,
+    //   newest first.  Each bit is stored twice, HIST_WINDOW apart, so the
+    //   window starting at histPtr is always contiguous.
+    uint8_t hist[2 * HIST_WINDOW];
+    int histPtr;
+
+    // Lookup state of the branch between predict and update
+    uint32_t row[MAX_PERCEPTRON_TABLES];
+    int tableSum[MAX_PERCEPTRON_TABLES];
+    int sum;
+    bool pred;
+};
+
+void perceptronDefaultConfig(perceptronConfig* cfg) {
+    cfg->numTables = 4;
+    cfg->maxHist = 256;
+    cfg->logRows = 8;
+}
+
+// Histories of a new predictor start all not taken
+static perceptron* createHistory(perceptronTables* tb) {
+    perceptron* p = calloc(1, sizeof(perceptron));
+    p->tb = tb;
+    tb->users++;
+    memset(p->hist, 0xff, sizeof(p->hist));
+    return p;
+}
+
+perceptron* perceptronCreate(const perceptronConfig* cfg) {
+    if (cfg->numTables < 1 || cfg->numTables > MAX_PERCEPTRON_TABLES) {
+        fprintf(stderr, "Perceptron: between 1 and %d tables supported\n",
+                MAX_PERCEPTRON_TABLES);
+        return NULL;
+    }
+    if (cfg->maxHist < 1 || cfg->maxHist > MAX_PERCEPTRON_HIST) {
+        fprintf(stderr, "Perceptron: history length must be in 1..%d\n",
+                MAX_PERCEPTRON_HIST);
+        return NULL;
+    }
+    if (cfg->logRows < 1 || cfg->logRows > 20) {
+        fprintf(stderr, "Perceptron: log2 rows must be in 1..20\n");
+        return NULL;
+    }
+
+    perceptronTables* tb = calloc(1, sizeof(perceptronTables));
+    int inputs = 0;
+    tb->cfg = *cfg;
+
+    // History lengths halve from the longest table down
+    for (int i = 0; i < cfg->numTables; i++) {
+        int len = cfg->maxHist >> (cfg->numTables - 1 - i);
+        if (len < 1) {
+            len = 1;
+        }
+        tb->histLength[i] = len;
+        tb->rowLength[i] = (len + VECTOR_BYTES - 1) & ~(VECTOR_BYTES - 1);
+        tb->weights[i] = aligned_alloc(VECTOR_BYTES,
+                                       (size_t)tb->rowLength[i] << cfg->logRows);
+        memset(tb->weights[i], 0, (size_t)tb->rowLength[i] << cfg->logRows);
+        tb->bias[i] = calloc(1 << cfg->logRows, sizeof(int8_t));
+        tb->touched[i] = calloc(1 << cfg->logRows, sizeof(uint8_t));
+        inputs += len + 1;
+    }
+
+    // Training threshold from Jimenez and Lin
+    tb->theta = (int)(1.93 * inputs + 14);
+
+    return createHistory(tb);
+}
+
+perceptron* perceptronCreateSharing(perceptron* other) {
+    return createHistory(other->tb);
+}
+
+void perceptronFree(perceptron* p) {
+    if (p == NULL) {
+        return;
+    }
+    perceptronTables* tb = p->tb;
+    free(p);
+    if (--tb->users > 0) {
+        return;
+    }
+    for (int i = 0; i < tb->cfg.numTables; i++) {
+        free(tb->weights[i]);
+        free(tb->bias[i]);
+        free(tb->touched[i]);
+    }
+    free(tb);
+}
+
+// Dot product of a weight row with the history, len a multiple of
+//   VECTOR_BYTES.  Each weight is negated where its history bit is not taken,
+//   biased to unsigned and summed 8 bytes at a time with SAD.
+static int dotProduct(const int8_t* w, const uint8_t* h, int len) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i toUnsigned = _mm_set1_epi8((char)0x80);
+    __m128i acc = zero;
+
+    for (int j = 0; j < len; j += VECTOR_BYTES) {
+        __m128i wv = _mm_loadu_si128((const __m128i*)(w + j));
+        __m128i mv = _mm_loadu_si128((const __m128i*)(h + j));
+        __m128i v = _mm_sub_epi8(_mm_xor_si128(wv, mv), mv);
+        v = _mm_xor_si128(v, toUnsigned);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    int sum = _mm_cvtsi128_si32(acc)
+              + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+    return sum - 128 * len;
+#else
+    int sum = 0;
+    for (int j = 0; j < len; j++) {
+        sum += h[j] ? -w[j] : w[j];
+    }
+    return sum;
+#endif
+}
+
+// Move each weight one step towards agreeing with the outcome, saturating
+//   at +/-127 so that negation in dotProduct cannot overflow.
+static void train(int8_t* w, const uint8_t* h, int len, bool taken) {
+    uint8_t t = taken ? 0x00 : 0xff;
+    int j = 0;
+
+#ifdef __SSE2__
+    const __m128i tv = _mm_set1_epi8((char)t);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i minWeight = _mm_set1_epi8(-128);
+
+    for (; j + VECTOR_BYTES <= len; j += VECTOR_BYTES) {
+        __m128i wv = _mm_load_si128((const __m128i*)(w + j));
+        __m128i mv = _mm_loadu_si128((const __m128i*)(h + j));
+        __m128i step = _mm_or_si128(_mm_xor_si128(mv, tv), one);
+        wv = _mm_adds_epi8(wv, step);
+        wv = _mm_sub_epi8(wv, _mm_cmpeq_epi8(wv, minWeight));
+        _mm_store_si128((__m128i*)(w + j), wv);
+    }
+#endif
+    for (; j < len; j++) {
+        if (h[j] == t) {
+            if (w[j] < 127) {
+                w[j]++;
+            }
+        }
+        else if (w[j] > -127) {
+            w[j]--;
+        }
+    }
+}
+
+bool perceptronPredict(perceptron* p, uint64_t pc) {
+    uint32_t mask = (1u << p->tb->cfg.logRows) - 1;
+    uint64_t h = pc >> 2;
+    const uint8_t* window = &p->hist[p->histPtr];
+
+    p->sum = 0;
+    for (int i = 0; i < p->tb->cfg.numTables; i++) {
+        uint32_t row = (uint32_t)(h ^ (h >> p->tb->cfg.logRows) ^ (i * 0x2f1u))
+                       & mask;
+        const int8_t* w = &p->tb->weights[i][(size_t)row * p->tb->rowLength[i]];
+        p->row[i] = row;
+        p->tableSum[i] = p->tb->bias[i][row] + dotProduct(w, window, p->tb->rowLength[i]);
+        p->sum += p->tableSum[i];
+    }
+    p->pred = p->sum >= 0;
+    return p->pred;
+}
+
+void perceptronUpdate(perceptron* p, bool taken) {
+    const uint8_t* window = &p->hist[p->histPtr];
+    bool needsTraining = (p->pred != taken) || abs(p->sum) <= p->tb->theta;
+
+    for (int i = 0; i < p->tb->cfg.numTables; i++) {
+        uint32_t row = p->row[i];
+        perceptronTableStats* st = &p->tb->stats[i];
+
+        if (!p->tb->touched[i][row]) {
+            p->tb->touched[i][row] = 1;
+            st->rowsUsed++;
+        }
+        if ((p->tableSum[i] >= 0) == taken) {
+            st->agreed++;
+        }
+        if (needsTraining) {
+            int8_t* b = &p->tb->bias[i][row];
+            if (taken && *b < 127) {
+                (*b)++;
+            }
+            else if (!taken && *b > -127) {
+                (*b)--;
+            }
+            train(&p->tb->weights[i][(size_t)row * p->tb->rowLength[i]], window,
+                  p->tb->histLength[i], taken);
+            st->trained++;
+        }
+    }
+
+    p->histPtr = (p->histPtr + HIST_WINDOW - 1) % HIST_WINDOW;
+    p->hist[p->histPtr] = taken ? 0x00 : 0xff;
+    p->hist[p->histPtr + HIST_WINDOW] = p->hist[p->histPtr];
+}
+
+int perceptronTableCount(const perceptron* p) {
+    return p->tb->cfg.numTables;
+}
+
+int perceptronHistoryLength(const perceptron* p, int table) {
+    return p->tb->histLength[table];
+}
+
+const perceptronTableStats* perceptronGetStats(const perceptron* p, int table) {
+    return &p->tb->stats[table];
+}
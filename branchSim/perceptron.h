@@ -0,0 +1,43 @@
+#ifndef PERCEPTRON_H
+#define PERCEPTRON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Multi-table perceptron predictor.  Each table holds rows of int8 weights
+//   selected by a hash of the pc, and covers its own global history length;
+//   the prediction is the sign of the summed dot products of the selected
+//   rows with the history, taken as +1 for taken and -1 for not taken.
+
+#define MAX_PERCEPTRON_TABLES 16
+#define MAX_PERCEPTRON_HIST 1024
+
+typedef struct _perceptronConfig {
+    int numTables;
+    int maxHist; // history length of the longest table
+    int logRows; // log2 rows per table
+} perceptronConfig;
+
+typedef struct _perceptronTableStats {
+    uint64_t rowsUsed;
+    uint64_t agreed;   // predictions where the table's sum matched the outcome
+    uint64_t trained;
+} perceptronTableStats;
+
+typedef struct _perceptron perceptron;
+
+void perceptronDefaultConfig(perceptronConfig* cfg);
+perceptron* perceptronCreate(const perceptronConfig* cfg);
+// A predictor with its own history that shares the weights of other
+perceptron* perceptronCreateSharing(perceptron* other);
+void perceptronFree(perceptron* p);
+
+// As with TAGE, the lookup state is kept until the following update
+bool perceptronPredict(perceptron* p, uint64_t pc);
+void perceptronUpdate(perceptron* p, bool taken);
+
+int perceptronTableCount(const perceptron* p);
+int perceptronHistoryLength(const perceptron* p, int table);
+const perceptronTableStats* perceptronGetStats(const perceptron* p, int table);
+
+#endif
@@ -0,0 +1,551 @@
+#include <branch.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "predictor.h"
+
+typedef unsigned char counter;
+
+// Counter tables, shared like the TAGE and perceptron tables
+typedef struct _counterTables {
+    counter* predictor;
+    counter* localPHT;
+    counter* chooser;
+    int users;
+} counterTables;
+
+struct _predictor {
+    predictorConfig cfg;
+    counterTables* tables;
+    uint64_t BHR;
+    uint64_t* localBHT; // per-branch histories, never shared
+    tage* tagePredictor;
+    perceptron* perceptronPredictor;
+    targetPredictor* targets;
+    branchProfile* profile;
+    predictorStats stats;
+
+    // Tournament component use, chosen and correct
+    uint64_t choseGlobal;
+    uint64_t choseGlobalCorrect;
+    uint64_t choseLocal;
+    uint64_t choseLocalCorrect;
+};
+
+void predictorDefaultConfig(predictorConfig* cfg) {
+    cfg->model = DEFAULT;
+    cfg->logSize = 10;
+    cfg->historyBits = 0;
+    cfg->logLocalBHT = 10;
+    cfg->localHistBits = 10;
+    cfg->logLocalPHT = 10;
+    cfg->logChooser = 0;
+    cfg->tournamentGlobal = GSHARE;
+    tageDefaultConfig(&cfg->tage);
+    perceptronDefaultConfig(&cfg->perceptron);
+    targetDefaultConfig(&cfg->target);
+    cfg->profileTop = 0;
+}
+
+bool predictorParseOption(predictorConfig* cfg, int op, const char* arg) {
+    switch (op) {
+        // Counter table size and global history bits
+        case 's':
+            cfg->logSize = atoi(arg);
+            return true;
+        case 'b':
+            cfg->historyBits = atoi(arg);
+            return true;
+
+        // Predictor model, enum BRANCH_MODEL_TYPE
+        case 'g':
+            cfg->model = atoi(arg);
+            return true;
+
+        // TAGE tagged tables
+        case 't':
+            cfg->tage.numTables = atoi(arg);
+            return true;
+
+        // TAGE shortest and longest history lengths
+        case 'm':
+            cfg->tage.minHist = atoi(arg);
+            return true;
+        case 'M':
+            cfg->tage.maxHist = atoi(arg);
+            return true;
+
+        // TAGE log2 entries per tagged table
+        case 'e':
+            cfg->tage.logEntries = atoi(arg);
+            return true;
+
+        // TAGE statistical corrector and loop predictor, 0 disables
+        case 'c':
+            cfg->tage.useSC = atoi(arg) != 0;
+            return true;
+        case 'o':
+            cfg->tage.useLoop = atoi(arg) != 0;
+            return true;
+
+        // Perceptron tables, longest history and log2 rows per table
+        case 'n':
+            cfg->perceptron.numTables = atoi(arg);
+            return true;
+        case 'H':
+            cfg->perceptron.maxHist = atoi(arg);
+            return true;
+        case 'R':
+            cfg->perceptron.logRows = atoi(arg);
+            return true;
+
+        // Local predictor, log2 history table entries, history bits and
+        //   log2 counter table entries
+        case 'l':
+            cfg->logLocalBHT = atoi(arg);
+            return true;
+        case 'w':
+            cfg->localHistBits = atoi(arg);
+            return true;
+        case 'L':
+            cfg->logLocalPHT = atoi(arg);
+            return true;
+
+        // Tournament log2 chooser entries and global model
+        case 'C':
+            cfg->logChooser = atoi(arg);
+            return true;
+        case 'G':
+            cfg->tournamentGlobal = atoi(arg);
+            return true;
+
+        // BTB ways and log2 sets
+        case 'A':
+            cfg->target.ways = atoi(arg);
+            return true;
+        case 'B':
+            cfg->target.logSets = atoi(arg);
+            return true;
+
+        // Return address stack entries, 0 disables
+        case 'a':
+            cfg->target.rasSize = atoi(arg);
+            return true;
+
+        // Indirect predictor tagged tables (0 disables) and log2 entries
+        //   per table
+        case 'i':
+            cfg->target.indirectTables = atoi(arg);
+            return true;
+        case 'I':
+            cfg->target.indirectLogEntries = atoi(arg);
+            return true;
+
+        // Profile branches by pc, listing this many at finish
+        case 'P':
+            cfg->profileTop = atoi(arg);
+            return true;
+    }
+    return false;
+}
+
+static counter incrementCounter(counter c) {
+    if (c == 3) {
+        return c;
+    }
+    return c + 1;
+}
+
+static counter decrementCounter(counter c) {
+    if (c == 0) {
+        return c;
+    }
+    return c - 1;
+}
+
+static bool predict(counter c) {
+    if (c == 0 || c == 1) {
+        return false;
+    }
+    else {
+        return true;
+    }
+}
+
+static void addToBHR(predictor* bp, bool taken) {
+    uint8_t t = (uint8_t)taken;
+    bp->BHR = ((bp->BHR << 1) | t) & ((1L << bp->cfg.historyBits) - 1);
+}
+
+static uint64_t getIndex(predictor* bp, uint64_t addr, int model) {
+    int s = bp->cfg.logSize;
+    int b = bp->cfg.historyBits;
+
+    if (model == GSELECT) {
+        return (((addr >> 3) & ((1L << (s-b)) - 1)) << b) | bp->BHR;
+    }
+    else if (model == GSHARE) {
+        return ((addr >> 3) ^ bp->BHR) & ((1L << s) - 1);
+    }
+    return (addr >> 3) & ((1L << s) - 1);
+}
+
+// Yeh-Patt two-level local predictor.  A per-branch history table feeds a
+//   counter table indexed by the local history, with pc bits above it when
+//   the counter table is larger than the history.
+static uint64_t* getLocalHistory(predictor* bp, uint64_t addr) {
+    uint64_t index = (addr >> 3) & ((1L << bp->cfg.logLocalBHT) - 1);
+    return &bp->localBHT[index];
+}
+
+static counter* getLocalCounter(predictor* bp, uint64_t addr) {
+    uint64_t index = ((addr >> 3) << bp->cfg.localHistBits)
+                     | *getLocalHistory(bp, addr);
+    return &bp->tables->localPHT[index & ((1L << bp->cfg.logLocalPHT) - 1)];
+}
+
+static void addToLocalHistory(predictor* bp, uint64_t addr, bool taken) {
+    uint64_t* h = getLocalHistory(bp, addr);
+    *h = ((*h << 1) | taken) & ((1L << bp->cfg.localHistBits) - 1);
+}
+
+static counter* getChooser(predictor* bp, uint64_t addr) {
+    uint64_t index = (addr >> 3) & ((1L << bp->cfg.logChooser) - 1);
+    return &bp->tables->chooser[index];
+}
+
+// Reject models and table sizes the predictor cannot be built with, rather
+//   than run some other configuration in their place
+static bool checkConfig(const predictorConfig* cfg) {
+    if (cfg->model < DEFAULT || cfg->model > TOURNAMENT) {
+        fprintf(stderr, "Branch: unknown predictor model %d\n", cfg->model);
+        return false;
+    }
+    if (cfg->logSize < 0 || cfg->logSize > 30
+        || cfg->historyBits < 0 || cfg->historyBits > 62) {
+        fprintf(stderr, "Branch: log2 size must be in 0..30 and history "
+                        "bits in 0..62\n");
+        return false;
+    }
+    int global = (cfg->model == TOURNAMENT) ? cfg->tournamentGlobal
+                                            : cfg->model;
+    if (cfg->model == TOURNAMENT && global != GSHARE && global != GSELECT) {
+        fprintf(stderr, "Branch: the tournament global model must be "
+                        "gshare or gselect\n");
+        return false;
+    }
+    // gselect takes the pc bits above the history from the counter index
+    if (global == GSELECT && cfg->historyBits >= cfg->logSize) {
+        fprintf(stderr, "Branch: gselect needs fewer history bits than "
+                        "log2 size\n");
+        return false;
+    }
+    if ((cfg->model == YEH_PATT || cfg->model == TOURNAMENT)
+        && (cfg->logLocalBHT < 0 || cfg->logLocalBHT > 30
+            || cfg->localHistBits < 0 || cfg->localHistBits > 62
+            || cfg->logLocalPHT < 0 || cfg->logLocalPHT > 30)) {
+        fprintf(stderr, "Branch: local table log2 sizes must be in 0..30 and "
+                        "local history bits in 0..62\n");
+        return false;
+    }
+    if (cfg->model == TOURNAMENT
+        && (cfg->logChooser < 0 || cfg->logChooser > 30)) {
+        fprintf(stderr, "Branch: log2 chooser size must be in 0..30\n");
+        return false;
+    }
+    return true;
+}
+
+predictor* predictorCreate(const predictorConfig* cfg, predictor* shareWith) {
+    if (!checkConfig(cfg)) {
+        return NULL;
+    }
+
+    predictor* bp = calloc(1, sizeof(predictor));
+    bp->cfg = *cfg;
+    if (bp->cfg.logChooser == 0) {
+        bp->cfg.logChooser = cfg->logSize;
+    }
+    // By default the BTB holds as many targets as the counter table
+    if (bp->cfg.target.logSets < 0) {
+        int logWays = 0;
+        while ((1 << logWays) < cfg->target.ways) {
+            logWays++;
+        }
+        bp->cfg.target.logSets = (cfg->logSize > logWays)
+                                     ? cfg->logSize - logWays : 0;
+    }
+    if (cfg->profileTop > 0) {
+        bp->profile = profileCreate();
+    }
+    if (cfg->model == YEH_PATT || cfg->model == TOURNAMENT) {
+        bp->localBHT = calloc(1L << cfg->logLocalBHT, sizeof(uint64_t));
+    }
+
+    if (shareWith != NULL) {
+        bp->tables = shareWith->tables;
+        bp->tables->users++;
+        bp->targets = targetCreateSharing(shareWith->targets);
+        if (cfg->model == TAGE_SC_L) {
+            bp->tagePredictor = tageCreateSharing(shareWith->tagePredictor);
+        }
+        else if (cfg->model == PERCEPTRON) {
+            bp->perceptronPredictor
+                = perceptronCreateSharing(shareWith->perceptronPredictor);
+        }
+        return bp;
+    }
+
+    bp->targets = targetCreate(&bp->cfg.target);
+    if (bp->targets == NULL) {
+        free(bp->localBHT);
+        free(bp);
+        return NULL;
+    }
+    if (cfg->model == TAGE_SC_L) {
+        bp->tagePredictor = tageCreate(&cfg->tage);
+        if (bp->tagePredictor == NULL) {
+            targetFree(bp->targets);
+            free(bp->localBHT);
+            free(bp);
+            return NULL;
+        }
+    }
+    else if (cfg->model == PERCEPTRON) {
+        bp->perceptronPredictor = perceptronCreate(&cfg->perceptron);
+        if (bp->perceptronPredictor == NULL) {
+            targetFree(bp->targets);
+            free(bp->localBHT);
+            free(bp);
+            return NULL;
+        }
+    }
+
+    uint64_t predictorSize = 1L << cfg->logSize;
+    bp->tables = calloc(1, sizeof(counterTables));
+    bp->tables->users = 1;
+    bp->tables->predictor = malloc(predictorSize * sizeof(counter));
+    for (uint64_t i = 0; i < predictorSize; i++) {
+        bp->tables->predictor[i] = 1;
+    }
+    if (cfg->model == YEH_PATT || cfg->model == TOURNAMENT) {
+        uint64_t phtSize = 1L << cfg->logLocalPHT;
+        bp->tables->localPHT = malloc(phtSize * sizeof(counter));
+        for (uint64_t i = 0; i < phtSize; i++) {
+            bp->tables->localPHT[i] = 1;
+        }
+    }
+    if (cfg->model == TOURNAMENT) {
+        uint64_t chooserSize = 1L << bp->cfg.logChooser;
+        bp->tables->chooser = malloc(chooserSize * sizeof(counter));
+        for (uint64_t i = 0; i < chooserSize; i++) {
+            bp->tables->chooser[i] = 1;
+        }
+    }
+    return bp;
+}
+
+void predictorFree(predictor* bp) {
+    if (bp == NULL) {
+        return;
+    }
+    tageFree(bp->tagePredictor);
+    perceptronFree(bp->perceptronPredictor);
+    targetFree(bp->targets);
+    profileFree(bp->profile);
+    free(bp->localBHT);
+    if (--bp->tables->users == 0) {
+        free(bp->tables->predictor);
+        free(bp->tables->localPHT);
+        free(bp->tables->chooser);
+        free(bp->tables);
+    }
+    free(bp);
+}
+
+uint64_t predictorRequest(predictor* bp, trace_op* op) {
+    uint64_t pcAddress = op->pcAddress;
+    uint64_t nextAddress = op->nextPCAddress;
+    uint64_t predAddress = 0;
+    bool actual = (nextAddress != pcAddress + 4);
+    counter* c = NULL;
+    counter* local = NULL;
+    counter* chooser = NULL;
+    bool globalPred = false;
+    bool localPred = false;
+
+    //predict
+    bool taken;
+    if (bp->cfg.model == TAGE_SC_L) {
+        taken = tagePredict(bp->tagePredictor, pcAddress);
+    }
+    else if (bp->cfg.model == PERCEPTRON) {
+        taken = perceptronPredict(bp->perceptronPredictor, pcAddress);
+    }
+    else if (bp->cfg.model == YEH_PATT) {
+        local = getLocalCounter(bp, pcAddress);
+        taken = predict(*local);
+    }
+    else if (bp->cfg.model == TOURNAMENT) {
+        c = &bp->tables->predictor[getIndex(bp, pcAddress,
+                                            bp->cfg.tournamentGlobal)];
+        local = getLocalCounter(bp, pcAddress);
+        chooser = getChooser(bp, pcAddress);
+        globalPred = predict(*c);
+        localPred = predict(*local);
+        taken = predict(*chooser) ? globalPred : localPred;
+    }
+    else {
+        c = &bp->tables->predictor[getIndex(bp, pcAddress, bp->cfg.model)];
+        taken = predict(*c);
+    }
+    // The BTB is read for every branch; a taken prediction that misses in
+    //   it has no target to redirect to and falls through
+    uint64_t target = targetPredict(bp->targets, pcAddress);
+    if (taken && target != 0) {
+        predAddress = target;
+    }
+    else {
+        predAddress = pcAddress + 4;
+    }
+
+    bp->stats.branches++;
+    if (predAddress != nextAddress) {
+        bp->stats.mispredicts++;
+        if (taken != actual) {
+            bp->stats.directionMispredicts++;
+        }
+        else {
+            bp->stats.targetMispredicts++;
+        }
+    }
+    if (bp->profile != NULL) {
+        profileRecord(bp->profile, pcAddress, actual,
+                      predAddress != nextAddress,
+                      predAddress != nextAddress && taken == actual);
+    }
+
+    //update predictor
+    if (bp->cfg.model == TAGE_SC_L) {
+        tageUpdate(bp->tagePredictor, pcAddress, actual);
+    }
+    else if (bp->cfg.model == PERCEPTRON) {
+        perceptronUpdate(bp->perceptronPredictor, actual);
+    }
+    else {
+        if (chooser != NULL) {
+            if (predict(*chooser)) {
+                bp->choseGlobal++;
+                bp->choseGlobalCorrect += (globalPred == actual);
+            }
+            else {
+                bp->choseLocal++;
+                bp->choseLocalCorrect += (localPred == actual);
+            }
+            // The chooser only learns when the components disagree
+            if (globalPred != localPred) {
+                *chooser = (globalPred == actual) ? incrementCounter(*chooser)
+                                                  : decrementCounter(*chooser);
+            }
+        }
+        if (c != NULL) {
+            *c = actual ? incrementCounter(*c) : decrementCounter(*c);
+            addToBHR(bp, actual);
+        }
+        if (local != NULL) {
+            *local = actual ? incrementCounter(*local) : decrementCounter(*local);
+            addToLocalHistory(bp, pcAddress, actual);
+        }
+    }
+    targetUpdate(bp->targets, pcAddress, actual, nextAddress);
+
+    return predAddress;
+}
+
+const predictorStats* predictorGetStats(const predictor* bp) {
+    return &bp->stats;
+}
+
+static void printTageStats(const tage* t, int outFd) {
+    const tageStats* ts = tageGetStats(t);
+    char buf[128];
+    int len;
+
+    len = snprintf(buf, sizeof(buf), "TAGE base provided - %lu\n",
+                   ts->baseProvided);
+    (void)!write(outFd, buf, len);
+    for (int i = 0; i < tageTableCount(t); i++) {
+        len = snprintf(buf, sizeof(buf), "TAGE table %d (history %d) provided - %lu\n",
+                       i, tageHistoryLength(t, i), ts->providerHits[i]);
+        (void)!write(outFd, buf, len);
+    }
+    len = snprintf(buf, sizeof(buf), "TAGE allocations - %lu\n", ts->allocations);
+    (void)!write(outFd, buf, len);
+    len = snprintf(buf, sizeof(buf), "SC overrides - %lu (%lu correct)\n",
+                   ts->scOverrides, ts->scOverridesCorrect);
+    (void)!write(outFd, buf, len);
+    len = snprintf(buf, sizeof(buf), "Loop overrides - %lu (%lu correct)\n",
+                   ts->loopOverrides, ts->loopOverridesCorrect);
+    (void)!write(outFd, buf, len);
+}
+
+static void printPerceptronStats(const perceptron* p, int outFd) {
+    char buf[128];
+    int len;
+
+    for (int i = 0; i < perceptronTableCount(p); i++) {
+        const perceptronTableStats* ps = perceptronGetStats(p, i);
+        len = snprintf(buf, sizeof(buf),
+                       "Perceptron table %d (history %d) - rows used %lu, agreed %lu, trained %lu\n",
+                       i, perceptronHistoryLength(p, i),
+                       ps->rowsUsed, ps->agreed, ps->trained);
+        (void)!write(outFd, buf, len);
+    }
+}
+
+static void printTargetStats(const targetPredictor* tp, int outFd) {
+    const targetStats* ts = targetGetStats(tp);
+    char buf[160];
+    int len;
+
+    len = snprintf(buf, sizeof(buf),
+                   "BTB lookups - %lu, hits - %lu, misses - %lu (aliased %lu), evictions - %lu\n",
+                   ts->lookups, ts->hits, ts->misses, ts->aliased, ts->evictions);
+    (void)!write(outFd, buf, len);
+    len = snprintf(buf, sizeof(buf),
+                   "RAS predictions - %lu (%lu correct), overflows - %lu\n",
+                   ts->rasPredictions, ts->rasCorrect, ts->rasOverflows);
+    (void)!write(outFd, buf, len);
+    len = snprintf(buf, sizeof(buf),
+                   "Indirect predictions - %lu (%lu correct, %lu from tagged tables), allocations - %lu\n",
+                   ts->indirectPredictions, ts->indirectCorrect,
+                   ts->indirectProvided, ts->indirectAllocations);
+    (void)!write(outFd, buf, len);
+}
+
+void predictorPrintModelStats(const predictor* bp, int outFd) {
+    printTargetStats(bp->targets, outFd);
+    if (bp->cfg.model == TOURNAMENT) {
+        char buf[128];
+        int len = snprintf(buf, sizeof(buf),
+                           "Tournament chose global - %lu (%lu correct), local - %lu (%lu correct)\n",
+                           bp->choseGlobal, bp->choseGlobalCorrect,
+                           bp->choseLocal, bp->choseLocalCorrect);
+        (void)!write(outFd, buf, len);
+    }
+    if (bp->tagePredictor != NULL) {
+        printTageStats(bp->tagePredictor, outFd);
+    }
+    if (bp->perceptronPredictor != NULL) {
+        printPerceptronStats(bp->perceptronPredictor, outFd);
+    }
+}
+
+void predictorPrintProfile(const predictor* bp, uint64_t instructions,
+                           int outFd) {
+    if (bp->profile != NULL) {
+        profilePrint(bp->profile, bp->cfg.profileTop, instructions, outFd);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <trace.h>
+
+#include "perceptron.h"
+#include "profile.h"
+#include "tage.h"
+#include "target.h"
+
+// One complete branch predictor: a direction predictor of the configured
+//   model and a target predictor.  branchSim keeps one per processor;
+//   predictors created to share with another use its tables but keep their
+//   own histories.
+
+typedef struct _predictorConfig {
+    int model;       // enum BRANCH_MODEL_TYPE
+    int logSize;     // log2 entries of the counter table
+    int historyBits; // global history bits for the counter table
+    int logLocalBHT; // log2 entries of the per-branch local histories
+    int localHistBits;
+    int logLocalPHT; // log2 counters indexed by local history and pc
+    int logChooser;  // log2 tournament chooser counters, 0 for logSize
+    int tournamentGlobal; // GSHARE or GSELECT half of the tournament
+    tageConfig tage;
+    perceptronConfig perceptron;
+    targetConfig target; // BTB sets of -1 size it like the counter table
+    int profileTop;      // branches listed by the per-pc profile, 0 disables
+} predictorConfig;
+
+typedef struct _predictorStats {
+    uint64_t branches;
+    uint64_t mispredicts;          // predicted address was wrong
+    uint64_t directionMispredicts;
+    uint64_t targetMispredicts;    // direction right, taken target wrong
+} predictorStats;
+
+typedef struct _predictor predictor;
+
+// getopt options that configure a predictor, shared by branchSim and
+//   branchEval
+#define PREDICTOR_OPTIONS "s:b:g:t:m:M:e:c:o:n:H:R:l:w:L:C:G:A:B:a:i:I:P:"
+
+void predictorDefaultConfig(predictorConfig* cfg);
+// Apply one of PREDICTOR_OPTIONS, false if op is not one of them
+bool predictorParseOption(predictorConfig* cfg, int op, const char* arg);
+predictor* predictorCreate(const predictorConfig* cfg, predictor* shareWith);
+void predictorFree(predictor* bp);
+
+// Predict the next pc after the branch op, then train on its outcome
+uint64_t predictorRequest(predictor* bp, trace_op* op);
+
+const predictorStats* predictorGetStats(const predictor* bp);
+
+// Model specific statistics, for predictors that own their tables
+void predictorPrintModelStats(const predictor* bp, int outFd);
+
+// Per-pc profile, when enabled; instructions may be 0 if not known
+void predictorPrintProfile(const predictor* bp, uint64_t instructions,
+                           int outFd);
+
+#endif
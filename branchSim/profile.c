@@ -0,0 +1,154 @@
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PROFILE_INITIAL_SLOTS 1024
+
+typedef struct _profileEntry {
+    uint64_t pc; // 0 marks an empty slot
+    uint64_t executions;
+    uint64_t taken;
+    uint64_t mispredicts;
+    uint64_t targetMispredicts;
+} profileEntry;
+
+// Open addressing with linear probing, doubled when 3/4 full
+struct _branchProfile {
+    profileEntry* slots;
+    uint64_t slotCount;
+    uint64_t used;
+    uint64_t mispredicts;
+};
+
+branchProfile* profileCreate(void) {
+    branchProfile* prof = calloc(1, sizeof(branchProfile));
+    prof->slotCount = PROFILE_INITIAL_SLOTS;
+    prof->slots = calloc(prof->slotCount, sizeof(profileEntry));
+    return prof;
+}
+
+void profileFree(branchProfile* prof) {
+    if (prof == NULL) {
+        return;
+    }
+    free(prof->slots);
+    free(prof);
+}
+
+static uint64_t hashPc(uint64_t pc) {
+    pc ^= pc >> 33;
+    pc *= 0xff51afd7ed558ccdULL;
+    pc ^= pc >> 33;
+    return pc;
+}
+
+static profileEntry* findSlot(profileEntry* slots, uint64_t slotCount,
+                              uint64_t pc) {
+    uint64_t i = hashPc(pc) & (slotCount - 1);
+    while (slots[i].pc != 0 && slots[i].pc != pc) {
+        i = (i + 1) & (slotCount - 1);
+    }
+    return &slots[i];
+}
+
+static void grow(branchProfile* prof) {
+    uint64_t newCount = prof->slotCount * 2;
+    profileEntry* newSlots = calloc(newCount, sizeof(profileEntry));
+    for (uint64_t i = 0; i < prof->slotCount; i++) {
+        if (prof->slots[i].pc != 0) {
+            *findSlot(newSlots, newCount, prof->slots[i].pc) = prof->slots[i];
+        }
+    }
+    free(prof->slots);
+    prof->slots = newSlots;
+    prof->slotCount = newCount;
+}
+
+void profileRecord(branchProfile* prof, uint64_t pc, bool taken,
+                   bool mispredict, bool targetMispredict) {
+    profileEntry* e = findSlot(prof->slots, prof->slotCount, pc);
+    if (e->pc == 0) {
+        if (4 * (prof->used + 1) > 3 * prof->slotCount) {
+            grow(prof);
+            e = findSlot(prof->slots, prof->slotCount, pc);
+        }
+        e->pc = pc;
+        prof->used++;
+    }
+    e->executions++;
+    e->taken += taken;
+    e->mispredicts += mispredict;
+    e->targetMispredicts += targetMispredict;
+    prof->mispredicts += mispredict;
+}
+
+static int byMispredicts(const void* a, const void* b) {
+    const profileEntry* x = *(const profileEntry* const*)a;
+    const profileEntry* y = *(const profileEntry* const*)b;
+    if (x->mispredicts != y->mispredicts) {
+        return (x->mispredicts < y->mispredicts) ? 1 : -1;
+    }
+    return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+void profilePrint(const branchProfile* prof, int top, uint64_t instructions,
+                  int outFd) {
+    char buf[192];
+    int len;
+
+    profileEntry** order = malloc(prof->used * sizeof(profileEntry*));
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < prof->slotCount; i++) {
+        if (prof->slots[i].pc != 0) {
+            order[n++] = &prof->slots[i];
+        }
+    }
+    qsort(order, n, sizeof(profileEntry*), byMispredicts);
+
+    len = snprintf(buf, sizeof(buf),
+                   "Branch profile - %lu static branches, %lu mispredicts\n",
+                   n, prof->mispredicts);
+    (void)!write(outFd, buf, len);
+    len = snprintf(buf, sizeof(buf), "%18s %10s %7s %11s %8s %7s %7s%s\n",
+                   "pc", "executions", "taken", "mispredicts", "target",
+                   "share", "cumul", instructions ? "     MPKI" : "");
+    (void)!write(outFd, buf, len);
+
+    uint64_t cumulative = 0;
+    for (uint64_t i = 0; i < n && i < (uint64_t)top; i++) {
+        profileEntry* e = order[i];
+        double share = prof->mispredicts
+                           ? 100.0 * e->mispredicts / prof->mispredicts : 0.0;
+        cumulative += e->mispredicts;
+        len = snprintf(buf, sizeof(buf),
+                       "%#18lx %10lu %6.1f%% %11lu %8lu %6.2f%% %6.2f%%",
+                       e->pc, e->executions, 100.0 * e->taken / e->executions,
+                       e->mispredicts, e->targetMispredicts, share,
+                       prof->mispredicts
+                           ? 100.0 * cumulative / prof->mispredicts : 0.0);
+        if (instructions) {
+            len += snprintf(buf + len, sizeof(buf) - len, " %8.3f",
+                            1000.0 * e->mispredicts / instructions);
+        }
+        buf[len++] = '\n';
+        (void)!write(outFd, buf, len);
+    }
+
+    // How many static branches it takes to cover the mispredicts
+    static const int coverage[] = {50, 90, 99};
+    for (int c = 0; c < 3; c++) {
+        uint64_t sum = 0;
+        uint64_t count = 0;
+        while (count < n && 100 * sum < coverage[c] * prof->mispredicts) {
+            sum += order[count++]->mispredicts;
+        }
+        len = snprintf(buf, sizeof(buf),
+                       "Branches causing %d%% of mispredicts - %lu\n",
+                       coverage[c], count);
+        (void)!write(outFd, buf, len);
+    }
+
+    free(order);
+}
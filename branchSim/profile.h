@@ -0,0 +1,25 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-pc branch profile, kept to find the hard to predict branches.  Each
+//   static branch counts its executions, taken outcomes and mispredicts, of
+//   which target mispredicts are those where the direction was right.
+
+typedef struct _branchProfile branchProfile;
+
+branchProfile* profileCreate(void);
+void profileFree(branchProfile* prof);
+
+void profileRecord(branchProfile* prof, uint64_t pc, bool taken,
+                   bool mispredict, bool targetMispredict);
+
+// Print the top branches by mispredicts and how the mispredicts are spread
+//   over the static branches.  MPKI is included when instructions is known;
+//   pass 0 to leave the column out.
+void profilePrint(const branchProfile* prof, int top, uint64_t instructions,
+                  int outFd);
+
+#endif
@@ -0,0 +1,555 @@
+#include "tage.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_TAGE_TABLES 20
+#define HIST_BUFFER_SIZE 4096
+#define HIST_BUFFER_MASK (HIST_BUFFER_SIZE - 1)
+#define U_RESET_PERIOD (1 << 18)
+
+#define SC_TABLES 4
+#define LOOP_ENTRIES 64
+#define LOOP_TAG_BITS 14
+#define LOOP_CONFIDENT 3
+
+// Global history folded down to a table's index or tag width.  Each update
+//   shifts in the newest history bit and cancels the bit that has left the
+//   window, so the fold costs O(1) however long the history is.
+typedef struct _foldedHistory {
+    uint32_t comp;
+    int compLength;
+    int origLength;
+    int outPoint;
+} foldedHistory;
+
+typedef struct _tageEntry {
+    int8_t ctr;  // 3 bit signed counter, taken when >= 0
+    uint16_t tag;
+    uint8_t u;   // 2 bit useful counter
+} tageEntry;
+
+typedef struct _loopEntry {
+    uint16_t tag;
+    uint16_t pastIter;    // iterations in the last complete run of the loop
+    uint16_t currentIter;
+    uint8_t confidence;
+    uint8_t age;
+    bool dir;             // direction taken while the loop keeps iterating
+} loopEntry;
+
+// Tables and training state, shared by every tage that was created from
+//   the same one
+typedef struct _tageTables {
+    tageConfig cfg;
+    int users;
+    int histLength[MAX_TAGE_TABLES];
+    int tagBits[MAX_TAGE_TABLES];
+    tageEntry* tables[MAX_TAGE_TABLES];
+    uint8_t* base;
+    int logBase;
+
+    int8_t useAltOnNa;
+    uint64_t updateCount;
+    uint32_t seed;
+
+    int8_t* sc[SC_TABLES];
+    int scThreshold;
+    int scThresholdCtr;
+
+    loopEntry loops[LOOP_ENTRIES];
+    int8_t useLoop;
+
+    tageStats stats;
+} tageTables;
+
+struct _tage {
+    tageTables* tb;
+
+    uint8_t ghist[HIST_BUFFER_SIZE];
+    int ghistPtr;
+    uint64_t recentHist; // newest 64 history bits, for the short SC histories
+    uint32_t pathHist;
+    foldedHistory indexFold[MAX_TAGE_TABLES];
+    foldedHistory tagFold[2][MAX_TAGE_TABLES];
+
+    // Lookup state of the branch between tagePredict and tageUpdate
+    uint32_t index[MAX_TAGE_TABLES];
+    uint16_t tag[MAX_TAGE_TABLES];
+    uint32_t baseIndex;
+    int provider;
+    int altProvider;
+    bool longestPred;
+    bool altPred;
+    bool tagePred;
+    uint32_t scIndex[SC_TABLES];
+    int scSum;
+    bool scPred;
+    bool scUsed;
+    int loopIndex;
+    bool loopHit;
+    bool loopValid;
+    bool loopPred;
+    bool finalPred;
+};
+
+static const int scHistLength[SC_TABLES] = {0, 4, 8, 16};
+
+void tageDefaultConfig(tageConfig* cfg) {
+    cfg->numTables = 7;
+    cfg->minHist = 5;
+    cfg->maxHist = 130;
+    cfg->logEntries = 10;
+    cfg->useSC = true;
+    cfg->useLoop = true;
+}
+
+static void foldInit(foldedHistory* f, int origLength, int compLength) {
+    f->comp = 0;
+    f->origLength = origLength;
+    f->compLength = compLength;
+    f->outPoint = origLength % compLength;
+}
+
+static void foldUpdate(foldedHistory* f, const uint8_t* hist, int ptr) {
+    f->comp = (f->comp << 1) | hist[ptr & HIST_BUFFER_MASK];
+    f->comp ^= (uint32_t)hist[(ptr + f->origLength) & HIST_BUFFER_MASK]
+               << f->outPoint;
+    f->comp ^= f->comp >> f->compLength;
+    f->comp &= (1u << f->compLength) - 1;
+}
+
+static uint32_t nextRandom(tage* t) {
+    t->tb->seed ^= t->tb->seed << 13;
+    t->tb->seed ^= t->tb->seed >> 17;
+    t->tb->seed ^= t->tb->seed << 5;
+    return t->tb->seed;
+}
+
+static int8_t satInc(int8_t v, int8_t max) {
+    return (v < max) ? v + 1 : v;
+}
+
+static int8_t satDec(int8_t v, int8_t min) {
+    return (v > min) ? v - 1 : v;
+}
+
+// Histories of a new predictor start empty, sized from its tables
+static tage* createHistory(tageTables* tb) {
+    tage* t = calloc(1, sizeof(tage));
+    t->tb = tb;
+    tb->users++;
+    for (int i = 0; i < tb->cfg.numTables; i++) {
+        foldInit(&t->indexFold[i], tb->histLength[i], tb->cfg.logEntries);
+        foldInit(&t->tagFold[0][i], tb->histLength[i], tb->tagBits[i]);
+        foldInit(&t->tagFold[1][i], tb->histLength[i], tb->tagBits[i] - 1);
+    }
+    return t;
+}
+
+tage* tageCreate(const tageConfig* cfg) {
+    if (cfg->numTables < 1 || cfg->numTables > MAX_TAGE_TABLES) {
+        fprintf(stderr, "TAGE: between 1 and %d tagged tables supported\n",
+                MAX_TAGE_TABLES);
+        return NULL;
+    }
+    if (cfg->minHist < 1 || cfg->maxHist < cfg->minHist
+        || cfg->maxHist >= HIST_BUFFER_SIZE) {
+        fprintf(stderr, "TAGE: need 1 <= min history <= max history < %d\n",
+                HIST_BUFFER_SIZE);
+        return NULL;
+    }
+    if (cfg->logEntries < 4 || cfg->logEntries > 20) {
+        fprintf(stderr, "TAGE: log2 table entries must be in 4..20\n");
+        return NULL;
+    }
+
+    tageTables* tb = calloc(1, sizeof(tageTables));
+    int n = cfg->numTables;
+    tb->cfg = *cfg;
+    tb->seed = 0x2545f491;
+
+    // Geometric series of history lengths from minHist to maxHist
+    for (int i = 0; i < n; i++) {
+        double ratio = (n == 1) ? 0.0 : (double)i / (n - 1);
+        tb->histLength[i] = (int)(cfg->minHist
+                                  * pow((double)cfg->maxHist / cfg->minHist,
+                                        ratio)
+                                  + 0.5);
+        if (i > 0 && tb->histLength[i] <= tb->histLength[i - 1]) {
+            tb->histLength[i] = tb->histLength[i - 1] + 1;
+        }
+        tb->tagBits[i] = (n == 1) ? 8 : 8 + (i * 4) / (n - 1);
+        tb->tables[i] = calloc(1 << cfg->logEntries, sizeof(tageEntry));
+    }
+
+    tb->logBase = cfg->logEntries + 2;
+    tb->base = malloc(1 << tb->logBase);
+    for (int i = 0; i < (1 << tb->logBase); i++) {
+        tb->base[i] = 1;
+    }
+
+    for (int i = 0; i < SC_TABLES; i++) {
+        tb->sc[i] = calloc(1 << cfg->logEntries, sizeof(int8_t));
+    }
+    tb->scThreshold = 6;
+    tb->useLoop = -1;
+
+    return createHistory(tb);
+}
+
+tage* tageCreateSharing(tage* other) {
+    return createHistory(other->tb);
+}
+
+void tageFree(tage* t) {
+    if (t == NULL) {
+        return;
+    }
+    tageTables* tb = t->tb;
+    free(t);
+    if (--tb->users > 0) {
+        return;
+    }
+    for (int i = 0; i < tb->cfg.numTables; i++) {
+        free(tb->tables[i]);
+    }
+    for (int i = 0; i < SC_TABLES; i++) {
+        free(tb->sc[i]);
+    }
+    free(tb->base);
+    free(tb);
+}
+
+static uint32_t tableIndex(tage* t, uint64_t pc, int i) {
+    int logE = t->tb->cfg.logEntries;
+    int pathBits = (t->tb->histLength[i] < 16) ? t->tb->histLength[i] : 16;
+    uint32_t path = t->pathHist & ((1u << pathBits) - 1);
+    uint32_t shift = ((logE > i) ? logE - i : i - logE) + 1;
+    uint32_t idx = (uint32_t)pc ^ (uint32_t)(pc >> shift)
+                   ^ t->indexFold[i].comp ^ path ^ (path >> logE);
+    return idx & ((1u << logE) - 1);
+}
+
+static uint16_t tableTag(tage* t, uint64_t pc, int i) {
+    uint32_t tag = (uint32_t)pc ^ t->tagFold[0][i].comp
+                   ^ (t->tagFold[1][i].comp << 1);
+    return tag & ((1u << t->tb->tagBits[i]) - 1);
+}
+
+static void loopLookup(tage* t, uint64_t pc) {
+    uint16_t tag = (pc >> 6) & ((1 << LOOP_TAG_BITS) - 1);
+    loopEntry* e;
+
+    t->loopIndex = pc & (LOOP_ENTRIES - 1);
+    e = &t->tb->loops[t->loopIndex];
+    t->loopHit = (e->age > 0 && e->tag == tag);
+    t->loopValid = t->loopHit && e->confidence >= LOOP_CONFIDENT;
+    t->loopPred = (e->currentIter == e->pastIter) ? !e->dir : e->dir;
+}
+
+static void loopUpdate(tage* t, uint64_t pc, bool taken) {
+    loopEntry* e = &t->tb->loops[t->loopIndex];
+
+    if (t->loopHit) {
+        if (t->loopValid && t->loopPred != taken) {
+            // The trip count changed, forget the loop
+            e->age = 0;
+            return;
+        }
+        if (taken == e->dir) {
+            if (e->currentIter < UINT16_MAX) {
+                e->currentIter++;
+            }
+            if (e->pastIter != 0 && e->currentIter > e->pastIter) {
+                e->confidence = 0;
+            }
+        }
+        else {
+            // Loop exit, a repeated trip count builds confidence
+            if (e->currentIter == e->pastIter) {
+                if (e->confidence < LOOP_CONFIDENT) {
+                    e->confidence++;
+                }
+                if (e->age < 255) {
+                    e->age++;
+                }
+            }
+            else {
+                e->pastIter = e->currentIter;
+                e->confidence = 0;
+            }
+            e->currentIter = 0;
+        }
+    }
+    else if (t->tagePred != taken) {
+        // A branch TAGE mispredicted may be a loop exit; claim an entry
+        //   once its current owner has aged out.
+        if (e->age > 0) {
+            e->age--;
+        }
+        else {
+            e->tag = (pc >> 6) & ((1 << LOOP_TAG_BITS) - 1);
+            e->dir = !taken;
+            e->pastIter = 0;
+            e->currentIter = 0;
+            e->confidence = 0;
+            e->age = 7;
+        }
+    }
+}
+
+bool tagePredict(tage* t, uint64_t pc) {
+    int n = t->tb->cfg.numTables;
+
+    pc >>= 2;
+
+    // Base and tagged table lookups, the longest hit provides
+    t->baseIndex = pc & ((1u << t->tb->logBase) - 1);
+    t->provider = -1;
+    t->altProvider = -1;
+    for (int i = n - 1; i >= 0; i--) {
+        t->index[i] = tableIndex(t, pc, i);
+        t->tag[i] = tableTag(t, pc, i);
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        if (t->tb->tables[i][t->index[i]].tag == t->tag[i]) {
+            if (t->provider < 0) {
+                t->provider = i;
+            }
+            else {
+                t->altProvider = i;
+                break;
+            }
+        }
+    }
+
+    bool basePred = t->tb->base[t->baseIndex] >= 2;
+    t->altPred = (t->altProvider >= 0)
+                     ? t->tb->tables[t->altProvider][t->index[t->altProvider]].ctr
+                           >= 0
+                     : basePred;
+    if (t->provider >= 0) {
+        tageEntry* e = &t->tb->tables[t->provider][t->index[t->provider]];
+        bool weak = (e->ctr == 0 || e->ctr == -1);
+        t->longestPred = e->ctr >= 0;
+        t->tagePred = (weak && e->u == 0 && t->tb->useAltOnNa >= 0)
+                          ? t->altPred
+                          : t->longestPred;
+    }
+    else {
+        t->longestPred = basePred;
+        t->tagePred = basePred;
+    }
+    t->finalPred = t->tagePred;
+
+    // Statistical corrector, sums counters indexed by short histories and
+    //   the TAGE prediction, weighted by how confident TAGE is.
+    t->scUsed = false;
+    if (t->tb->cfg.useSC) {
+        int conf = 1;
+        if (t->provider >= 0) {
+            int ctr = t->tb->tables[t->provider][t->index[t->provider]].ctr;
+            conf = abs(2 * ctr + 1);
+        }
+        t->scSum = (t->tagePred ? 1 : -1) * conf * 4;
+        for (int i = 0; i < SC_TABLES; i++) {
+            uint32_t h = t->recentHist & ((1u << scHistLength[i]) - 1);
+            uint32_t idx = (uint32_t)pc ^ h ^ (h << 3) ^ (i << 5);
+            t->scIndex[i]
+                = ((idx << 1) | t->tagePred) & ((1u << t->tb->cfg.logEntries) - 1);
+            t->scSum += 2 * t->tb->sc[i][t->scIndex[i]] + 1;
+        }
+        t->scPred = t->scSum >= 0;
+        if (t->scPred != t->tagePred && abs(t->scSum) >= t->tb->scThreshold) {
+            t->scUsed = true;
+            t->finalPred = t->scPred;
+        }
+    }
+
+    if (t->tb->cfg.useLoop) {
+        loopLookup(t, pc);
+        if (t->loopValid && t->tb->useLoop >= 0) {
+            t->finalPred = t->loopPred;
+        }
+    }
+
+    return t->finalPred;
+}
+
+static void updateHistory(tage* t, uint64_t pc, bool taken) {
+    t->ghistPtr = (t->ghistPtr - 1) & HIST_BUFFER_MASK;
+    t->ghist[t->ghistPtr] = taken;
+    for (int i = 0; i < t->tb->cfg.numTables; i++) {
+        foldUpdate(&t->indexFold[i], t->ghist, t->ghistPtr);
+        foldUpdate(&t->tagFold[0][i], t->ghist, t->ghistPtr);
+        foldUpdate(&t->tagFold[1][i], t->ghist, t->ghistPtr);
+    }
+    t->recentHist = (t->recentHist << 1) | taken;
+    t->pathHist = ((t->pathHist << 1) | (pc & 1)) & 0xffff;
+}
+
+static void updateTables(tage* t, bool taken) {
+    int n = t->tb->cfg.numTables;
+    tageEntry* p = (t->provider >= 0)
+                       ? &t->tb->tables[t->provider][t->index[t->provider]]
+                       : NULL;
+
+    // Learn whether the alternate prediction beats a newly allocated entry
+    if (p != NULL && p->u == 0 && (p->ctr == 0 || p->ctr == -1)
+        && t->longestPred != t->altPred) {
+        t->tb->useAltOnNa = (t->altPred == taken) ? satInc(t->tb->useAltOnNa, 7)
+                                               : satDec(t->tb->useAltOnNa, -8);
+    }
+
+    // On a misprediction allocate an entry in a longer history table
+    if (t->longestPred != taken && t->provider < n - 1) {
+        int start = t->provider + 1;
+        int chosen = -1;
+        if (start < n - 1 && (nextRandom(t) & 1)) {
+            start++;
+        }
+        for (int i = start; i < n; i++) {
+            if (t->tb->tables[i][t->index[i]].u == 0) {
+                chosen = i;
+                break;
+            }
+        }
+        if (chosen < 0 && start > t->provider + 1
+            && t->tb->tables[t->provider + 1][t->index[t->provider + 1]].u == 0) {
+            chosen = t->provider + 1;
+        }
+        if (chosen >= 0) {
+            tageEntry* e = &t->tb->tables[chosen][t->index[chosen]];
+            e->tag = t->tag[chosen];
+            e->ctr = taken ? 0 : -1;
+            e->u = 0;
+            t->tb->stats.allocations++;
+        }
+        else {
+            for (int i = t->provider + 1; i < n; i++) {
+                tageEntry* e = &t->tb->tables[i][t->index[i]];
+                if (e->u > 0) {
+                    e->u--;
+                }
+            }
+        }
+    }
+
+    // Train the provider, and the alternate while the provider is new
+    if (p != NULL) {
+        if (p->u == 0 && (p->ctr == 0 || p->ctr == -1)) {
+            if (t->altProvider >= 0) {
+                tageEntry* a = &t->tb->tables[t->altProvider]
+                                         [t->index[t->altProvider]];
+                a->ctr = taken ? satInc(a->ctr, 3) : satDec(a->ctr, -4);
+            }
+            else {
+                uint8_t* b = &t->tb->base[t->baseIndex];
+                *b = taken ? ((*b < 3) ? *b + 1 : 3) : ((*b > 0) ? *b - 1 : 0);
+            }
+        }
+        p->ctr = taken ? satInc(p->ctr, 3) : satDec(p->ctr, -4);
+        if (t->longestPred != t->altPred) {
+            if (t->longestPred == taken) {
+                if (p->u < 3) {
+                    p->u++;
+                }
+            }
+            else if (p->u > 0) {
+                p->u--;
+            }
+        }
+    }
+    else {
+        uint8_t* b = &t->tb->base[t->baseIndex];
+        *b = taken ? ((*b < 3) ? *b + 1 : 3) : ((*b > 0) ? *b - 1 : 0);
+    }
+
+    // Periodically age the useful bits so stale entries can be replaced
+    t->tb->updateCount++;
+    if ((t->tb->updateCount & (U_RESET_PERIOD - 1)) == 0) {
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < (1 << t->tb->cfg.logEntries); j++) {
+                t->tb->tables[i][j].u >>= 1;
+            }
+        }
+    }
+}
+
+static void updateSC(tage* t, bool taken) {
+    if (t->scUsed) {
+        t->tb->stats.scOverrides++;
+        if (t->scPred == taken) {
+            t->tb->stats.scOverridesCorrect++;
+        }
+    }
+    if (t->scPred != taken || abs(t->scSum) < t->tb->scThreshold) {
+        for (int i = 0; i < SC_TABLES; i++) {
+            int8_t* c = &t->tb->sc[i][t->scIndex[i]];
+            *c = taken ? satInc(*c, 31) : satDec(*c, -32);
+        }
+    }
+
+    // Adapt the override threshold as in O-GEHL
+    if (t->scPred != taken) {
+        if (++t->tb->scThresholdCtr >= 63) {
+            t->tb->scThreshold++;
+            t->tb->scThresholdCtr = 0;
+        }
+    }
+    else if (abs(t->scSum) < t->tb->scThreshold) {
+        if (--t->tb->scThresholdCtr <= -64) {
+            if (t->tb->scThreshold > 1) {
+                t->tb->scThreshold--;
+            }
+            t->tb->scThresholdCtr = 0;
+        }
+    }
+}
+
+void tageUpdate(tage* t, uint64_t pc, bool taken) {
+    pc >>= 2;
+
+    if (t->provider >= 0) {
+        t->tb->stats.providerHits[t->provider]++;
+    }
+    else {
+        t->tb->stats.baseProvided++;
+    }
+
+    if (t->tb->cfg.useLoop) {
+        if (t->loopValid) {
+            bool otherPred = t->scUsed ? t->scPred : t->tagePred;
+            if (t->tb->useLoop >= 0) {
+                t->tb->stats.loopOverrides++;
+                if (t->loopPred == taken) {
+                    t->tb->stats.loopOverridesCorrect++;
+                }
+            }
+            if (t->loopPred != otherPred) {
+                t->tb->useLoop = (t->loopPred == taken) ? satInc(t->tb->useLoop, 63)
+                                                     : satDec(t->tb->useLoop, -64);
+            }
+        }
+        loopUpdate(t, pc, taken);
+    }
+    if (t->tb->cfg.useSC) {
+        updateSC(t, taken);
+    }
+    updateTables(t, taken);
+    updateHistory(t, pc, taken);
+}
+
+const tageStats* tageGetStats(const tage* t) {
+    return &t->tb->stats;
+}
+
+int tageTableCount(const tage* t) {
+    return t->tb->cfg.numTables;
+}
+
+int tageHistoryLength(const tage* t, int table) {
+    return t->tb->histLength[table];
+}
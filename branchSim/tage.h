@@ -0,0 +1,49 @@
+#ifndef TAGE_H
+#define TAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// TAGE-SC-L direction predictor.  A bimodal base table backed by tagged
+//   tables indexed with geometrically increasing global history lengths,
+//   followed by a statistical corrector and a loop predictor that may
+//   override the TAGE prediction.
+
+typedef struct _tageConfig {
+    int numTables;  // tagged tables
+    int minHist;    // history length of the shortest tagged table
+    int maxHist;    // history length of the longest tagged table
+    int logEntries; // log2 entries per tagged table
+    bool useSC;
+    bool useLoop;
+} tageConfig;
+
+typedef struct _tageStats {
+    uint64_t providerHits[32]; // predictions provided by each tagged table
+    uint64_t baseProvided;
+    uint64_t allocations;
+    uint64_t scOverrides;
+    uint64_t scOverridesCorrect;
+    uint64_t loopOverrides;
+    uint64_t loopOverridesCorrect;
+} tageStats;
+
+typedef struct _tage tage;
+
+void tageDefaultConfig(tageConfig* cfg);
+tage* tageCreate(const tageConfig* cfg);
+// A predictor with its own histories that shares the tables of other, as
+//   SMT threads would.  Tables are freed along with their last user.
+tage* tageCreateSharing(tage* other);
+void tageFree(tage* t);
+
+// Predict the direction of the branch at pc.  The lookup state is kept in
+//   the predictor until the following tageUpdate of the same branch.
+bool tagePredict(tage* t, uint64_t pc);
+void tageUpdate(tage* t, uint64_t pc, bool taken);
+
+const tageStats* tageGetStats(const tage* t);
+int tageTableCount(const tage* t);
+int tageHistoryLength(const tage* t, int table);
+
+#endif
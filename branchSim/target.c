@@ -0,0 +1,525 @@
+#include "target.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_BTB_WAYS 16
+#define MAX_RAS_SIZE 256
+#define CALL_CANDIDATES 64
+#define HIST_BUFFER_SIZE 1024
+#define HIST_BUFFER_MASK (HIST_BUFFER_SIZE - 1)
+#define RETURN_CONFIDENT 2
+
+typedef struct _btbEntry {
+    bool valid;
+    bool indirect;      // seen with more than one target
+    bool call;          // a later return landed just after it
+    uint8_t returnConf; // 2 bit, returns to the fall through of a call
+    uint64_t tag;
+    uint64_t target;
+    uint64_t lastUse;
+} btbEntry;
+
+typedef struct _indirectEntry {
+    uint16_t tag;
+    uint8_t ctr; // 2 bit confidence in the target
+    uint8_t u;   // 2 bit useful counter
+    uint64_t target;
+} indirectEntry;
+
+// Path history folded down to an index or tag width, as in the TAGE
+//   direction predictor
+typedef struct _foldedHistory {
+    uint32_t comp;
+    int compLength;
+    int origLength;
+    int outPoint;
+} foldedHistory;
+
+// BTB and indirect tables, shared by every predictor created from the same
+//   one, along with their statistics
+typedef struct _targetTables {
+    targetConfig cfg;
+    int users;
+    btbEntry* btb;
+    uint64_t useStamp;
+    // Pc last written to each slot of an untagged direct mapped BTB of the
+    //   same size, which the aliased misses are counted against
+    uint64_t* untagged;
+    int histLength[MAX_INDIRECT_TABLES];
+    int tagBits[MAX_INDIRECT_TABLES];
+    indirectEntry* indirect[MAX_INDIRECT_TABLES];
+    uint32_t seed;
+    targetStats stats;
+} targetTables;
+
+enum TARGET_SOURCE { FROM_NONE, FROM_BTB, FROM_RAS, FROM_INDIRECT };
+
+struct _targetPredictor {
+    targetTables* tb;
+
+    uint64_t ras[MAX_RAS_SIZE];
+    int rasTop;   // next free slot, wrapping over the oldest entry
+    int rasCount;
+
+    // Pcs of recent taken branches, newest last, searched for the call a
+    //   branch returns to
+    uint64_t candidates[CALL_CANDIDATES];
+    int candidateTop;
+    int candidateCount;
+
+    uint8_t phist[HIST_BUFFER_SIZE];
+    int phistPtr;
+    foldedHistory indexFold[MAX_INDIRECT_TABLES];
+    foldedHistory tagFold[2][MAX_INDIRECT_TABLES];
+
+    // Lookup state of the branch between targetPredict and targetUpdate
+    btbEntry* entry;
+    uint32_t index[MAX_INDIRECT_TABLES];
+    uint16_t tag[MAX_INDIRECT_TABLES];
+    int provider;
+    int altProvider;
+    uint64_t indirectPred;
+    uint64_t btbTarget;
+    uint64_t prediction;
+    int source;
+};
+
+void targetDefaultConfig(targetConfig* cfg) {
+    cfg->ways = 4;
+    cfg->logSets = -1;
+    cfg->rasSize = 16;
+    cfg->indirectTables = 4;
+    cfg->indirectLogEntries = 9;
+    cfg->indirectMinHist = 8;
+    cfg->indirectMaxHist = 64;
+}
+
+static void foldInit(foldedHistory* f, int origLength, int compLength) {
+    f->comp = 0;
+    f->origLength = origLength;
+    f->compLength = compLength;
+    f->outPoint = origLength % compLength;
+}
+
+static void foldUpdate(foldedHistory* f, const uint8_t* hist, int ptr) {
+    f->comp = (f->comp << 1) | hist[ptr & HIST_BUFFER_MASK];
+    f->comp ^= (uint32_t)hist[(ptr + f->origLength) & HIST_BUFFER_MASK]
+               << f->outPoint;
+    f->comp ^= f->comp >> f->compLength;
+    f->comp &= (1u << f->compLength) - 1;
+}
+
+static targetPredictor* createHistory(targetTables* tb) {
+    targetPredictor* tp = calloc(1, sizeof(targetPredictor));
+    tp->tb = tb;
+    tb->users++;
+    for (int i = 0; i < tb->cfg.indirectTables; i++) {
+        foldInit(&tp->indexFold[i], tb->histLength[i],
+                 tb->cfg.indirectLogEntries);
+        foldInit(&tp->tagFold[0][i], tb->histLength[i], tb->tagBits[i]);
+        foldInit(&tp->tagFold[1][i], tb->histLength[i], tb->tagBits[i] - 1);
+    }
+    return tp;
+}
+
+targetPredictor* targetCreate(const targetConfig* cfg) {
+    if (cfg->ways < 1 || cfg->ways > MAX_BTB_WAYS) {
+        fprintf(stderr, "BTB: between 1 and %d ways supported\n", MAX_BTB_WAYS);
+        return NULL;
+    }
+    if (cfg->logSets < 0 || cfg->logSets > 24) {
+        fprintf(stderr, "BTB: log2 sets must be in 0..24\n");
+        return NULL;
+    }
+    if (cfg->rasSize < 0 || cfg->rasSize > MAX_RAS_SIZE) {
+        fprintf(stderr, "RAS: between 0 and %d entries supported\n",
+                MAX_RAS_SIZE);
+        return NULL;
+    }
+    if (cfg->indirectTables < 0 || cfg->indirectTables > MAX_INDIRECT_TABLES) {
+        fprintf(stderr, "Indirect: between 0 and %d tables supported\n",
+                MAX_INDIRECT_TABLES);
+        return NULL;
+    }
+    if (cfg->indirectTables > 0
+        && (cfg->indirectMinHist < 1 || cfg->indirectMaxHist < cfg->indirectMinHist
+            || cfg->indirectMaxHist >= HIST_BUFFER_SIZE
+            || cfg->indirectLogEntries < 4 || cfg->indirectLogEntries > 20)) {
+        fprintf(stderr, "Indirect: need 1 <= min history <= max history < %d"
+                        " and log2 entries in 4..20\n", HIST_BUFFER_SIZE);
+        return NULL;
+    }
+
+    targetTables* tb = calloc(1, sizeof(targetTables));
+    int n = cfg->indirectTables;
+    tb->cfg = *cfg;
+    tb->btb = calloc((size_t)cfg->ways << cfg->logSets, sizeof(btbEntry));
+    tb->untagged = calloc((size_t)cfg->ways << cfg->logSets, sizeof(uint64_t));
+    tb->seed = 0x2545f491;
+
+    // Geometric path history lengths, as for the TAGE tagged tables
+    for (int i = 0; i < n; i++) {
+        double ratio = (n == 1) ? 0.0 : (double)i / (n - 1);
+        tb->histLength[i] = (int)(cfg->indirectMinHist
+                                  * pow((double)cfg->indirectMaxHist
+                                            / cfg->indirectMinHist,
+                                        ratio)
+                                  + 0.5);
+        if (i > 0 && tb->histLength[i] <= tb->histLength[i - 1]) {
+            tb->histLength[i] = tb->histLength[i - 1] + 1;
+        }
+        tb->tagBits[i] = 9 + i;
+        tb->indirect[i] = calloc(1 << cfg->indirectLogEntries,
+                                 sizeof(indirectEntry));
+    }
+
+    return createHistory(tb);
+}
+
+targetPredictor* targetCreateSharing(targetPredictor* other) {
+    return createHistory(other->tb);
+}
+
+void targetFree(targetPredictor* tp) {
+    if (tp == NULL) {
+        return;
+    }
+    targetTables* tb = tp->tb;
+    free(tp);
+    if (--tb->users > 0) {
+        return;
+    }
+    for (int i = 0; i < tb->cfg.indirectTables; i++) {
+        free(tb->indirect[i]);
+    }
+    free(tb->btb);
+    free(tb->untagged);
+    free(tb);
+}
+
+// Upper pc bits are folded into the set index so that branches at aligned
+//   addresses spread over the sets; the tag is then the whole pc
+static btbEntry* btbSet(targetTables* tb, uint64_t pc) {
+    uint64_t set = ((pc >> 3) ^ (pc >> (3 + tb->cfg.logSets)))
+                   & ((1L << tb->cfg.logSets) - 1);
+    return &tb->btb[set * tb->cfg.ways];
+}
+
+static uint64_t btbTag(uint64_t pc) {
+    return pc >> 3;
+}
+
+static uint64_t* untaggedSlot(targetTables* tb, uint64_t pc) {
+    uint64_t mask = ((uint64_t)tb->cfg.ways << tb->cfg.logSets) - 1;
+    return &tb->untagged[(pc >> 3) & mask];
+}
+
+static btbEntry* btbFind(targetTables* tb, uint64_t pc) {
+    btbEntry* set = btbSet(tb, pc);
+    uint64_t tag = btbTag(pc);
+    for (int w = 0; w < tb->cfg.ways; w++) {
+        if (set[w].valid && set[w].tag == tag) {
+            return &set[w];
+        }
+    }
+    return NULL;
+}
+
+// Fill an invalid way if there is one, else the least recently used
+static btbEntry* btbAllocate(targetTables* tb, uint64_t pc) {
+    btbEntry* set = btbSet(tb, pc);
+    btbEntry* victim = &set[0];
+    for (int w = 0; w < tb->cfg.ways; w++) {
+        if (!set[w].valid) {
+            victim = &set[w];
+            break;
+        }
+        if (set[w].lastUse < victim->lastUse) {
+            victim = &set[w];
+        }
+    }
+    if (victim->valid) {
+        tb->stats.evictions++;
+    }
+    *victim = (btbEntry){.valid = true, .tag = btbTag(pc)};
+    return victim;
+}
+
+static uint32_t nextRandom(targetTables* tb) {
+    tb->seed ^= tb->seed << 13;
+    tb->seed ^= tb->seed >> 17;
+    tb->seed ^= tb->seed << 5;
+    return tb->seed;
+}
+
+static uint32_t indirectIndex(targetPredictor* tp, uint64_t pc, int i) {
+    int logE = tp->tb->cfg.indirectLogEntries;
+    uint32_t idx = (uint32_t)(pc >> 3) ^ (uint32_t)(pc >> (3 + logE + i))
+                   ^ tp->indexFold[i].comp;
+    return idx & ((1u << logE) - 1);
+}
+
+static uint16_t indirectTag(targetPredictor* tp, uint64_t pc, int i) {
+    uint32_t tag = (uint32_t)(pc >> 3) ^ tp->tagFold[0][i].comp
+                   ^ (tp->tagFold[1][i].comp << 1);
+    return tag & ((1u << tp->tb->tagBits[i]) - 1);
+}
+
+static void indirectLookup(targetPredictor* tp, uint64_t pc) {
+    targetTables* tb = tp->tb;
+
+    tp->provider = -1;
+    tp->altProvider = -1;
+    for (int i = tb->cfg.indirectTables - 1; i >= 0; i--) {
+        tp->index[i] = indirectIndex(tp, pc, i);
+        tp->tag[i] = indirectTag(tp, pc, i);
+        if (tb->indirect[i][tp->index[i]].tag != tp->tag[i]) {
+            continue;
+        }
+        if (tp->provider < 0) {
+            tp->provider = i;
+        }
+        else if (tp->altProvider < 0) {
+            tp->altProvider = i;
+        }
+    }
+
+    tp->indirectPred = 0;
+    if (tp->provider >= 0) {
+        indirectEntry* p = &tb->indirect[tp->provider][tp->index[tp->provider]];
+        tp->indirectPred = p->target;
+        // A fresh entry defers to the shorter history that hit
+        if (p->ctr == 0 && tp->altProvider >= 0) {
+            tp->indirectPred = tb->indirect[tp->altProvider]
+                                           [tp->index[tp->altProvider]].target;
+        }
+    }
+}
+
+uint64_t targetPredict(targetPredictor* tp, uint64_t pc) {
+    targetTables* tb = tp->tb;
+
+    tb->stats.lookups++;
+    tp->entry = btbFind(tb, pc);
+    tp->btbTarget = (tp->entry != NULL) ? tp->entry->target : 0;
+    tp->prediction = 0;
+    tp->source = FROM_NONE;
+    tp->provider = -1;
+    if (tb->cfg.indirectTables > 0) {
+        indirectLookup(tp, pc);
+    }
+
+    if (tp->entry == NULL) {
+        uint64_t slotPc = *untaggedSlot(tb, pc);
+        tb->stats.misses++;
+        tb->stats.aliased += (slotPc != 0 && slotPc != pc);
+        return 0;
+    }
+
+    tb->stats.hits++;
+    tp->entry->lastUse = ++tb->useStamp;
+    // A return with a single call site is served as well by its BTB target,
+    //   so only those that have returned to several places use the stack
+    if (tp->entry->indirect && tp->entry->returnConf >= RETURN_CONFIDENT
+        && tp->rasCount > 0) {
+        tp->prediction = tp->ras[(tp->rasTop - 1 + tb->cfg.rasSize)
+                                 % tb->cfg.rasSize];
+        tp->source = FROM_RAS;
+    }
+    else if (tp->entry->indirect && tp->provider >= 0) {
+        tp->prediction = tp->indirectPred;
+        tp->source = FROM_INDIRECT;
+    }
+    else {
+        tp->prediction = tp->entry->target;
+        tp->source = FROM_BTB;
+    }
+    return tp->prediction;
+}
+
+static void rasPush(targetPredictor* tp, uint64_t addr) {
+    int size = tp->tb->cfg.rasSize;
+    if (size == 0) {
+        return;
+    }
+    if (tp->rasCount == size) {
+        tp->tb->stats.rasOverflows++;
+    }
+    else {
+        tp->rasCount++;
+    }
+    tp->ras[tp->rasTop] = addr;
+    tp->rasTop = (tp->rasTop + 1) % size;
+}
+
+// Pop the stack back past the entry holding addr, if it has one
+static void rasReturnTo(targetPredictor* tp, uint64_t addr) {
+    int size = tp->tb->cfg.rasSize;
+    for (int d = 1; d <= tp->rasCount; d++) {
+        if (tp->ras[(tp->rasTop - d + size) % size] == addr) {
+            tp->rasTop = (tp->rasTop - d + size) % size;
+            tp->rasCount -= d;
+            return;
+        }
+    }
+}
+
+// Find the taken branch that target falls through from, dropping it and
+//   everything newer.  Returns its pc, or 0 when there is none.
+static uint64_t findCall(targetPredictor* tp, uint64_t target) {
+    for (int d = 1; d <= tp->candidateCount; d++) {
+        int slot = (tp->candidateTop - d + CALL_CANDIDATES) % CALL_CANDIDATES;
+        if (tp->candidates[slot] + 4 == target) {
+            tp->candidateTop = slot;
+            tp->candidateCount -= d;
+            return tp->candidates[slot];
+        }
+    }
+    return 0;
+}
+
+static void addCandidate(targetPredictor* tp, uint64_t pc) {
+    tp->candidates[tp->candidateTop] = pc;
+    tp->candidateTop = (tp->candidateTop + 1) % CALL_CANDIDATES;
+    if (tp->candidateCount < CALL_CANDIDATES) {
+        tp->candidateCount++;
+    }
+}
+
+static void indirectUpdate(targetPredictor* tp, uint64_t target) {
+    targetTables* tb = tp->tb;
+    int n = tb->cfg.indirectTables;
+    uint64_t altPred = tp->btbTarget;
+
+    if (tp->altProvider >= 0) {
+        altPred = tb->indirect[tp->altProvider][tp->index[tp->altProvider]].target;
+    }
+
+    if (tp->provider >= 0) {
+        indirectEntry* p = &tb->indirect[tp->provider][tp->index[tp->provider]];
+        if (p->target != altPred) {
+            if (p->target == target && p->u < 3) {
+                p->u++;
+            }
+            else if (altPred == target && p->u > 0) {
+                p->u--;
+            }
+        }
+        if (p->target == target) {
+            p->ctr += (p->ctr < 3);
+        }
+        else if (p->ctr > 0) {
+            p->ctr--;
+        }
+        else {
+            p->target = target;
+        }
+    }
+
+    // On a wrong target allocate an entry with a longer path history,
+    //   sometimes skipping a table so that contexts contending for one
+    //   entry spread out
+    uint64_t predicted = (tp->provider >= 0) ? tp->indirectPred : altPred;
+    if (predicted != target && tp->provider < n - 1) {
+        int start = tp->provider + 1;
+        if (start < n - 1 && (nextRandom(tb) & 1)) {
+            start++;
+        }
+        for (int i = start; i < n; i++) {
+            indirectEntry* e = &tb->indirect[i][tp->index[i]];
+            if (e->u == 0) {
+                *e = (indirectEntry){.tag = tp->tag[i], .target = target};
+                tb->stats.indirectAllocations++;
+                return;
+            }
+        }
+        for (int i = tp->provider + 1; i < n; i++) {
+            indirectEntry* e = &tb->indirect[i][tp->index[i]];
+            if (e->u > 0) {
+                e->u--;
+            }
+        }
+    }
+}
+
+// Each taken branch adds two bits, the whole target xor folded down
+static void updatePathHistory(targetPredictor* tp, uint64_t target) {
+    uint64_t h = target >> 2;
+    for (int shift = 32; shift >= 2; shift >>= 1) {
+        h ^= h >> shift;
+    }
+    for (int b = 0; b < 2; b++) {
+        tp->phistPtr = (tp->phistPtr - 1) & HIST_BUFFER_MASK;
+        tp->phist[tp->phistPtr] = (h >> b) & 1;
+        for (int i = 0; i < tp->tb->cfg.indirectTables; i++) {
+            foldUpdate(&tp->indexFold[i], tp->phist, tp->phistPtr);
+            foldUpdate(&tp->tagFold[0][i], tp->phist, tp->phistPtr);
+            foldUpdate(&tp->tagFold[1][i], tp->phist, tp->phistPtr);
+        }
+    }
+}
+
+void targetUpdate(targetPredictor* tp, uint64_t pc, bool taken,
+                  uint64_t target) {
+    targetTables* tb = tp->tb;
+    btbEntry* e = tp->entry;
+
+    if (!taken) {
+        return;
+    }
+    *untaggedSlot(tb, pc) = pc;
+
+    if (tp->source == FROM_RAS) {
+        tb->stats.rasPredictions++;
+        tb->stats.rasCorrect += (tp->prediction == target);
+        if (tp->prediction != target) {
+            e->returnConf = 0;
+        }
+    }
+    if (e != NULL && e->indirect) {
+        tb->stats.indirectPredictions++;
+        tb->stats.indirectCorrect += (tp->prediction == target);
+        tb->stats.indirectProvided += (tp->source == FROM_INDIRECT);
+    }
+
+    if (e == NULL) {
+        e = btbAllocate(tb, pc);
+        e->target = target;
+        e->lastUse = ++tb->useStamp;
+    }
+    else if (e->target != target) {
+        e->indirect = true;
+        e->target = target;
+    }
+
+    // Learn returns, and the calls they return from
+    uint64_t callPc = findCall(tp, target);
+    if (callPc != 0) {
+        btbEntry* call = btbFind(tb, callPc);
+        if (call != NULL) {
+            call->call = true;
+        }
+        e->returnConf += (e->returnConf < 3);
+        rasReturnTo(tp, target);
+    }
+    else {
+        e->returnConf -= (e->returnConf > 0);
+        addCandidate(tp, pc);
+    }
+    if (e->call) {
+        rasPush(tp, pc + 4);
+    }
+
+    // Returns served by the stack leave the indirect tables to other branches
+    bool rasReturn = tb->cfg.rasSize > 0 && e->returnConf >= RETURN_CONFIDENT;
+    if (tb->cfg.indirectTables > 0 && e->indirect && !rasReturn) {
+        indirectUpdate(tp, target);
+    }
+    updatePathHistory(tp, target);
+}
+
+const targetStats* targetGetStats(const targetPredictor* tp) {
+    return &tp->tb->stats;
+}
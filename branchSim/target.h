@@ -0,0 +1,58 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Target prediction for taken branches: a set-associative tagged BTB with
+//   LRU replacement, a return address stack, and an ITTAGE-style indirect
+//   predictor indexed by path history.  Traces do not mark calls, returns or
+//   indirect jumps, so each BTB entry learns its kind from what it has seen:
+//   a branch with more than one target is indirect, and one that lands just
+//   after an earlier taken branch is a return from that branch, a call.
+
+#define MAX_INDIRECT_TABLES 8
+
+typedef struct _targetConfig {
+    int ways;
+    int logSets;           // log2 BTB sets
+    int rasSize;           // return address stack entries, 0 disables
+    int indirectTables;    // ITTAGE tagged tables, 0 disables
+    int indirectLogEntries;
+    int indirectMinHist;   // path history bits of the shortest table
+    int indirectMaxHist;
+} targetConfig;
+
+typedef struct _targetStats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t aliased;      // misses an untagged BTB would have served wrongly
+    uint64_t evictions;
+    uint64_t rasPredictions;
+    uint64_t rasCorrect;
+    uint64_t rasOverflows;
+    uint64_t indirectPredictions;
+    uint64_t indirectCorrect;
+    uint64_t indirectProvided; // indirect predictions from a tagged table
+    uint64_t indirectAllocations;
+} targetStats;
+
+typedef struct _targetPredictor targetPredictor;
+
+void targetDefaultConfig(targetConfig* cfg);
+targetPredictor* targetCreate(const targetConfig* cfg);
+// A predictor with its own return stack and path history that shares the
+//   BTB and indirect tables of other
+targetPredictor* targetCreateSharing(targetPredictor* other);
+void targetFree(targetPredictor* tp);
+
+// Predict the target of the taken branch at pc, or 0 when it misses
+uint64_t targetPredict(targetPredictor* tp, uint64_t pc);
+// Train on the outcome of every branch, taken or not
+void targetUpdate(targetPredictor* tp, uint64_t pc, bool taken,
+                  uint64_t target);
+
+const targetStats* targetGetStats(const targetPredictor* tp);
+
+#endif
@@ -35,6 +35,7 @@ typedef struct _cacheLine {
 
 cache* self = NULL;
 coher* coherComp = NULL;
+void (*accessReq)(uint8_t, uint64_t, int, int, int) = NULL;
 cacheLine*** cacheSets = NULL;
 cacheLine** victimCache = NULL;
 
@@ -157,6 +158,7 @@ cache* init(cache_sim_args* csa)
     self->si.destroy = destroy;
 
     coherComp = csa->coherComp;
+    accessReq = csa->accessReq;
     coherComp->registerCacheInterface(coherCallback);
 
     createCache(sets, lines);
@@ -238,7 +240,21 @@ void coherCallback(int type, int processorNum, int64_t addr)
             break;
 
         case INVALIDATE:
-            // This is taught later in the semester.
+            // The coherence component took the line away, and has already
+            //   written it back if it was dirty
+            for (int i = 0; i < lines; i++) {
+                cacheLine* line = cacheSets[getSet(addr)][i];
+                if (line->valid && line->addr == addr &&
+                    line->processorNum == processorNum) {
+                    line->valid = false;
+                }
+            }
+            for (int i = 0; i < victimEntries; i++) {
+                if (victimCache[i]->valid && victimCache[i]->addr == addr &&
+                    victimCache[i]->processorNum == processorNum) {
+                    victimCache[i]->valid = false;
+                }
+            }
             break;
 
         default:
@@ -480,13 +496,24 @@ void memoryRequest(trace_op* op, int processorNum, int64_t tag,
     uint64_t addr = op->memAddress;
     int accessSize = op->size;
     uint64_t mask = (uint64_t)(blockSize - 1);
+    bool isRead = (op->op == MEM_LOAD);
     if ((addr & mask) && ((addr & mask) + accessSize > blockSize)) {
         uint64_t addr1 = addr & (~mask);
         uint64_t addr2 = addr1 + (uint64_t)blockSize;
+        if (accessReq != NULL) {
+            int offset = addr & mask;
+            accessReq(isRead, addr1, offset, blockSize - offset, processorNum);
+            accessReq(isRead, addr2, 0, offset + accessSize - blockSize,
+                      processorNum);
+        }
         cacheRequest(op, addr1, processorNum, tag, callback);
         cacheRequest(op, addr2, processorNum, tag, callback);
     }
     else {
+        if (accessReq != NULL) {
+            accessReq(isRead, addr & (~mask), addr & mask, accessSize,
+                      processorNum);
+        }
         addr = addr & (~mask);
         cacheRequest(op, addr, processorNum, tag, callback);
     }
@@ -548,7 +575,8 @@ int tick()
 
 int finish(int outFd)
 {
-    return 0;
+    // Coherence, interconnect and memory report after the cache
+    return coherComp->si.finish(outFd);
 }
 
 int destroy(void)
@@ -8,7 +8,7 @@ extern interconn* inter_sim;
 
 typedef enum _coherence_states
 {
-    UNDEF = 0, // As tree find returns NULL, we need an unused for NULL
+    UNDEF = 0, // The line table returns 0 for absent lines
     MODIFIED,
     INVALID,
     SHARE,
@@ -18,7 +18,9 @@ typedef enum _coherence_states
     INVALID_SHARED,
     INVALID_SHARED_EXCLUSIVE,
     INVALID_MODIFIED,
-    SHARED_MODIFIED
+    SHARED_MODIFIED,
+    OWNED_MODIFIED,   // O upgrading, still the owner of the dirty data
+    INVALID_SHARED_MODIFIED // stored to while the read miss is outstanding
 } coherence_states;
 
 typedef enum _coherence_scheme
@@ -27,38 +29,112 @@ typedef enum _coherence_scheme
     MSI,
     MESI,
     MOESI,
-    MESIF
+    MESIF,
+    DRAGON
 } coherence_scheme;
 
-coherence_states
-cacheMI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum);
-coherence_states
-cacheMSI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMSI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum);
-coherence_states
-cacheMESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum);
-coherence_states
-cacheMOESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMOESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum);
-coherence_states
-cacheMESIF(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum);
-coherence_states
-snoopMESIF(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum);
+// Messages a cache controller sends, in protocol.c
+void sendBusRd(uint64_t addr, int procNum);
+void sendBusWr(uint64_t addr, int procNum);
+void sendBusUpgr(uint64_t addr, int procNum);
+void sendBusUpd(uint64_t addr, int procNum);
+void sendData(uint64_t addr, int procNum, int pDest, int msgNum);
+void indicateShared(uint64_t addr, int procNum, int pDest, int msgNum);
+void ack(uint64_t addr, int procNum, int pDest, bus_req_type reqType,
+         int msgNum);
+void shareData(uint64_t addr, int procNum, int pDest, int msgNum);
+void sendWriteback(uint64_t addr, int procNum);
+
+// Events a protocol reacts to: the cache's load and store requests and
+//   evictions, then one snoop event per bus_req_type
+typedef enum _coherence_event
+{
+    EV_LOAD,
+    EV_STORE,
+    EV_EVICT,
+    EV_SNOOP,                             // + bus_req_type
+    EV_ANY_SNOOP = EV_SNOOP + BUSUPD + 1  // snoops without a rule of their own
+} coherence_event;
+
+#define COHER_EVENTS EV_ANY_SNOOP
+#define COHER_STATES (INVALID_SHARED_MODIFIED + 1)
+
+// Message a transition sends
+typedef enum _coherence_msg
+{
+    MSG_NONE,
+    MSG_BUSRD,
+    MSG_BUSWR,
+    MSG_DATA,
+    MSG_SHARED_DATA,
+    MSG_SHARED,
+    MSG_ACK,        // only sent in reply to BusRd, BusWr, BusUpgr and BusUpd
+    MSG_WRITEBACK,  // dirty data to memory
+    MSG_BUSUPGR,
+    MSG_BUSUPD
+} coherence_msg;
+
+// One transition of a protocol
+typedef struct _protocol_rule
+{
+    coherence_states state;
+    coherence_event event;
+    coherence_states next;
+    cache_action ca;        // snoops: callback to the cache
+    uint8_t perm;           // cache requests: permission granted
+    coherence_msg msg;
+} protocol_rule;
+
+typedef struct _protocol
+{
+    const char* name;
+    const protocol_rule* rules;
+    int ruleCount;
+} protocol;
+
+// Built in protocols, indexed by coherence_scheme
+extern const protocol protocols[];
+extern const int protocolCount;
+
+// Build the transition table from a built in protocol or a rule file,
+//   returning 0 on success
+int protocolSelect(coherence_scheme scheme);
+int protocolLoad(const char* fileName);
+void protocolFree(void);
+
+coherence_states protocolCache(uint8_t is_read, uint8_t* permAvail,
+                               coherence_states currentState, uint64_t addr,
+                               int procNum);
+coherence_states protocolEvict(coherence_states currentState, uint64_t addr,
+                               int procNum, uint8_t* writeback);
+coherence_states protocolSnoop(bus_req_type reqType, cache_action* ca,
+                               coherence_states currentState, uint64_t addr,
+                               int procNum, int srcProc, int msgNum);
+
+// Message sent by the latest transition, MSG_NONE if it had no rule
+coherence_msg protocolLastMessage(void);
+const char* protocolStateName(coherence_states state);
+const char* protocolEventName(coherence_event event);
+
+// Transitions taken and never taken
+void protocolReport(int outFd);
+
+// State of a line in a processor's cache, in coherence.c
+coherence_states getState(uint64_t addr, int processorNum);
+
+// Invariant checks on the line of each transition, in verify.c
+void verifyInit(int processorCount);
+void verifyTransition(uint64_t addr, int procNum, coherence_event event,
+                      coherence_states nextState);
+void verifyReport(int outFd);
+void verifyFree(void);
+
+// Sharing miss classification, in sharing.c
+void sharingInit(int processorCount);
+void sharingInvalidate(uint64_t addr, int procNum);
+void sharingAccess(uint8_t is_read, uint64_t addr, int offset, int size,
+                   int procNum, bool hasCopy);
+void sharingReport(int outFd, int top);
+void sharingFree(void);
 
 #endif
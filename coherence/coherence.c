@@ -3,11 +3,11 @@
 #include <getopt.h>
 #include "coher_internal.h"
 
-#include "stree.h"
+#include <linetable.h>
 
 typedef void (*cacheCallbackFunc)(int, int, int64_t);
 
-tree_t** coherStates = NULL;
+line_table** coherStates = NULL;
 int processorCount = 1;
 int CADSS_VERBOSE = 0;
 coherence_scheme cs = MI;
@@ -15,22 +15,84 @@ coher* self = NULL;
 interconn* inter_sim = NULL;
 cacheCallbackFunc cacheCallback = NULL;
 
+uint64_t evictions = 0;
+uint64_t writebacks = 0;
+
+// Migratory sharing: a line that is read and then written by one processor
+//   after another is given exclusively on the read, so the write needs no
+//   upgrade.  Each line's history is a byte in lineHistory.
+#define HIST_MIGRATORY 0x80
+#define HIST_UNWRITTEN 0x40 // granted exclusively on a read, not yet written
+#define HIST_WRITER 0x3f    // last writer + 1, modulo 63
+
+bool migratoryMode = false;
+line_table* lineHistory = NULL;
+uint64_t migratoryDetected = 0;
+uint64_t migratoryReverted = 0;
+uint64_t migratoryReads = 0;
+uint64_t upgradesSaved = 0;
+
+// Write updates: updateCounts holds, per processor, the updates each copy
+//   has received since the processor last used it.  With an updateLimit,
+//   a copy is dropped instead of taking that many unused updates.
+line_table** updateCounts = NULL;
+int updateLimit = 0;
+uint64_t updatesReceived = 0;
+uint64_t updatesUnused = 0;
+uint64_t copiesDropped = 0;
+
+// Lines reported with the most false sharing misses
+int sharingTop = 5;
+
+// Check the coherence invariants after every transition
+bool verifyMode = false;
+
 uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum, int srcProc, int msgNum);
 uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum);
 uint8_t invlReq(uint64_t addr, int processorNum);
+static void evictLine(uint64_t addr, int processorNum);
 void registerCacheInterface(void (*callback)(int, int, int64_t));
+void accessReq(uint8_t is_read, uint64_t addr, int offset, int size,
+               int processorNum);
 
 coher* init(coher_sim_args* csa)
 {
     int op;
+    const char* protocolFile = NULL;
 
-    while ((op = getopt(csa->arg_count, csa->arg_list, "s:")) != -1)
+    while ((op = getopt(csa->arg_count, csa->arg_list, "s:f:mu:l:v")) != -1)
     {
         switch (op)
         {
             case 's':
                 cs = atoi(optarg);
                 break;
+
+            // Protocol rule file, replacing the scheme's built in table
+            case 'f':
+                protocolFile = optarg;
+                break;
+
+            // Detect migratory lines and grant them exclusively on reads
+            case 'm':
+                migratoryMode = true;
+                break;
+
+            // Competitive update: copies drop out after this many unused
+            //   updates, 0 always updates
+            case 'u':
+                updateLimit = atoi(optarg);
+                break;
+
+            // Number of false sharing lines to report
+            case 'l':
+                sharingTop = atoi(optarg);
+                break;
+
+            // Verify the single writer and dirty data invariants
+            case 'v':
+                verifyMode = true;
+                break;
         }
     }
 
@@ -42,10 +104,38 @@ coher* init(coher_sim_args* csa)
         return NULL;
     }
 
-    coherStates = malloc(sizeof(tree_t*) * processorCount);
+    // The point-to-point topologies deliver a broadcast to each cache in
+    //   its own order, so the snooping protocols are not ordered on them
+    //   and the invariants would not hold
+    if (verifyMode && processorCount > 1 && csa->inter->pointToPoint)
+    {
+        fprintf(stderr, "Error: -v needs the bus (interconnectProj -t 0), "
+                        "the snooping protocols are unordered on other "
+                        "topologies\n");
+        return NULL;
+    }
+
+    if ((protocolFile != NULL) ? protocolLoad(protocolFile)
+                               : protocolSelect(cs))
+    {
+        return NULL;
+    }
+
+    coherStates = malloc(sizeof(line_table*) * processorCount);
+    updateCounts = malloc(sizeof(line_table*) * processorCount);
     for (int i = 0; i < processorCount; i++)
     {
-        coherStates[i] = tree_new();
+        coherStates[i] = line_table_new();
+        updateCounts[i] = line_table_new();
+    }
+    if (migratoryMode)
+    {
+        lineHistory = line_table_new();
+    }
+    sharingInit(processorCount);
+    if (verifyMode)
+    {
+        verifyInit(processorCount);
     }
 
     inter_sim = csa->inter;
@@ -69,19 +159,78 @@ void registerCacheInterface(void (*callback)(int, int, int64_t))
     cacheCallback = callback;
 }
 
+// A line the cache evicted while its request was outstanding is marked in
+//   its table entry and evicted again once the request completes
+#define LINE_EVICTED 0x80
+
 coherence_states getState(uint64_t addr, int processorNum)
 {
-    coherence_states lookState
-        = (coherence_states)tree_find(coherStates[processorNum], addr);
+    coherence_states lookState = (coherence_states)(
+        line_table_find(coherStates[processorNum], addr) & ~LINE_EVICTED);
     if (lookState == UNDEF)
         return INVALID;
 
     return lookState;
 }
 
+// Setting a state clears the eviction mark
 void setState(uint64_t addr, int processorNum, coherence_states nextState)
 {
-    tree_insert(coherStates[processorNum], addr, (void*)nextState);
+    line_table_set(coherStates[processorNum], addr, nextState);
+}
+
+static bool lineEvicted(uint64_t addr, int processorNum)
+{
+    return line_table_find(coherStates[processorNum], addr) & LINE_EVICTED;
+}
+
+// States waiting on a request of the cache's
+static bool pendingState(coherence_states state)
+{
+    switch (state)
+    {
+        case INVALID_SHARED:
+        case INVALID_SHARED_EXCLUSIVE:
+        case INVALID_SHARED_MODIFIED:
+        case INVALID_MODIFIED:
+        case SHARED_MODIFIED:
+        case OWNED_MODIFIED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The copy's latest update, if any, was never used
+static void updateUnused(uint64_t addr, int processorNum)
+{
+    if (updateCounts[processorNum]->count == 0)
+        return;
+    if (line_table_find(updateCounts[processorNum], addr) > 0)
+    {
+        updatesUnused++;
+        line_table_remove(updateCounts[processorNum], addr);
+    }
+}
+
+// A copy snooping an update takes it, or with the competitive limit
+//   reached is dropped, which the protocol sees as an invalidation
+static bus_req_type snoopUpdate(uint64_t addr, int processorNum)
+{
+    uint8_t unused = line_table_find(updateCounts[processorNum], addr);
+
+    updatesReceived++;
+    updatesUnused += (unused > 0);
+    if (updateLimit > 0 && unused + 1 >= updateLimit)
+    {
+        copiesDropped++;
+        line_table_remove(updateCounts[processorNum], addr);
+        return BUSUPGR;
+    }
+
+    line_table_set(updateCounts[processorNum], addr,
+                   (unused < UINT8_MAX) ? unused + 1 : unused);
+    return BUSUPD;
 }
 
 uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum, int srcProc, int msgNum)
@@ -99,66 +248,161 @@ uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum, int srcPro
     coherence_states nextState;
     cache_action ca;
 
-    switch (cs)
+    // The snoop filter dropped the line, so the cache loses its copy as if
+    //   it had evicted it
+    if (reqType == BUSINV)
     {
-        case MI:
-            nextState
-                = snoopMI(reqType, &ca, currentState, addr, processorNum, srcProc, msgNum);
-            break;
-        case MSI:
-            nextState
-                = snoopMSI(reqType, &ca, currentState, addr, processorNum, srcProc, msgNum);
-            break;
-        case MESI:
-            nextState
-                = snoopMESI(reqType, &ca, currentState, addr, processorNum, srcProc, msgNum);
-            break;
-        case MOESI:
-            nextState
-                = snoopMOESI(reqType, &ca, currentState, addr, processorNum, srcProc, msgNum);
-            break;
-        case MESIF:
-            nextState
-                = snoopMESIF(reqType, &ca, currentState, addr, processorNum, srcProc, msgNum);
-            break;
-        default:
-            fprintf(stderr, "Undefined coherence scheme - %d\n", cs);
-            break;
+        if (currentState != INVALID)
+        {
+            evictions++;
+            evictLine(addr, processorNum);
+            sharingInvalidate(addr, processorNum);
+            cacheCallback(INVALIDATE, processorNum, addr);
+        }
+        return 0;
+    }
+
+    if (reqType == BUSUPD &&
+        (currentState == SHARE || currentState == OWNED))
+    {
+        reqType = snoopUpdate(addr, processorNum);
     }
 
+    bool evicted = lineEvicted(addr, processorNum);
+    nextState = protocolSnoop(reqType, &ca, currentState, addr, processorNum,
+                              srcProc, msgNum);
+
+    // NO_ACTION is only a callback for a finished eviction, and evictions
+    //   never make the cache wait
     switch (ca)
     {
-        case DATA_RECV:
         case INVALIDATE:
-        case NO_ACTION:
+            sharingInvalidate(addr, processorNum);
+            cacheCallback(ca, processorNum, addr);
+            break;
+
+        case DATA_RECV:
             cacheCallback(ca, processorNum, addr);
             break;
 
+        case NO_ACTION:
+            break;
+
         default:
             assert(0);
     }
 
     // If the destination state is invalid, that is an implicit
-    // state and does not need to be stored in the tree.
+    // state and does not need to be stored in the table.
     if (nextState == INVALID)
     {
         if (currentState != INVALID)
         {
-            tree_remove(coherStates[processorNum], addr);
+            line_table_remove(coherStates[processorNum], addr);
         }
     }
     else
     {
         setState(addr, processorNum, nextState);
     }
+    if (verifyMode)
+    {
+        verifyTransition(addr, processorNum, EV_SNOOP + reqType, nextState);
+    }
     if (CADSS_VERBOSE) {
         printf("Proc %d Snoop Addr %p: %d -> %d via %d\n",
                processorNum, (void*)addr, currentState, nextState, reqType);
     }
 
+    // The cache no longer has the line its request was for
+    if (evicted && nextState != INVALID)
+    {
+        if (pendingState(nextState))
+            line_table_set(coherStates[processorNum], addr,
+                           nextState | LINE_EVICTED);
+        else
+            evictLine(addr, processorNum);
+    }
+
     return 0;
 }
 
+// States in which a cache holds the line's data
+static bool holdsCopy(coherence_states state)
+{
+    switch (state)
+    {
+        case MODIFIED:
+        case SHARE:
+        case EXCLUSIVE:
+        case OWNED:
+        case FORWARD:
+        case SHARED_MODIFIED:
+        case OWNED_MODIFIED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Update the line's history for a request, returning whether a read should
+//   be made as a write to get the line exclusively
+static bool migratoryRequest(uint8_t is_read, uint64_t addr, int processorNum,
+                             coherence_states currentState)
+{
+    uint8_t history = line_table_find(lineHistory, addr);
+    uint8_t writer = processorNum % HIST_WRITER + 1;
+
+    if (is_read)
+    {
+        if (currentState != INVALID || !(history & HIST_MIGRATORY))
+            return false;
+
+        // The last exclusive read was never written, so the line has
+        //   stopped migrating
+        if (history & HIST_UNWRITTEN)
+        {
+            migratoryReverted++;
+            line_table_set(lineHistory, addr,
+                           history & ~(HIST_MIGRATORY | HIST_UNWRITTEN));
+            return false;
+        }
+
+        migratoryReads++;
+        line_table_set(lineHistory, addr, history | HIST_UNWRITTEN);
+        return true;
+    }
+
+    if (history & HIST_UNWRITTEN)
+    {
+        if (currentState == MODIFIED || currentState == INVALID_MODIFIED)
+            upgradesSaved++;
+        history &= ~HIST_UNWRITTEN;
+    }
+
+    // An upgrade while one other cache holds the line, which another
+    //   processor wrote last, is the line migrating
+    if (!(history & HIST_MIGRATORY) && holdsCopy(currentState) &&
+        currentState != MODIFIED && currentState != EXCLUSIVE &&
+        (history & HIST_WRITER) != 0 && (history & HIST_WRITER) != writer)
+    {
+        int copies = 0;
+        for (int i = 0; i < processorCount && copies < 2; i++)
+        {
+            if (i != processorNum && holdsCopy(getState(addr, i)))
+                copies++;
+        }
+        if (copies == 1)
+        {
+            migratoryDetected++;
+            history |= HIST_MIGRATORY;
+        }
+    }
+
+    line_table_set(lineHistory, addr, (history & ~HIST_WRITER) | writer);
+    return false;
+}
+
 uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum)
 {
     if (processorNum < 0 || processorNum >= processorCount)
@@ -170,39 +414,27 @@ uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum)
     coherence_states nextState;
     uint8_t permAvail = 0;
 
-    switch (cs)
+    // Using the copy makes its latest update a useful one
+    if (updateCounts[processorNum]->count > 0)
     {
-        case MI:
-            nextState = cacheMI(is_read, &permAvail, currentState, addr,
-                                processorNum);
-            break;
-
-        case MSI:
-            nextState = cacheMSI(is_read, &permAvail, currentState, addr,
-                                processorNum);
-            break;
-
-        case MESI:
-            nextState = cacheMESI(is_read, &permAvail, currentState, addr,
-                                processorNum);
-            break;
-
-        case MOESI:
-            nextState = cacheMOESI(is_read, &permAvail, currentState, addr,
-                                processorNum);
-            break;
-
-        case MESIF:
-            nextState = cacheMESIF(is_read, &permAvail, currentState, addr,
-                                processorNum);
-            break;
+        line_table_remove(updateCounts[processorNum], addr);
+    }
 
-        default:
-            fprintf(stderr, "Undefined coherence scheme - %d\n", cs);
-            break;
+    if (migratoryMode &&
+        migratoryRequest(is_read, addr, processorNum, currentState))
+    {
+        is_read = 0;
     }
 
+    nextState = protocolCache(is_read, &permAvail, currentState, addr,
+                              processorNum);
+
     setState(addr, processorNum, nextState);
+    if (verifyMode)
+    {
+        verifyTransition(addr, processorNum, is_read ? EV_LOAD : EV_STORE,
+                         nextState);
+    }
     // if (CADSS_VERBOSE) {
     //     printf("Proc %d Perm Addr %p: %d -> %d via %d\n",
     //            processorNum, (void*)addr, currentState, nextState,
@@ -211,56 +443,63 @@ uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum)
     return permAvail;
 }
 
-uint8_t invlReq(uint64_t addr, int processorNum)
+// The cache's view of each access, which permReq only sees as a line
+void accessReq(uint8_t is_read, uint64_t addr, int offset, int size,
+               int processorNum)
 {
-    coherence_states currentState, nextState = INVALID;
-    cache_action ca;
-    uint8_t flush;
+    sharingAccess(is_read, addr, offset, size, processorNum,
+                  holdsCopy(getState(addr, processorNum)));
+}
 
-    if (processorNum < 0 || processorNum >= processorCount)
-    {
-        // ERROR
-    }
+// Run the protocol's Evict rule on the line
+static void evictLine(uint64_t addr, int processorNum)
+{
+    coherence_states currentState = getState(addr, processorNum);
+    coherence_states nextState;
+    uint8_t writeback;
 
-    currentState = getState(addr, processorNum);
-	//printf("%d - %d - %p\n", processorNum, currentState, addr);
+    updateUnused(addr, processorNum);
+    nextState = protocolEvict(currentState, addr, processorNum, &writeback);
+    writebacks += writeback;
 
-    flush = 0;
-    switch (cs)
+    if (nextState == INVALID)
     {
-        case MI:
-            nextState = INVALID;
-            if (currentState != INVALID)
-            {
-                //inter_sim->busReq(DATA, addr, processorNum);
-                flush = 1;
-            }
-            break;
-
-        case MSI:
-            // TODO: Implement this.
-            break;
-        case MESI:
-            // TODO: Implement this.
-            break;
-
-        case MOESI:
-            // TODO: Implement this.
-            break;
+        line_table_remove(coherStates[processorNum], addr);
+    }
+    else
+    {
+        setState(addr, processorNum, nextState);
+    }
+    if (verifyMode)
+    {
+        verifyTransition(addr, processorNum, EV_EVICT, nextState);
+    }
 
-        case MESIF:
-            // TODO: Implement this.
-            break;
+    // A request still outstanding completes into a line the cache has
+    //   dropped, so the line is evicted again then
+    if (pendingState(nextState))
+    {
+        line_table_set(coherStates[processorNum], addr,
+                       nextState | LINE_EVICTED);
+    }
+}
 
-        default:
-            fprintf(stderr, "Undefined coherence scheme - %d\n", cs);
-            break;
+uint8_t invlReq(uint64_t addr, int processorNum)
+{
+    if (processorNum < 0 || processorNum >= processorCount)
+    {
+        // ERROR
     }
 
-    tree_remove(coherStates[processorNum], addr);
+    if (getState(addr, processorNum) != INVALID)
+    {
+        evictions++;
+    }
+    evictLine(addr, processorNum);
 
-    // Notify about "permReqOnFlush".
-    return flush;
+    // Writebacks leave through a buffer, so the cache never waits for the
+    //   eviction to finish
+    return 0;
 }
 
 int tick()
@@ -270,12 +509,50 @@ int tick()
 
 int finish(int outFd)
 {
+    protocolReport(outFd);
+    dprintf(outFd, "Evictions - %lu, writebacks - %lu\n", evictions,
+            writebacks);
+    if (updatesReceived > 0)
+    {
+        dprintf(outFd,
+                "Updates received - %lu, unused - %lu, copies dropped - %lu\n",
+                updatesReceived, updatesUnused, copiesDropped);
+    }
+    if (migratoryMode)
+    {
+        dprintf(outFd,
+                "Migratory lines - %lu detected, %lu reverted; exclusive "
+                "reads - %lu, upgrades saved - %lu\n",
+                migratoryDetected, migratoryReverted, migratoryReads,
+                upgradesSaved);
+    }
+    sharingReport(outFd, sharingTop);
+    if (verifyMode)
+    {
+        verifyReport(outFd);
+    }
     return inter_sim->si.finish(outFd);
 }
 
 int destroy(void)
 {
-    // TODO
+    for (int i = 0; i < processorCount; i++)
+    {
+        line_table_free(coherStates[i]);
+        line_table_free(updateCounts[i]);
+    }
+    free(coherStates);
+    free(updateCounts);
+    if (lineHistory != NULL)
+    {
+        line_table_free(lineHistory);
+    }
+    protocolFree();
+    sharingFree();
+    if (verifyMode)
+    {
+        verifyFree();
+    }
 
     return inter_sim->si.destroy();
 }
@@ -16,6 +16,22 @@ void sendBusWr(uint64_t addr, int procNum)
     inter_sim->req(BUSWR, addr, procNum, -1, true, -1);
 }
 
+void sendBusUpgr(uint64_t addr, int procNum)
+{
+    if (CADSS_VERBOSE) {
+        printf("Processor %d sending BUSUPGR for address %lx\n", procNum, addr);
+    }
+    inter_sim->req(BUSUPGR, addr, procNum, -1, true, -1);
+}
+
+void sendBusUpd(uint64_t addr, int procNum)
+{
+    if (CADSS_VERBOSE) {
+        printf("Processor %d sending BUSUPD for address %lx\n", procNum, addr);
+    }
+    inter_sim->req(BUSUPD, addr, procNum, -1, true, -1);
+}
+
 void sendData(uint64_t addr, int procNum, int pDest, int msgNum)
 {
     if (CADSS_VERBOSE) {
@@ -34,8 +50,9 @@ void indicateShared(uint64_t addr, int procNum, int pDest, int msgNum)
 
 void ack(uint64_t addr, int procNum, int pDest, bus_req_type reqType, int msgNum)
 {
-    if (reqType != BUSRD && reqType != BUSWR) {
-        // Only send ACKs for BusRd and BusWr requests
+    if (reqType != BUSRD && reqType != BUSWR && reqType != BUSUPGR &&
+        reqType != BUSUPD) {
+        // Only send ACKs for broadcast requests
         return;
     }
     if (CADSS_VERBOSE) {
@@ -52,738 +69,299 @@ void shareData(uint64_t addr, int procNum, int pDest, int msgNum)
     inter_sim->req(SHARED_DATA, addr, procNum, pDest, false, msgNum);
 }
 
-coherence_states
-cacheMI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    switch (currentState)
-    {
-        case INVALID:
-            *permAvail = 0;
-            sendBusWr(addr, procNum);
-            return INVALID_MODIFIED;
-        case MODIFIED:
-            *permAvail = 1;
-            return MODIFIED;
-        case INVALID_MODIFIED:
-            fprintf(stderr, "IM state on %lx, but request %d\n", addr,
-                    is_read);
-            *permAvail = 0;
-            return INVALID_MODIFIED;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-snoopMI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum)
-{
-    *ca = NO_ACTION;
-    switch (currentState)
-    {
-        case INVALID:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return INVALID;
-        case MODIFIED:
-            sendData(addr, procNum, srcProc, msgNum);
-            // indicateShared(addr, procNum, srcProc, msgNum); // Needed for E state
-            *ca = INVALIDATE;
-            return INVALID;
-        case INVALID_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA || reqType == SHARED)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-
-            return INVALID_MODIFIED;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            perror("snoopMI: Unsupported state\n");
-            exit(1);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-cacheMSI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    switch (currentState)
-    {
-        case INVALID:
-            *permAvail = 0;
-            if (is_read) {
-                sendBusRd(addr, procNum);
-                return INVALID_SHARED;
-            }
-            else {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-        case SHARE:
-            if (is_read)
-            {
-                *permAvail = 1;
-                return SHARE;
-            }
-            else
-            {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARED_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1;
-            return MODIFIED;
-        case SHARED_MODIFIED:
-            if (is_read)
-            {
-                *permAvail = 1;
-            }
-            else
-            {
-                *permAvail = 0;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            fprintf(stderr, "IM state on %lx, but request %d\n", addr,
-                    is_read);
-            *permAvail = 0;
-            return INVALID_MODIFIED;
-        case INVALID_SHARED:
-            *permAvail = 0;
-            if (is_read)
-            {
-                return INVALID_SHARED;
-            }
-            else
-            {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-snoopMSI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum)
-{
-    *ca = NO_ACTION;
-    switch (currentState)
-    {
-        case INVALID:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return INVALID;
-        case MODIFIED:
-            sendData(addr, procNum, srcProc, msgNum);
-            // indicateShared(addr, procNum, srcProc, msgNum); // Needed for E state
-            if (reqType == BUSRD)
-                return SHARE;
-            else if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            return MODIFIED;
-        case SHARE:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == BUSWR)
-            {
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            return SHARE;
-        case SHARED_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            //maybe need to check for addr
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-
-            return INVALID_MODIFIED;
-        case INVALID_SHARED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return SHARE;
-            }
-
-            return INVALID_SHARED;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-cacheMESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    switch (currentState)
-    {
-        case INVALID:
-            *permAvail = 0;
-            if (is_read) {
-                sendBusRd(addr, procNum);
-                return INVALID_SHARED_EXCLUSIVE;
-            }
-            else {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-        case SHARE:
-            if (is_read)
-            {
-                *permAvail = 1;
-                return SHARE;
-            }
-            else
-            {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARED_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1;
-            return MODIFIED;
-        case EXCLUSIVE:
-            *permAvail = 1;
-            if (is_read)
-            {
-                return EXCLUSIVE;
-            }
-            else
-            {
-                return MODIFIED;
-            }
-        case SHARED_MODIFIED:
-            if (is_read)
-            {
-                *permAvail = 1;
-            }
-            else
-            {
-                *permAvail = 0;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            fprintf(stderr, "IM state on %lx, but request %d\n", addr,
-                    is_read);
-            *permAvail = 0;
-            return INVALID_MODIFIED;
-        case INVALID_SHARED_EXCLUSIVE:
-            *permAvail = 0;
-            if (is_read)
-            {
-                return INVALID_SHARED_EXCLUSIVE;
-            }
-            else
-            {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-            return INVALID_SHARED_EXCLUSIVE;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-snoopMESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum)
-{
-    *ca = NO_ACTION;
-    switch (currentState)
-    {
-        case INVALID:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return INVALID;
-        case MODIFIED:
-            if (reqType == BUSRD) {
-                shareData(addr, procNum, srcProc, msgNum);
-                return SHARE;
-            }
-            else if (reqType == BUSWR) {
-                sendData(addr, procNum, srcProc, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return MODIFIED;
-        case EXCLUSIVE:
-            if (reqType == BUSRD) { 
-                indicateShared(addr, procNum, srcProc, msgNum); 
-                return SHARE;
-            } 
-            else if (reqType == SHARED) {
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                return SHARE; 
-            } 
-            else if (reqType == BUSWR) {
-                *ca = INVALIDATE;
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return EXCLUSIVE;
-        case SHARE:
-            if (reqType == BUSWR)
-            {
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum, srcProc, msgNum);
-                return SHARE;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return SHARE;
-        case SHARED_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-
-            return INVALID_MODIFIED;
-        case INVALID_SHARED_EXCLUSIVE:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return EXCLUSIVE;
-            }
-            if (reqType == SHARED) {
-                *ca = DATA_RECV;
-                return SHARE;
-            }
-
-            return INVALID_SHARED_EXCLUSIVE;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-cacheMOESI(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
-{
-    switch (currentState)
-    {
-        case INVALID:
-            *permAvail = 0;
-            if (is_read) {
-                sendBusRd(addr, procNum);
-                return INVALID_SHARED_EXCLUSIVE;
-            }
-            else {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-        case OWNED:
-            if (is_read)
-            {
-                *permAvail = 1;
-                return OWNED;
-            }
-            else
-            {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARED_MODIFIED;
-            }
-        case SHARE:
-            if (is_read)
-            {
-                *permAvail = 1;
-                return SHARE;
-            }
-            else
-            {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARED_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1;
-            return MODIFIED;
-        case EXCLUSIVE:
-            *permAvail = 1;
-            if (is_read)
-            {
-                return EXCLUSIVE;
-            }
-            else
-            {
-                return MODIFIED;
-            }
-        case SHARED_MODIFIED:
-            if (is_read)
-            {
-                *permAvail = 1;
-            }
-            else
-            {
-                *permAvail = 0;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            fprintf(stderr, "IM state on %lx, but request %d\n", addr,
-                    is_read);
-            *permAvail = 0;
-            return INVALID_MODIFIED;
-        case INVALID_SHARED_EXCLUSIVE:
-            *permAvail = 0;
-            if (is_read)
-            {
-                return INVALID_SHARED_EXCLUSIVE;
-            }
-            else
-            {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-            return INVALID_SHARED_EXCLUSIVE;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-snoopMOESI(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum)
-{
-    *ca = NO_ACTION;
-    switch (currentState)
-    {
-        case INVALID:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return INVALID;
-        case MODIFIED:
-            if (reqType == BUSRD) {
-                shareData(addr, procNum, srcProc, msgNum);
-                return OWNED;
-            }
-            else if (reqType == BUSWR) {
-                sendData(addr, procNum, srcProc, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return MODIFIED;
-        case OWNED:
-            if (reqType == BUSRD) {
-                shareData(addr, procNum, srcProc, msgNum);
-                return OWNED;
-            }
-            else if (reqType == BUSWR) {
-                sendData(addr, procNum, srcProc, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return OWNED;
-        case EXCLUSIVE:
-            if (reqType == BUSRD) { 
-                indicateShared(addr, procNum, srcProc, msgNum); 
-                return SHARE;
-            } 
-            else if (reqType == SHARED) {
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                return SHARE; 
-            } 
-            else if (reqType == BUSWR) {
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return EXCLUSIVE;
-        case SHARE:
-            if (reqType == BUSWR)
-            {
-                *ca = INVALIDATE;
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                return INVALID;
-            }
-            if (reqType == BUSRD) {
-                indicateShared(addr, procNum, srcProc, msgNum);
-                return SHARE;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return SHARE;
-        case SHARED_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-
-            return INVALID_MODIFIED;
-        case INVALID_SHARED_EXCLUSIVE:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return EXCLUSIVE;
-            }
-            if (reqType == SHARED) {
-                *ca = DATA_RECV;
-                return SHARE;
-            }
-
-            return INVALID_SHARED_EXCLUSIVE;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
-
-coherence_states
-cacheMESIF(uint8_t is_read, uint8_t* permAvail, coherence_states currentState,
-        uint64_t addr, int procNum)
+// Memory is node processorCount on the point-to-point topologies
+void sendWriteback(uint64_t addr, int procNum)
 {
-    switch (currentState)
-    {
-        case INVALID:
-            *permAvail = 0;
-            if (is_read) {
-                sendBusRd(addr, procNum);
-                return INVALID_SHARED_EXCLUSIVE;
-            }
-            else {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-        case FORWARD:
-            if (is_read)
-            {
-                *permAvail = 1;
-                return FORWARD;
-            }
-            else
-            {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARED_MODIFIED;
-            }
-        case SHARE:
-            if (is_read)
-            {
-                *permAvail = 1;
-                return SHARE;
-            }
-            else
-            {
-                *permAvail = 0;
-                sendBusWr(addr, procNum);
-                return SHARED_MODIFIED;
-            }
-        case MODIFIED:
-            *permAvail = 1;
-            return MODIFIED;
-        case EXCLUSIVE:
-            *permAvail = 1;
-            if (is_read)
-            {
-                return EXCLUSIVE;
-            }
-            else
-            {
-                return MODIFIED;
-            }
-        case SHARED_MODIFIED:
-            if (is_read)
-            {
-                *permAvail = 1;
-            }
-            else
-            {
-                *permAvail = 0;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            fprintf(stderr, "IM state on %lx, but request %d\n", addr,
-                    is_read);
-            *permAvail = 0;
-            return INVALID_MODIFIED;
-        case INVALID_SHARED_EXCLUSIVE:
-            *permAvail = 0;
-            if (is_read)
-            {
-                return INVALID_SHARED_EXCLUSIVE;
-            }
-            else
-            {
-                sendBusWr(addr, procNum);
-                return INVALID_MODIFIED;
-            }
-            return INVALID_SHARED_EXCLUSIVE;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
+    if (CADSS_VERBOSE) {
+        printf("Processor %d writing back address %lx\n", procNum, addr);
     }
-
-    return INVALID;
+    inter_sim->req(BUSWB, addr, procNum, processorCount, false, -1);
 }
 
-coherence_states
-snoopMESIF(bus_req_type reqType, cache_action* ca, coherence_states currentState,
-        uint64_t addr, int procNum, int srcProc, int msgNum)
-{
-    *ca = NO_ACTION;
-    switch (currentState)
-    {
-        case INVALID:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return INVALID;
-        case MODIFIED:
-            if (reqType == BUSRD) {
-                shareData(addr, procNum, srcProc, msgNum);
-                return SHARE;
-            }
-            else if (reqType == BUSWR) {
-                sendData(addr, procNum, srcProc, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return MODIFIED;
-        case FORWARD:
-            if (reqType == BUSRD) {
-                shareData(addr, procNum, srcProc, msgNum);
-                return SHARE;
-            }
-            else if (reqType == BUSWR) {
-                sendData(addr, procNum, srcProc, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return FORWARD;
-        case EXCLUSIVE:
-            if (reqType == BUSRD) { 
-                indicateShared(addr, procNum, srcProc, msgNum); 
-                return SHARE;
-            } 
-            else if (reqType == SHARED) {
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                return SHARE; 
-            } 
-            else if (reqType == BUSWR) {
-                ack(addr, procNum, srcProc, reqType, msgNum);
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            return EXCLUSIVE;
-        case SHARE:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == BUSWR)
-            {
-                *ca = INVALIDATE;
-                return INVALID;
-            }
-            return SHARE;
-        case SHARED_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-            return SHARED_MODIFIED;
-        case INVALID_MODIFIED:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return MODIFIED;
-            }
-
-            return INVALID_MODIFIED;
-        case INVALID_SHARED_EXCLUSIVE:
-            ack(addr, procNum, srcProc, reqType, msgNum);
-            if (reqType == DATA)
-            {
-                *ca = DATA_RECV;
-                return EXCLUSIVE;
-            }
-            if (reqType == SHARED) {
-                *ca = DATA_RECV;
-                return FORWARD;
-            }
-
-            return INVALID_SHARED_EXCLUSIVE;
-        default:
-            fprintf(stderr, "State %d not supported, found on %lx\n",
-                    currentState, addr);
-            break;
-    }
-
-    return INVALID;
-}
\ No newline at end of file
+//
+// Protocol tables.  Each rule gives the next state, cache action,
+//   permission and message for a state and event; ANY covers the snoops of
+//   a state that have no rule of their own.  A state with no rule for an
+//   event is not part of the protocol.
+//
+// Dirty lines are written back when evicted and clean lines are dropped
+//   without a message.  A line evicted while its request is outstanding
+//   keeps waiting for the request, less any shared copy it held, and is
+//   evicted again by coherence.c once the request completes.
+//
+// A store to a shared copy sends BusUpgr, which only invalidates the other
+//   copies, and the upgrade is granted by an Ack once they are gone.  An
+//   upgrade that loses the race to another writer is left in IM without
+//   data: the owner supplies it when the stale upgrade reaches it, and if
+//   none does the Ack retries the request as a BusWr.
+//
+// A store made while a read miss is outstanding waits in ISM for the fill
+//   and then upgrades, as a BusWr of its own could be ordered after a
+//   later writer while the read's reply still grants the line.
+//
+
+#define IS INVALID_SHARED
+#define ISE INVALID_SHARED_EXCLUSIVE
+#define IM INVALID_MODIFIED
+#define SM SHARED_MODIFIED
+#define OM OWNED_MODIFIED
+#define ISM INVALID_SHARED_MODIFIED
+
+#define LOAD(s, n, perm, msg) { s, EV_LOAD, n, NO_ACTION, perm, msg }
+#define STORE(s, n, perm, msg) { s, EV_STORE, n, NO_ACTION, perm, msg }
+#define EVICT(s, n, msg) { s, EV_EVICT, n, NO_ACTION, 0, msg }
+#define SNOOP(s, t, n, ca, msg) { s, EV_SNOOP + t, n, ca, 0, msg }
+#define ANY(s, n, ca, msg) { s, EV_ANY_SNOOP, n, ca, 0, msg }
+
+static const protocol_rule miRules[] = {
+    LOAD(INVALID, IM, 0, MSG_BUSWR),
+    STORE(INVALID, IM, 0, MSG_BUSWR),
+    LOAD(MODIFIED, MODIFIED, 1, MSG_NONE),
+    STORE(MODIFIED, MODIFIED, 1, MSG_NONE),
+    LOAD(IM, IM, 0, MSG_NONE),
+    STORE(IM, IM, 0, MSG_NONE),
+    EVICT(INVALID, INVALID, MSG_NONE),
+    EVICT(MODIFIED, INVALID, MSG_WRITEBACK),
+    EVICT(IM, IM, MSG_NONE),
+
+    ANY(INVALID, INVALID, NO_ACTION, MSG_ACK),
+    ANY(MODIFIED, INVALID, INVALIDATE, MSG_DATA),
+    SNOOP(IM, DATA, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(IM, SHARED, MODIFIED, DATA_RECV, MSG_NONE),
+    ANY(IM, IM, NO_ACTION, MSG_ACK),
+};
+
+static const protocol_rule msiRules[] = {
+    LOAD(INVALID, IS, 0, MSG_BUSRD),
+    STORE(INVALID, IM, 0, MSG_BUSWR),
+    LOAD(SHARE, SHARE, 1, MSG_NONE),
+    STORE(SHARE, SM, 0, MSG_BUSUPGR),
+    LOAD(MODIFIED, MODIFIED, 1, MSG_NONE),
+    STORE(MODIFIED, MODIFIED, 1, MSG_NONE),
+    LOAD(SM, SM, 1, MSG_NONE),
+    STORE(SM, SM, 0, MSG_NONE),
+    LOAD(IM, IM, 0, MSG_NONE),
+    STORE(IM, IM, 0, MSG_NONE),
+    LOAD(IS, IS, 0, MSG_NONE),
+    STORE(IS, ISM, 0, MSG_NONE),
+    LOAD(ISM, ISM, 0, MSG_NONE),
+    STORE(ISM, ISM, 0, MSG_NONE),
+    EVICT(INVALID, INVALID, MSG_NONE),
+    EVICT(SHARE, INVALID, MSG_NONE),
+    EVICT(MODIFIED, INVALID, MSG_WRITEBACK),
+    EVICT(SM, IM, MSG_NONE),
+    EVICT(IM, IM, MSG_NONE),
+    EVICT(IS, IS, MSG_NONE),
+    EVICT(ISM, ISM, MSG_NONE),
+
+    ANY(INVALID, INVALID, NO_ACTION, MSG_ACK),
+    SNOOP(MODIFIED, BUSRD, SHARE, NO_ACTION, MSG_DATA),
+    SNOOP(MODIFIED, BUSWR, INVALID, INVALIDATE, MSG_DATA),
+    SNOOP(MODIFIED, BUSUPGR, INVALID, INVALIDATE, MSG_DATA),
+    ANY(MODIFIED, MODIFIED, NO_ACTION, MSG_DATA),
+    SNOOP(SHARE, BUSWR, INVALID, INVALIDATE, MSG_ACK),
+    SNOOP(SHARE, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),
+    ANY(SHARE, SHARE, NO_ACTION, MSG_ACK),
+    SNOOP(SM, DATA, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(SM, ACK, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(SM, BUSWR, IM, NO_ACTION, MSG_ACK),
+    SNOOP(SM, BUSUPGR, IM, NO_ACTION, MSG_ACK),
+    ANY(SM, SM, NO_ACTION, MSG_ACK),
+    SNOOP(IM, DATA, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(IM, ACK, IM, NO_ACTION, MSG_BUSWR),
+    ANY(IM, IM, NO_ACTION, MSG_ACK),
+    SNOOP(IS, DATA, SHARE, DATA_RECV, MSG_NONE),
+    ANY(IS, IS, NO_ACTION, MSG_ACK),
+    SNOOP(ISM, DATA, SM, DATA_RECV, MSG_BUSUPGR),
+    ANY(ISM, ISM, NO_ACTION, MSG_ACK),
+};
+
+// Requests of the MESI family, less the states a protocol adds
+#define MESI_REQUESTS                                 \
+    LOAD(INVALID, ISE, 0, MSG_BUSRD),                 \
+    STORE(INVALID, IM, 0, MSG_BUSWR),                 \
+    LOAD(SHARE, SHARE, 1, MSG_NONE),                  \
+    STORE(SHARE, SM, 0, MSG_BUSUPGR),                 \
+    LOAD(MODIFIED, MODIFIED, 1, MSG_NONE),            \
+    STORE(MODIFIED, MODIFIED, 1, MSG_NONE),           \
+    LOAD(EXCLUSIVE, EXCLUSIVE, 1, MSG_NONE),          \
+    STORE(EXCLUSIVE, MODIFIED, 1, MSG_NONE),          \
+    LOAD(SM, SM, 1, MSG_NONE),                        \
+    STORE(SM, SM, 0, MSG_NONE),                       \
+    LOAD(IM, IM, 0, MSG_NONE),                        \
+    STORE(IM, IM, 0, MSG_NONE),                       \
+    LOAD(ISE, ISE, 0, MSG_NONE),                      \
+    STORE(ISE, ISM, 0, MSG_NONE),                     \
+    LOAD(ISM, ISM, 0, MSG_NONE),                      \
+    STORE(ISM, ISM, 0, MSG_NONE),                     \
+    EVICT(INVALID, INVALID, MSG_NONE),                \
+    EVICT(SHARE, INVALID, MSG_NONE),                  \
+    EVICT(EXCLUSIVE, INVALID, MSG_NONE),              \
+    EVICT(MODIFIED, INVALID, MSG_WRITEBACK),          \
+    EVICT(SM, IM, MSG_NONE),                          \
+    EVICT(IM, IM, MSG_NONE),                          \
+    EVICT(ISE, ISE, MSG_NONE),                        \
+    EVICT(ISM, ISM, MSG_NONE)
+
+// Snoops on E and the transient states of the MESI family
+#define MESI_SNOOPS                                           \
+    ANY(INVALID, INVALID, NO_ACTION, MSG_ACK),                \
+    SNOOP(EXCLUSIVE, BUSRD, SHARE, NO_ACTION, MSG_SHARED),    \
+    SNOOP(EXCLUSIVE, SHARED, SHARE, NO_ACTION, MSG_NONE),     \
+    SNOOP(EXCLUSIVE, BUSWR, INVALID, INVALIDATE, MSG_ACK),    \
+    SNOOP(EXCLUSIVE, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),  \
+    ANY(EXCLUSIVE, EXCLUSIVE, NO_ACTION, MSG_ACK),            \
+    SNOOP(SM, DATA, MODIFIED, DATA_RECV, MSG_NONE),           \
+    SNOOP(SM, ACK, MODIFIED, DATA_RECV, MSG_NONE),            \
+    SNOOP(SM, BUSWR, IM, NO_ACTION, MSG_ACK),                 \
+    SNOOP(SM, BUSUPGR, IM, NO_ACTION, MSG_ACK),               \
+    SNOOP(SM, BUSRD, SM, NO_ACTION, MSG_SHARED),              \
+    ANY(SM, SM, NO_ACTION, MSG_ACK),                          \
+    SNOOP(IM, DATA, MODIFIED, DATA_RECV, MSG_NONE),           \
+    SNOOP(IM, ACK, IM, NO_ACTION, MSG_BUSWR),                 \
+    ANY(IM, IM, NO_ACTION, MSG_ACK),                          \
+    SNOOP(ISE, DATA, EXCLUSIVE, DATA_RECV, MSG_NONE),         \
+    ANY(ISE, ISE, NO_ACTION, MSG_ACK),                        \
+    SNOOP(ISM, DATA, MODIFIED, DATA_RECV, MSG_NONE),          \
+    SNOOP(ISM, SHARED, SM, DATA_RECV, MSG_BUSUPGR),           \
+    ANY(ISM, ISM, NO_ACTION, MSG_ACK)
+
+static const protocol_rule mesiRules[] = {
+    MESI_REQUESTS,
+    MESI_SNOOPS,
+    SNOOP(MODIFIED, BUSRD, SHARE, NO_ACTION, MSG_SHARED_DATA),
+    SNOOP(MODIFIED, BUSWR, INVALID, INVALIDATE, MSG_DATA),
+    SNOOP(MODIFIED, BUSUPGR, INVALID, INVALIDATE, MSG_DATA),
+    ANY(MODIFIED, MODIFIED, NO_ACTION, MSG_ACK),
+    SNOOP(SHARE, BUSWR, INVALID, INVALIDATE, MSG_ACK),
+    SNOOP(SHARE, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),
+    SNOOP(SHARE, BUSRD, SHARE, NO_ACTION, MSG_SHARED),
+    ANY(SHARE, SHARE, NO_ACTION, MSG_ACK),
+    SNOOP(ISE, SHARED, SHARE, DATA_RECV, MSG_NONE),
+};
+
+// An owner upgrading its line waits in OM rather than SM, as it still has
+//   to supply the dirty data if another writer wins the race
+static const protocol_rule moesiRules[] = {
+    MESI_REQUESTS,
+    LOAD(OWNED, OWNED, 1, MSG_NONE),
+    STORE(OWNED, OM, 0, MSG_BUSUPGR),
+    LOAD(OM, OM, 1, MSG_NONE),
+    STORE(OM, OM, 0, MSG_NONE),
+    EVICT(OWNED, INVALID, MSG_WRITEBACK), // memory takes over as owner
+    EVICT(OM, IM, MSG_WRITEBACK),
+    MESI_SNOOPS,
+    SNOOP(MODIFIED, BUSRD, OWNED, NO_ACTION, MSG_SHARED_DATA),
+    SNOOP(MODIFIED, BUSWR, INVALID, INVALIDATE, MSG_DATA),
+    SNOOP(MODIFIED, BUSUPGR, INVALID, INVALIDATE, MSG_DATA),
+    ANY(MODIFIED, MODIFIED, NO_ACTION, MSG_ACK),
+    SNOOP(OWNED, BUSRD, OWNED, NO_ACTION, MSG_SHARED_DATA),
+    SNOOP(OWNED, BUSWR, INVALID, INVALIDATE, MSG_DATA),
+    // The upgrade may be stale and need the dirty copy
+    SNOOP(OWNED, BUSUPGR, INVALID, INVALIDATE, MSG_DATA),
+    ANY(OWNED, OWNED, NO_ACTION, MSG_ACK),
+    SNOOP(OM, DATA, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(OM, ACK, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(OM, BUSRD, OM, NO_ACTION, MSG_SHARED_DATA),
+    SNOOP(OM, BUSWR, IM, NO_ACTION, MSG_DATA),
+    SNOOP(OM, BUSUPGR, IM, NO_ACTION, MSG_DATA),
+    ANY(OM, OM, NO_ACTION, MSG_ACK),
+    SNOOP(SHARE, BUSWR, INVALID, INVALIDATE, MSG_ACK),
+    SNOOP(SHARE, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),
+    SNOOP(SHARE, BUSRD, SHARE, NO_ACTION, MSG_SHARED),
+    ANY(SHARE, SHARE, NO_ACTION, MSG_ACK),
+    SNOOP(ISE, SHARED, SHARE, DATA_RECV, MSG_NONE),
+};
+
+static const protocol_rule mesifRules[] = {
+    MESI_REQUESTS,
+    LOAD(FORWARD, FORWARD, 1, MSG_NONE),
+    STORE(FORWARD, SM, 0, MSG_BUSUPGR),
+    EVICT(FORWARD, INVALID, MSG_NONE), // clean, memory forwards instead
+    MESI_SNOOPS,
+    SNOOP(MODIFIED, BUSRD, SHARE, NO_ACTION, MSG_SHARED_DATA),
+    SNOOP(MODIFIED, BUSWR, INVALID, INVALIDATE, MSG_DATA),
+    SNOOP(MODIFIED, BUSUPGR, INVALID, INVALIDATE, MSG_DATA),
+    ANY(MODIFIED, MODIFIED, NO_ACTION, MSG_ACK),
+    SNOOP(FORWARD, BUSRD, SHARE, NO_ACTION, MSG_SHARED_DATA),
+    SNOOP(FORWARD, BUSWR, INVALID, INVALIDATE, MSG_DATA),
+    SNOOP(FORWARD, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),
+    ANY(FORWARD, FORWARD, NO_ACTION, MSG_ACK),
+    SNOOP(SHARE, BUSWR, INVALID, INVALIDATE, MSG_ACK),
+    SNOOP(SHARE, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),
+    SNOOP(SHARE, BUSRD, SHARE, NO_ACTION, MSG_SHARED), // F may be gone
+    ANY(SHARE, SHARE, NO_ACTION, MSG_ACK),
+    SNOOP(ISE, SHARED, FORWARD, DATA_RECV, MSG_NONE),
+};
+
+// Dragon write-update.  Sc is S and Sm, the owner of a dirty shared line,
+//   is O.  A write to a shared line broadcasts BusUpd, and the copies take
+//   the new value instead of being invalidated; a copy answers Shared, so
+//   the writer stays Sm while anyone else holds the line and becomes M once
+//   no one does.  A miss is always a BusRd, and a write miss that finds
+//   the line shared follows it with a BusUpd.  A copy that snoops BusUpgr
+//   is one the competitive mode (-u) chose to drop instead of updating.
+static const protocol_rule dragonRules[] = {
+    LOAD(INVALID, ISE, 0, MSG_BUSRD),
+    STORE(INVALID, IM, 0, MSG_BUSRD),
+    LOAD(EXCLUSIVE, EXCLUSIVE, 1, MSG_NONE),
+    STORE(EXCLUSIVE, MODIFIED, 1, MSG_NONE),
+    LOAD(MODIFIED, MODIFIED, 1, MSG_NONE),
+    STORE(MODIFIED, MODIFIED, 1, MSG_NONE),
+    LOAD(SHARE, SHARE, 1, MSG_NONE),
+    STORE(SHARE, SM, 0, MSG_BUSUPD),
+    LOAD(OWNED, OWNED, 1, MSG_NONE),
+    STORE(OWNED, SM, 0, MSG_BUSUPD),
+    LOAD(SM, SM, 1, MSG_NONE),
+    STORE(SM, SM, 0, MSG_NONE),
+    LOAD(IM, IM, 0, MSG_NONE),
+    STORE(IM, IM, 0, MSG_NONE),
+    LOAD(ISE, ISE, 0, MSG_NONE),
+    STORE(ISE, IM, 0, MSG_NONE),
+    EVICT(INVALID, INVALID, MSG_NONE),
+    EVICT(SHARE, INVALID, MSG_NONE),
+    EVICT(EXCLUSIVE, INVALID, MSG_NONE),
+    EVICT(MODIFIED, INVALID, MSG_WRITEBACK),
+    EVICT(OWNED, INVALID, MSG_WRITEBACK),
+    EVICT(SM, SM, MSG_NONE),
+    EVICT(IM, IM, MSG_NONE),
+    EVICT(ISE, ISE, MSG_NONE),
+
+    ANY(INVALID, INVALID, NO_ACTION, MSG_ACK),
+    SNOOP(EXCLUSIVE, BUSRD, SHARE, NO_ACTION, MSG_SHARED),
+    ANY(EXCLUSIVE, EXCLUSIVE, NO_ACTION, MSG_ACK),
+    SNOOP(MODIFIED, BUSRD, OWNED, NO_ACTION, MSG_SHARED_DATA),
+    ANY(MODIFIED, MODIFIED, NO_ACTION, MSG_ACK),
+    SNOOP(SHARE, BUSRD, SHARE, NO_ACTION, MSG_SHARED),
+    SNOOP(SHARE, BUSUPD, SHARE, NO_ACTION, MSG_SHARED),
+    SNOOP(SHARE, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),
+    ANY(SHARE, SHARE, NO_ACTION, MSG_ACK),
+    SNOOP(OWNED, BUSRD, OWNED, NO_ACTION, MSG_SHARED_DATA),
+    SNOOP(OWNED, BUSUPD, SHARE, NO_ACTION, MSG_SHARED), // writer owns it
+    SNOOP(OWNED, BUSUPGR, INVALID, INVALIDATE, MSG_ACK),
+    ANY(OWNED, OWNED, NO_ACTION, MSG_ACK),
+    SNOOP(SM, SHARED, OWNED, DATA_RECV, MSG_NONE),
+    SNOOP(SM, ACK, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(SM, BUSRD, SM, NO_ACTION, MSG_SHARED),
+    SNOOP(SM, BUSUPD, SM, NO_ACTION, MSG_SHARED),
+    ANY(SM, SM, NO_ACTION, MSG_ACK),
+    SNOOP(IM, DATA, MODIFIED, DATA_RECV, MSG_NONE),
+    SNOOP(IM, SHARED, SM, NO_ACTION, MSG_BUSUPD),
+    ANY(IM, IM, NO_ACTION, MSG_ACK),
+    SNOOP(ISE, DATA, EXCLUSIVE, DATA_RECV, MSG_NONE),
+    SNOOP(ISE, SHARED, SHARE, DATA_RECV, MSG_NONE),
+    ANY(ISE, ISE, NO_ACTION, MSG_ACK),
+};
+
+#define RULES(r) r, sizeof(r) / sizeof(r[0])
+
+const protocol protocols[] = {
+    [MI] = { "MI", RULES(miRules) },
+    [MSI] = { "MSI", RULES(msiRules) },
+    [MESI] = { "MESI", RULES(mesiRules) },
+    [MOESI] = { "MOESI", RULES(moesiRules) },
+    [MESIF] = { "MESIF", RULES(mesifRules) },
+    [DRAGON] = { "Dragon", RULES(dragonRules) },
+};
+
+const int protocolCount = sizeof(protocols) / sizeof(protocols[0]);
@@ -0,0 +1,410 @@
+#include <coherence.h>
+#include "coher_internal.h"
+
+#include <string.h>
+
+// Transition table interpreter.  A protocol's rules are expanded into a
+//   table indexed by state and event, so each request or snoop is one
+//   lookup.  Each cell remembers the rule it came from, to count how often
+//   each rule is taken.
+
+typedef struct _transition {
+    uint8_t next;       // UNDEF where the protocol has no transition
+    uint8_t ca;
+    uint8_t perm;
+    uint8_t msg;
+    int rule;
+} transition;
+
+static transition table[COHER_STATES][COHER_EVENTS];
+static const char* protocolName = NULL;
+static const protocol_rule* rules = NULL;
+static int ruleCount = 0;
+static protocol_rule* loadedRules = NULL;
+static uint64_t* ruleHits = NULL;
+static uint64_t undefinedHits = 0;
+static coherence_msg lastMsg = MSG_NONE;
+
+static const char* stateNames[COHER_STATES] = {
+    [UNDEF] = "-",
+    [MODIFIED] = "M",
+    [INVALID] = "I",
+    [SHARE] = "S",
+    [EXCLUSIVE] = "E",
+    [OWNED] = "O",
+    [FORWARD] = "F",
+    [INVALID_SHARED] = "IS",
+    [INVALID_SHARED_EXCLUSIVE] = "ISE",
+    [INVALID_MODIFIED] = "IM",
+    [SHARED_MODIFIED] = "SM",
+    [OWNED_MODIFIED] = "OM",
+    [INVALID_SHARED_MODIFIED] = "ISM",
+};
+
+static const char* eventNames[COHER_EVENTS + 1] = {
+    [EV_LOAD] = "Load",
+    [EV_STORE] = "Store",
+    [EV_EVICT] = "Evict",
+    [EV_SNOOP + NO_REQ] = "NoReq",
+    [EV_SNOOP + BUSRD] = "BusRd",
+    [EV_SNOOP + BUSWR] = "BusWr",
+    [EV_SNOOP + DATA] = "Data",
+    [EV_SNOOP + SHARED] = "Shared",
+    [EV_SNOOP + MEMORY] = "Memory",
+    [EV_SNOOP + ACK] = "Ack",
+    [EV_SNOOP + SHARED_DATA] = "SharedData",
+    [EV_SNOOP + BUSWB] = "Writeback",
+    [EV_SNOOP + BUSUPGR] = "BusUpgr",
+    [EV_SNOOP + BUSUPD] = "BusUpd",
+    [EV_ANY_SNOOP] = "Snoop",
+};
+
+static const char* caNames[] = {
+    [NO_ACTION] = "-",
+    [DATA_RECV] = "fill",
+    [INVALIDATE] = "invalidate",
+};
+
+static const char* msgNames[] = {
+    [MSG_NONE] = "-",
+    [MSG_BUSRD] = "busRd",
+    [MSG_BUSWR] = "busWr",
+    [MSG_DATA] = "data",
+    [MSG_SHARED_DATA] = "sharedData",
+    [MSG_SHARED] = "shared",
+    [MSG_ACK] = "ack",
+    [MSG_WRITEBACK] = "writeback",
+    [MSG_BUSUPGR] = "busUpgr",
+    [MSG_BUSUPD] = "busUpd",
+};
+
+#define NAMES(a) (int)(sizeof(a) / sizeof(a[0]))
+
+static int lookupName(const char* const* names, int count, const char* name)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (names[i] != NULL && strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void fillCell(const protocol_rule* r, int index, int event)
+{
+    transition* t = &table[r->state][event];
+    t->next = r->next;
+    t->ca = r->ca;
+    t->perm = r->perm;
+    t->msg = r->msg;
+    t->rule = index;
+}
+
+// Expand the rules into the table: ANY rules first, so that rules naming
+//   a snoop replace them
+static int buildTable(void)
+{
+    memset(table, 0, sizeof(table));
+
+    for (int i = 0; i < ruleCount; i++)
+    {
+        const protocol_rule* r = &rules[i];
+        if (r->state <= UNDEF || r->state >= COHER_STATES ||
+            r->next <= UNDEF || r->next >= COHER_STATES)
+        {
+            fprintf(stderr, "Protocol %s: rule %d has no valid state\n",
+                    protocolName, i);
+            return 1;
+        }
+        if (r->event != EV_ANY_SNOOP)
+            continue;
+        for (int e = EV_SNOOP; e < COHER_EVENTS; e++)
+        {
+            fillCell(r, i, e);
+        }
+    }
+
+    for (int i = 0; i < ruleCount; i++)
+    {
+        const protocol_rule* r = &rules[i];
+        if (r->event == EV_ANY_SNOOP)
+            continue;
+
+        transition* t = &table[r->state][r->event];
+        if (t->next != UNDEF && rules[t->rule].event != EV_ANY_SNOOP)
+        {
+            fprintf(stderr, "Protocol %s: %s %s has two rules\n", protocolName,
+                    stateNames[r->state], eventNames[r->event]);
+            return 1;
+        }
+        fillCell(r, i, r->event);
+    }
+
+    free(ruleHits);
+    ruleHits = calloc(ruleCount, sizeof(uint64_t));
+    undefinedHits = 0;
+    return 0;
+}
+
+int protocolSelect(coherence_scheme scheme)
+{
+    if ((int)scheme < 0 || (int)scheme >= protocolCount)
+    {
+        fprintf(stderr, "Undefined coherence scheme - %d\n", scheme);
+        return 1;
+    }
+
+    protocolName = protocols[scheme].name;
+    rules = protocols[scheme].rules;
+    ruleCount = protocols[scheme].ruleCount;
+    return buildTable();
+}
+
+// A rule file has one rule per line,
+//     state event next [action] [message] [perm]
+//   with # starting a comment.  States and events are named as in the
+//   coverage report; "Snoop" is the event of an ANY rule.
+int protocolLoad(const char* fileName)
+{
+    FILE* f = fopen(fileName, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Couldn't open protocol file %s\n", fileName);
+        return 1;
+    }
+
+    int capacity = 64;
+    int count = 0;
+    protocol_rule* loaded = malloc(sizeof(protocol_rule) * capacity);
+    char line[256];
+    int lineNum = 0;
+    int err = 0;
+
+    while (err == 0 && fgets(line, sizeof(line), f) != NULL)
+    {
+        lineNum++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char* words[6];
+        int n = 0;
+        for (char* w = strtok(line, " \t\r\n"); w != NULL;
+             w = strtok(NULL, " \t\r\n"))
+        {
+            if (n == 6)
+            {
+                n++;
+                break;
+            }
+            words[n++] = w;
+        }
+        if (n == 0)
+            continue;
+
+        protocol_rule r = { 0 };
+        int state = lookupName(stateNames, NAMES(stateNames), words[0]);
+        int event = (n > 1)
+                        ? lookupName(eventNames, NAMES(eventNames), words[1])
+                        : -1;
+        int next = (n > 2)
+                       ? lookupName(stateNames, NAMES(stateNames), words[2])
+                       : -1;
+        if (n < 3 || n > 6 || state <= UNDEF || event < 0 || next <= UNDEF)
+        {
+            fprintf(stderr, "%s:%d: expected state event next\n", fileName,
+                    lineNum);
+            err = 1;
+            break;
+        }
+        r.state = state;
+        r.event = event;
+        r.next = next;
+
+        for (int i = 3; i < n; i++)
+        {
+            int v;
+            if (strcmp(words[i], "-") == 0)
+                continue;
+            else if (strcmp(words[i], "perm") == 0)
+                r.perm = 1;
+            else if ((v = lookupName(caNames, NAMES(caNames), words[i])) > 0)
+                r.ca = v;
+            else if ((v = lookupName(msgNames, NAMES(msgNames), words[i])) > 0)
+                r.msg = v;
+            else
+            {
+                fprintf(stderr, "%s:%d: unknown action %s\n", fileName,
+                        lineNum, words[i]);
+                err = 1;
+            }
+        }
+
+        if (count == capacity)
+        {
+            capacity *= 2;
+            loaded = realloc(loaded, sizeof(protocol_rule) * capacity);
+        }
+        loaded[count++] = r;
+    }
+    fclose(f);
+
+    if (err)
+    {
+        free(loaded);
+        return 1;
+    }
+
+    free(loadedRules);
+    loadedRules = loaded;
+    protocolName = fileName;
+    rules = loaded;
+    ruleCount = count;
+    return buildTable();
+}
+
+void protocolFree(void)
+{
+    free(loadedRules);
+    free(ruleHits);
+    loadedRules = NULL;
+    ruleHits = NULL;
+}
+
+static void sendMsg(coherence_msg msg, bus_req_type reqType, uint64_t addr,
+                    int procNum, int srcProc, int msgNum)
+{
+    lastMsg = msg;
+    switch (msg)
+    {
+        case MSG_NONE:
+            break;
+        case MSG_BUSRD:
+            sendBusRd(addr, procNum);
+            break;
+        case MSG_BUSWR:
+            sendBusWr(addr, procNum);
+            break;
+        case MSG_DATA:
+            sendData(addr, procNum, srcProc, msgNum);
+            break;
+        case MSG_SHARED_DATA:
+            shareData(addr, procNum, srcProc, msgNum);
+            break;
+        case MSG_SHARED:
+            indicateShared(addr, procNum, srcProc, msgNum);
+            break;
+        case MSG_ACK:
+            ack(addr, procNum, srcProc, reqType, msgNum);
+            break;
+        case MSG_WRITEBACK:
+            sendWriteback(addr, procNum);
+            break;
+        case MSG_BUSUPGR:
+            sendBusUpgr(addr, procNum);
+            break;
+        case MSG_BUSUPD:
+            sendBusUpd(addr, procNum);
+            break;
+    }
+}
+
+static transition* lookup(coherence_states state, int event, uint64_t addr)
+{
+    transition* t = &table[state][event];
+    if (t->next == UNDEF)
+    {
+        lastMsg = MSG_NONE;
+        undefinedHits++;
+        fprintf(stderr, "State %d not supported, found on %lx\n", state, addr);
+        return NULL;
+    }
+
+    ruleHits[t->rule]++;
+    return t;
+}
+
+coherence_states protocolCache(uint8_t is_read, uint8_t* permAvail,
+                               coherence_states currentState, uint64_t addr,
+                               int procNum)
+{
+    transition* t = lookup(currentState, is_read ? EV_LOAD : EV_STORE, addr);
+    if (t == NULL)
+        return INVALID;
+
+    *permAvail = t->perm;
+    sendMsg(t->msg, NO_REQ, addr, procNum, -1, -1);
+    return t->next;
+}
+
+// A protocol without eviction rules drops the line
+coherence_states protocolEvict(coherence_states currentState, uint64_t addr,
+                               int procNum, uint8_t* writeback)
+{
+    transition* t = &table[currentState][EV_EVICT];
+    *writeback = 0;
+    lastMsg = MSG_NONE;
+    if (t->next == UNDEF)
+        return INVALID;
+
+    ruleHits[t->rule]++;
+    *writeback = (t->msg == MSG_WRITEBACK);
+    sendMsg(t->msg, NO_REQ, addr, procNum, -1, -1);
+    return t->next;
+}
+
+coherence_states protocolSnoop(bus_req_type reqType, cache_action* ca,
+                               coherence_states currentState, uint64_t addr,
+                               int procNum, int srcProc, int msgNum)
+{
+    *ca = NO_ACTION;
+    transition* t = lookup(currentState, EV_SNOOP + reqType, addr);
+    if (t == NULL)
+        return INVALID;
+
+    *ca = t->ca;
+    sendMsg(t->msg, reqType, addr, procNum, srcProc, msgNum);
+    return t->next;
+}
+
+coherence_msg protocolLastMessage(void)
+{
+    return lastMsg;
+}
+
+const char* protocolStateName(coherence_states state)
+{
+    return stateNames[state];
+}
+
+const char* protocolEventName(coherence_event event)
+{
+    return eventNames[event];
+}
+
+void protocolReport(int outFd)
+{
+    int used = 0;
+    for (int i = 0; i < ruleCount; i++)
+    {
+        used += (ruleHits[i] > 0);
+    }
+
+    dprintf(outFd, "Protocol %s - %d of %d transitions taken", protocolName,
+            used, ruleCount);
+    if (undefinedHits > 0)
+        dprintf(outFd, ", %lu undefined", undefinedHits);
+    dprintf(outFd, "\n");
+
+    if (!CADSS_VERBOSE)
+        return;
+
+    for (int i = 0; i < ruleCount; i++)
+    {
+        const protocol_rule* r = &rules[i];
+        dprintf(outFd, "  %-4s %-10s -> %-4s %-10s %-10s %s %lu\n",
+                stateNames[r->state], eventNames[r->event],
+                stateNames[r->next], caNames[r->ca], msgNames[r->msg],
+                r->perm ? "perm" : "-   ", ruleHits[i]);
+    }
+}
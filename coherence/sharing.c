@@ -0,0 +1,274 @@
+#include <coherence.h>
+#include "coher_internal.h"
+
+#include <stdlib.h>
+
+// Sharing miss classification.  A processor whose copy is invalidated by
+//   another's write has lost the line; its next access to the line, if it
+//   holds no copy by then, is a coherence miss.  The miss is true sharing
+//   when another processor wrote one of the words it accesses since the
+//   copy was lost, and false sharing otherwise.
+//
+// Lines are tracked from their first store, each with a word mask per
+//   processor of the words it touched and of the words others wrote since
+//   it last touched the line.  A store reaches other copies later than the
+//   cache sees it, so each processor's latest store is also added to the
+//   copies it invalidates.
+
+#define WORD_BYTES 4
+#define LINE_WORDS 64 // mask bits, offsets past them wrap
+#define INITIAL_LOG_SLOTS 10
+
+typedef struct _sharing_line {
+    uint64_t addr;
+    uint64_t trueMisses;
+    uint64_t falseMisses;
+} sharing_line;
+
+static int procs = 0;
+static sharing_line* lines = NULL;
+static uint64_t* touched = NULL;   // procs masks per line
+static uint64_t* written = NULL;   // procs masks per line, by others
+static uint8_t* lost = NULL;       // procs flags per line
+static uint64_t* storeAddr = NULL; // per processor, latest store
+static uint64_t* storeWords = NULL;
+static uint64_t lineCount = 0;
+static uint64_t lineCapacity = 0;
+
+// Open addressed index into lines, slot holds line index + 1
+static uint32_t* slots = NULL;
+static uint64_t slotMask = 0;
+static int slotShift = 0;
+
+static uint64_t trueMisses = 0;
+static uint64_t falseMisses = 0;
+
+static inline uint64_t home(uint64_t addr)
+{
+    return (addr * 0x9E3779B97F4A7C15ull) >> slotShift;
+}
+
+static void* allocate(void* p, uint64_t bytes)
+{
+    p = realloc(p, bytes);
+    if (p == NULL)
+    {
+        fprintf(stderr, "ERROR.  Couldn't allocate sharing table\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void allocateSlots(int logSlots)
+{
+    uint64_t count = 1ull << logSlots;
+
+    free(slots);
+    slots = calloc(count, sizeof(uint32_t));
+    if (slots == NULL)
+    {
+        fprintf(stderr, "ERROR.  Couldn't allocate sharing table\n");
+        exit(1);
+    }
+    slotMask = count - 1;
+    slotShift = 64 - logSlots;
+
+    for (uint64_t i = 0; i < lineCount; i++)
+    {
+        uint64_t s = home(lines[i].addr);
+        while (slots[s] != 0)
+            s = (s + 1) & slotMask;
+        slots[s] = i + 1;
+    }
+}
+
+static sharing_line* findLine(uint64_t addr)
+{
+    for (uint64_t s = home(addr);; s = (s + 1) & slotMask)
+    {
+        if (slots[s] == 0)
+            return NULL;
+        if (lines[slots[s] - 1].addr == addr)
+            return &lines[slots[s] - 1];
+    }
+}
+
+static sharing_line* addLine(uint64_t addr)
+{
+    if (lineCount == lineCapacity)
+    {
+        lineCapacity = (lineCapacity == 0) ? 1024 : lineCapacity * 2;
+        lines = allocate(lines, sizeof(sharing_line) * lineCapacity);
+        touched = allocate(touched, sizeof(uint64_t) * lineCapacity * procs);
+        written = allocate(written, sizeof(uint64_t) * lineCapacity * procs);
+        lost = allocate(lost, sizeof(uint8_t) * lineCapacity * procs);
+    }
+
+    // Keep the load under 3/4 so probe runs stay short
+    if ((lineCount + 1) * 4 > (slotMask + 1) * 3)
+        allocateSlots(64 - slotShift + 1);
+
+    uint64_t i = lineCount++;
+    lines[i] = (sharing_line){ .addr = addr };
+    for (int p = 0; p < procs; p++)
+    {
+        touched[i * procs + p] = 0;
+        written[i * procs + p] = 0;
+        lost[i * procs + p] = 0;
+    }
+
+    uint64_t s = home(addr);
+    while (slots[s] != 0)
+        s = (s + 1) & slotMask;
+    slots[s] = i + 1;
+    return &lines[i];
+}
+
+void sharingInit(int processorCount)
+{
+    procs = processorCount;
+    allocateSlots(INITIAL_LOG_SLOTS);
+    storeAddr = calloc(procs, sizeof(uint64_t));
+    storeWords = calloc(procs, sizeof(uint64_t));
+}
+
+void sharingInvalidate(uint64_t addr, int procNum)
+{
+    sharing_line* l = findLine(addr);
+    if (l == NULL)
+        return;
+
+    uint64_t i = (l - lines) * procs + procNum;
+    lost[i] = 1;
+    for (int p = 0; p < procs; p++)
+    {
+        if (p != procNum && storeAddr[p] == addr)
+            written[i] |= storeWords[p];
+    }
+}
+
+void sharingAccess(uint8_t is_read, uint64_t addr, int offset, int size,
+                   int procNum, bool hasCopy)
+{
+    if (size <= 0)
+        return;
+
+    sharing_line* l = findLine(addr);
+    if (l == NULL)
+    {
+        if (is_read)
+            return;
+        l = addLine(addr);
+    }
+
+    uint64_t words = 0;
+    for (int w = offset / WORD_BYTES; w <= (offset + size - 1) / WORD_BYTES;
+         w++)
+    {
+        words |= 1ull << (w % LINE_WORDS);
+    }
+
+    uint64_t base = (l - lines) * procs;
+    touched[base + procNum] |= words;
+
+    if (lost[base + procNum])
+    {
+        lost[base + procNum] = 0;
+        if (!hasCopy)
+        {
+            if (written[base + procNum] & words)
+            {
+                l->trueMisses++;
+                trueMisses++;
+            }
+            else
+            {
+                l->falseMisses++;
+                falseMisses++;
+            }
+        }
+    }
+    written[base + procNum] = 0;
+
+    if (is_read)
+        return;
+
+    storeAddr[procNum] = addr;
+    storeWords[procNum] = words;
+    for (int p = 0; p < procs; p++)
+    {
+        if (p != procNum)
+            written[base + p] |= words;
+    }
+}
+
+// Worst lines first: most false sharing misses, then most misses
+static int compareLines(const void* a, const void* b)
+{
+    const sharing_line* la = &lines[*(const uint32_t*)a];
+    const sharing_line* lb = &lines[*(const uint32_t*)b];
+
+    if (la->falseMisses != lb->falseMisses)
+        return (la->falseMisses < lb->falseMisses) ? 1 : -1;
+    uint64_t ma = la->falseMisses + la->trueMisses;
+    uint64_t mb = lb->falseMisses + lb->trueMisses;
+    if (ma != mb)
+        return (ma < mb) ? 1 : -1;
+    return (la->addr > lb->addr) - (la->addr < lb->addr);
+}
+
+void sharingReport(int outFd, int top)
+{
+    if (trueMisses + falseMisses == 0)
+        return;
+
+    dprintf(outFd,
+            "Sharing misses - %lu, true sharing - %lu, false sharing - %lu\n",
+            trueMisses + falseMisses, trueMisses, falseMisses);
+
+    uint32_t* order = malloc(sizeof(uint32_t) * lineCount);
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < lineCount; i++)
+    {
+        if (lines[i].trueMisses + lines[i].falseMisses > 0)
+            order[count++] = i;
+    }
+    qsort(order, count, sizeof(uint32_t), compareLines);
+
+    // Each line is followed by the words each processor touched, as a mask
+    //   of WORD_BYTES words; disjoint masks are the false sharing to pad out
+    for (uint64_t i = 0; i < count && i < (uint64_t)top; i++)
+    {
+        sharing_line* l = &lines[order[i]];
+        uint64_t base = order[i] * (uint64_t)procs;
+
+        dprintf(outFd, "  Line %lx - %lu false, %lu true;", l->addr,
+                l->falseMisses, l->trueMisses);
+        for (int p = 0; p < procs; p++)
+        {
+            if (touched[base + p] != 0)
+                dprintf(outFd, " p%d %lx", p, touched[base + p]);
+        }
+        dprintf(outFd, "\n");
+    }
+    free(order);
+}
+
+void sharingFree(void)
+{
+    free(lines);
+    free(touched);
+    free(written);
+    free(lost);
+    free(slots);
+    free(storeAddr);
+    free(storeWords);
+    lines = NULL;
+    touched = NULL;
+    written = NULL;
+    lost = NULL;
+    slots = NULL;
+    storeAddr = NULL;
+    storeWords = NULL;
+    lineCount = lineCapacity = 0;
+}
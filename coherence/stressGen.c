@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+//
+// stressGen - write a randomized multi-core trace for coherence testing
+//
+//   Every processor hammers the same few hot lines with loads and stores of
+//   random words, so requests for a line race each other.  A share of the
+//   accesses go to private cold lines that push the hot lines out of small
+//   caches, and ALU ops between accesses vary the timing.  Run the result
+//   with the coherence component's -v to check the invariants.
+//
+
+#define HOT_BASE 0x100000ull
+#define COLD_BASE 0x10000000ull
+#define COLD_STRIDE 0x1000000ull // per processor
+#define COLD_LINES 4096
+#define ARCH_REGS 32
+
+static uint64_t rngState = 1;
+
+// xorshift64*, so a seed always gives the same traces
+static uint64_t nextRandom(void)
+{
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return rngState * 0x2545F4914F6CDD1Dull;
+}
+
+static int randomBelow(int n)
+{
+    return (int)((nextRandom() >> 33) % (uint64_t)n);
+}
+
+void printHelp(char* prog)
+{
+    printf("%s \n", prog);
+    printf("  -h            \t Help message\n");
+    printf("  -o <dir>      \t Directory for the p<n>.trace files\n");
+    printf("  -n <num>      \t Processors, default 4\n");
+    printf("  -k <num>      \t Memory ops per processor, default 20000\n");
+    printf("  -l <num>      \t Hot lines, default 4\n");
+    printf("  -w <pct>      \t Stores among hot accesses, default 40\n");
+    printf("  -c <pct>      \t Accesses to cold lines, default 10\n");
+    printf("  -a <pct>      \t ALU ops between accesses, default 25\n");
+    printf("  -b <bits>     \t Block size in bits, default 6\n");
+    printf("  -r <seed>     \t Random seed, default 1\n");
+}
+
+static void writeTrace(FILE* f, int proc, int ops, int hotLines,
+                       int storePct, int coldPct, int aluPct, int blockSize)
+{
+    uint64_t pc = 0x400000 + (uint64_t)proc * 0x10000;
+
+    for (int i = 0; i < ops; i++)
+    {
+        while (randomBelow(100) < aluPct)
+        {
+            fprintf(f, "A %lx %d, %d, %d\n", pc, 1 + randomBelow(ARCH_REGS - 1),
+                    1 + randomBelow(ARCH_REGS - 1),
+                    1 + randomBelow(ARCH_REGS - 1));
+            pc += 4;
+        }
+
+        uint64_t addr;
+        int size = (blockSize >= 8 && randomBelow(4) == 0) ? 8 : 4;
+        if (size > blockSize)
+            size = blockSize;
+
+        // Accesses stay within the line, as simpleCache assumes
+        if (randomBelow(100) < coldPct)
+        {
+            addr = COLD_BASE + proc * COLD_STRIDE +
+                   (uint64_t)randomBelow(COLD_LINES) * blockSize;
+        }
+        else
+        {
+            addr = HOT_BASE + (uint64_t)randomBelow(hotLines) * blockSize +
+                   (uint64_t)randomBelow(blockSize / size) * size;
+        }
+
+        char type = (randomBelow(100) < storePct) ? 'S' : 'L';
+        fprintf(f, "%c 0x%lx, %d\n", type, addr, size);
+        pc += 4;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int op;
+    char* outDir = NULL;
+    int procs = 4;
+    int ops = 20000;
+    int hotLines = 4;
+    int storePct = 40;
+    int coldPct = 10;
+    int aluPct = 25;
+    int blockBits = 6;
+    uint64_t seed = 1;
+
+    while ((op = getopt(argc, argv, "ho:n:k:l:w:c:a:b:r:")) != -1)
+    {
+        switch (op)
+        {
+            case 'o':
+                outDir = optarg;
+                break;
+            case 'n':
+                procs = atoi(optarg);
+                break;
+            case 'k':
+                ops = atoi(optarg);
+                break;
+            case 'l':
+                hotLines = atoi(optarg);
+                break;
+            case 'w':
+                storePct = atoi(optarg);
+                break;
+            case 'c':
+                coldPct = atoi(optarg);
+                break;
+            case 'a':
+                aluPct = atoi(optarg);
+                break;
+            case 'b':
+                blockBits = atoi(optarg);
+                break;
+            case 'r':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'h':
+            default:
+                printHelp(argv[0]);
+                return (op == 'h') ? 0 : 1;
+        }
+    }
+
+    if (outDir == NULL || procs < 1 || procs > 256 || hotLines < 1 ||
+        blockBits < 2 || blockBits > 20 || aluPct >= 100)
+    {
+        printHelp(argv[0]);
+        return 1;
+    }
+
+    if (mkdir(outDir, 0755) != 0 && errno != EEXIST)
+    {
+        perror("Error creating trace directory - ");
+        return 1;
+    }
+
+    // Zero is the one state xorshift never leaves
+    rngState = (seed != 0) ? seed : 1;
+    int blockSize = 1 << blockBits;
+
+    for (int p = 0; p < procs; p++)
+    {
+        char name[4096];
+        snprintf(name, sizeof(name), "%s/p%d.trace", outDir, p);
+        FILE* f = fopen(name, "w");
+        if (f == NULL)
+        {
+            perror("Error opening trace file - ");
+            return 1;
+        }
+        writeTrace(f, p, ops, hotLines, storePct, coldPct, aluPct, blockSize);
+        fclose(f);
+    }
+
+    printf("Wrote %d traces of %d ops to %s, seed %lu\n", procs, ops, outDir,
+           seed);
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <coherence.h>
+#include "coher_internal.h"
+
+#include <linetable.h>
+#include <stdlib.h>
+
+// Invariant checks (-v).  After each transition the line it touched is
+//   checked across all processors, so a check costs one lookup per
+//   processor:
+//
+//   single writer  - a copy in M or E is the only copy
+//   one owner      - at most one copy in O and at most one in F
+//   dirty data     - at most one copy holds data newer than memory, and a
+//                    copy that does passes the data on, by a data message
+//                    or writeback, before it is dropped or made clean
+//
+// A copy is dirty from when it enters M or O until it leaves them for a
+//   state that is not upgrading them (OM, or SM in Dragon).  An update
+//   hands the dirty data to its writer, who holds the whole line.  The
+//   dirty copies are kept in dirtyLines, one table per processor.
+
+#define VERIFY_PRINT_LIMIT 10
+
+typedef enum _violation
+{
+    SINGLE_WRITER,
+    ONE_OWNER,
+    DIRTY_DATA,
+    VIOLATION_KINDS
+} violation;
+
+static const char* violationNames[VIOLATION_KINDS] = {
+    [SINGLE_WRITER] = "single writer",
+    [ONE_OWNER] = "one owner",
+    [DIRTY_DATA] = "dirty data",
+};
+
+static int procs = 0;
+static line_table** dirtyLines = NULL;
+static uint64_t checks = 0;
+static uint64_t violations[VIOLATION_KINDS] = { 0 };
+static uint64_t printed = 0;
+
+void verifyInit(int processorCount)
+{
+    procs = processorCount;
+    dirtyLines = malloc(sizeof(line_table*) * procs);
+    for (int i = 0; i < procs; i++)
+    {
+        dirtyLines[i] = line_table_new();
+    }
+}
+
+static void report(violation kind, uint64_t addr, int procNum,
+                   coherence_event event)
+{
+    violations[kind]++;
+    if (printed++ >= VERIFY_PRINT_LIMIT)
+        return;
+
+    fprintf(stderr, "Coherence violation (%s) on %lx after processor %d %s:",
+            violationNames[kind], addr, procNum, protocolEventName(event));
+    for (int i = 0; i < procs; i++)
+    {
+        coherence_states state = getState(addr, i);
+        bool dirty = line_table_find(dirtyLines[i], addr);
+        if (state != INVALID || dirty)
+            fprintf(stderr, " p%d %s%s", i, protocolStateName(state),
+                    dirty ? "*" : "");
+    }
+    fprintf(stderr, "\n");
+}
+
+// Track the copy's dirty data through the transition
+static void checkDirty(uint64_t addr, int procNum, coherence_event event,
+                       coherence_states nextState)
+{
+    bool dirty = line_table_find(dirtyLines[procNum], addr);
+
+    if (event == EV_SNOOP + BUSUPD)
+    {
+        if (dirty)
+            line_table_remove(dirtyLines[procNum], addr);
+        return;
+    }
+    if (nextState == MODIFIED || nextState == OWNED)
+    {
+        if (!dirty)
+            line_table_set(dirtyLines[procNum], addr, 1);
+        return;
+    }
+    if (!dirty || nextState == SHARED_MODIFIED || nextState == OWNED_MODIFIED)
+        return;
+
+    coherence_msg msg = protocolLastMessage();
+    if (msg != MSG_DATA && msg != MSG_SHARED_DATA && msg != MSG_WRITEBACK)
+    {
+        report(DIRTY_DATA, addr, procNum, event);
+    }
+    line_table_remove(dirtyLines[procNum], addr);
+}
+
+void verifyTransition(uint64_t addr, int procNum, coherence_event event,
+                      coherence_states nextState)
+{
+    checks++;
+    checkDirty(addr, procNum, event, nextState);
+
+    int writers = 0, readers = 0, owners = 0, forwarders = 0, dirty = 0;
+    for (int i = 0; i < procs; i++)
+    {
+        switch (getState(addr, i))
+        {
+            case MODIFIED:
+            case EXCLUSIVE:
+                writers++;
+                break;
+            case OWNED:
+                owners++;
+                readers++;
+                break;
+            case FORWARD:
+                forwarders++;
+                readers++;
+                break;
+            case SHARE:
+            case SHARED_MODIFIED:
+            case OWNED_MODIFIED:
+                readers++;
+                break;
+            default:
+                break;
+        }
+        if (dirtyLines[i]->count > 0)
+            dirty += (line_table_find(dirtyLines[i], addr) != 0);
+    }
+
+    if (writers > 1 || (writers == 1 && readers > 0))
+        report(SINGLE_WRITER, addr, procNum, event);
+    if (owners > 1 || forwarders > 1)
+        report(ONE_OWNER, addr, procNum, event);
+    if (dirty > 1)
+        report(DIRTY_DATA, addr, procNum, event);
+}
+
+void verifyReport(int outFd)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < VIOLATION_KINDS; i++)
+    {
+        total += violations[i];
+    }
+
+    dprintf(outFd, "Invariant checks - %lu, violations - %lu", checks, total);
+    if (total > 0)
+    {
+        dprintf(outFd, " (single writer %lu, one owner %lu, dirty data %lu)",
+                violations[SINGLE_WRITER], violations[ONE_OWNER],
+                violations[DIRTY_DATA]);
+    }
+    dprintf(outFd, "\n");
+}
+
+void verifyFree(void)
+{
+    for (int i = 0; i < procs; i++)
+    {
+        line_table_free(dirtyLines[i]);
+    }
+    free(dirtyLines);
+    dirtyLines = NULL;
+}
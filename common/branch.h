@@ -10,6 +10,9 @@ enum BRANCH_MODEL_TYPE
     GSHARE = 1,
     GSELECT = 2,
     YEH_PATT = 3,
+    TAGE_SC_L = 4,
+    PERCEPTRON = 5,
+    TOURNAMENT = 6,
 };
 
 typedef struct _branch_sim_args {
@@ -9,6 +9,10 @@ typedef struct _cache_sim_args {
     int arg_count;
     char** arg_list;
     coher* coherComp;
+    // Set when the coherence component exports accessReq: every access,
+    //   hit or miss, with the line address and its bytes within the line
+    void (*accessReq)(uint8_t is_read, uint64_t addr, int offset, int size,
+                      int processorNum);
 } cache_sim_args;
 
 typedef struct _cache {
@@ -15,7 +15,11 @@ typedef enum _bus_req_type
     SHARED,
     MEMORY,
     ACK,
-    SHARED_DATA
+    SHARED_DATA,
+    BUSWB,          // dirty line written back to its home
+    BUSUPGR,        // shared copy made writable, invalidates the others
+    BUSUPD,         // a write broadcast to the other copies, which keep them
+    BUSINV          // snoop filter eviction, the copy is evicted from the cache
 } bus_req_type;
 
 #include "coherence.h"
@@ -34,6 +38,7 @@ typedef struct _interconn {
     void (*registerCoher)(struct _coher* coherComp);
     int (*busReqCacheTransfer)(uint64_t addr, int procNum);
     debug_env_vars dbgEnv;
+    bool pointToPoint;  // req delivers to pDest, rather than to every cache
 } interconn;
 
 #endif
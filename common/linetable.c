@@ -0,0 +1,136 @@
+#include "linetable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INITIAL_LOG_SLOTS 10
+
+static void allocate(line_table* lt, int logSlots)
+{
+    uint64_t slots = 1ull << logSlots;
+
+    lt->keys = malloc(sizeof(uint64_t) * slots);
+    lt->states = calloc(slots, sizeof(uint8_t));
+    if (lt->keys == NULL || lt->states == NULL)
+    {
+        fprintf(stderr, "ERROR.  Couldn't allocate line table\n");
+        exit(1);
+    }
+    lt->mask = slots - 1;
+    lt->shift = 64 - logSlots;
+    lt->count = 0;
+}
+
+// Line addresses share their low bits, so take the high bits of a
+//   multiplicative hash
+static inline uint64_t home(line_table* lt, uint64_t addr)
+{
+    return (addr * 0x9E3779B97F4A7C15ull) >> lt->shift;
+}
+
+static void grow(line_table* lt)
+{
+    uint64_t* keys = lt->keys;
+    uint8_t* states = lt->states;
+    uint64_t slots = lt->mask + 1;
+
+    allocate(lt, 64 - lt->shift + 1);
+    for (uint64_t i = 0; i < slots; i++)
+    {
+        if (states[i] != 0)
+            line_table_set(lt, keys[i], states[i]);
+    }
+
+    free(keys);
+    free(states);
+}
+
+line_table* line_table_new(void)
+{
+    line_table* lt = malloc(sizeof(line_table));
+    if (lt == NULL)
+    {
+        fprintf(stderr, "ERROR.  Couldn't create line table\n");
+        exit(1);
+    }
+    allocate(lt, INITIAL_LOG_SLOTS);
+    return lt;
+}
+
+void line_table_free(line_table* lt)
+{
+    free(lt->keys);
+    free(lt->states);
+    free(lt);
+}
+
+uint8_t line_table_find(line_table* lt, uint64_t addr)
+{
+    for (uint64_t i = home(lt, addr);; i = (i + 1) & lt->mask)
+    {
+        if (lt->states[i] == 0)
+            return 0;
+        if (lt->keys[i] == addr)
+            return lt->states[i];
+    }
+}
+
+void line_table_set(line_table* lt, uint64_t addr, uint8_t state)
+{
+    if (state == 0)
+    {
+        line_table_remove(lt, addr);
+        return;
+    }
+
+    uint64_t i = home(lt, addr);
+    while (lt->states[i] != 0)
+    {
+        if (lt->keys[i] == addr)
+        {
+            lt->states[i] = state;
+            return;
+        }
+        i = (i + 1) & lt->mask;
+    }
+
+    // Keep the load under 3/4 so probe runs stay short
+    if ((lt->count + 1) * 4 > (lt->mask + 1) * 3)
+    {
+        grow(lt);
+        line_table_set(lt, addr, state);
+        return;
+    }
+
+    lt->keys[i] = addr;
+    lt->states[i] = state;
+    lt->count++;
+}
+
+void line_table_remove(line_table* lt, uint64_t addr)
+{
+    uint64_t i = home(lt, addr);
+    while (lt->states[i] != 0 && lt->keys[i] != addr)
+        i = (i + 1) & lt->mask;
+
+    if (lt->states[i] == 0)
+        return;
+
+    // Backward shift: pull later entries of the run into the hole when the
+    //   hole lies between their home slot and where they sit, so no
+    //   tombstones are needed
+    for (uint64_t j = (i + 1) & lt->mask; lt->states[j] != 0;
+         j = (j + 1) & lt->mask)
+    {
+        uint64_t h = home(lt, lt->keys[j]);
+        if (((j - h) & lt->mask) >= ((j - i) & lt->mask))
+        {
+            lt->keys[i] = lt->keys[j];
+            lt->states[i] = lt->states[j];
+            i = j;
+        }
+    }
+
+    lt->states[i] = 0;
+    lt->count--;
+}
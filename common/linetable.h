@@ -0,0 +1,29 @@
+#ifndef LINETABLE_H
+#define LINETABLE_H
+
+#include <stdint.h>
+
+// Hash table from line address to a one byte state.  Open addressing with
+//   linear probing, keys and states in two flat arrays that only grow by
+//   doubling, so inserts do not allocate.  State 0 marks an empty slot and
+//   is what lookups of an absent line return.
+typedef struct _line_table {
+    uint64_t* keys;
+    uint8_t* states;
+    uint64_t mask;   // slots - 1, slots is a power of two
+    uint64_t count;
+    int shift;       // 64 - log2(slots), for the multiplicative hash
+} line_table;
+
+line_table* line_table_new(void);
+void line_table_free(line_table* lt);
+
+// State of addr, 0 if absent
+uint8_t line_table_find(line_table* lt, uint64_t addr);
+
+// Insert or update addr; a state of 0 removes it
+void line_table_set(line_table* lt, uint64_t addr, uint8_t state);
+
+void line_table_remove(line_table* lt, uint64_t addr);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef DIR_INTERNAL_H
+#define DIR_INTERNAL_H
+
+#include <interconnect.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+extern interconn* inter_sim;
+
+// State of a line in one processor's cache
+typedef enum _cache_state
+{
+    INVALID = 0,
+    SHARE,
+    EXCLUSIVE,
+    MODIFIED,
+    INVALID_SHARED_EXCLUSIVE, // GetS sent to the home node
+    INVALID_MODIFIED,         // GetM sent to the home node
+    SHARED_MODIFIED           // GetM sent, the shared copy is still readable
+} cache_state;
+
+// State of a line at its home node
+typedef enum _dir_state
+{
+    DIR_INVALID = 0, // no cached copies, memory is up to date
+    DIR_SHARED,      // clean copies at the sharers
+    DIR_EXCLUSIVE    // one owner in E or M
+} dir_state;
+
+// Messages are the bus_req_types of the interconnect:
+//   BUSRD       GetS to the home, or the home forwarding it to the owner
+//   BUSWR       GetM to the home, or the home invalidating a copy
+//   BUSUPGR     GetM from a sharer, which needs no data if it still has a copy
+//   DATA        exclusive data from the home, or the owner's copy to the home
+//   SHARED_DATA shared data from the home
+//   ACK         a copy was dropped, or there was none to send; from the
+//               home, an upgrade granted
+//   BUSWB       dirty data written back to the home on eviction
+//   MEMORY      the home fetching the line from memory
+
+typedef struct _dirStats {
+    uint64_t getS;
+    uint64_t getM;
+    uint64_t upgrades;      // GetMs granted without data
+    uint64_t queued;        // requests that waited for a busy line
+    uint64_t forwards;      // requests forwarded to an owner
+    uint64_t invalidations; // invalidations sent to sharers
+    uint64_t broadcasts;    // invalidations sent to every node on overflow
+    uint64_t memoryFetches;
+    uint64_t writebacks;
+    uint64_t messages;      // sent on the interconnect
+    uint64_t localMessages; // between a node and itself
+} dirStats;
+
+extern dirStats stats;
+extern int lineBits;
+extern int dirPointers;
+
+// Home node of the line holding addr
+int homeNode(uint64_t addr);
+
+// Send a message between nodes; a node sending to itself bypasses the
+//   interconnect.  toHome selects the role the message is for at dest.
+void dirSend(bus_req_type type, uint64_t addr, int src, int dest, bool toHome);
+
+void homeInit(void);
+void homeDestroy(void);
+void homeReceive(bus_req_type type, uint64_t addr, int home, int src);
+
+#endif
@@ -0,0 +1,484 @@
+#include <coherence.h>
+#include <trace.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "dir_internal.h"
+
+#include "stree.h"
+
+//
+// Directory-based MESI.  Each line has a home node, chosen by interleaving
+//   line addresses across the processors, that tracks which caches hold it.
+//   Requests go to the home alone, which forwards them to the owner or
+//   invalidates the sharers one message at a time, so traffic grows with
+//   the number of sharers rather than the number of processors.  Needs a
+//   point-to-point topology (interconnectProj -t 1, 2 or 3).
+//
+
+typedef void (*cacheCallbackFunc)(int, int, int64_t);
+
+// A line in a processor's cache, kept while it is valid or being filled
+typedef struct _cacheLine {
+    cache_state state;
+    int readers;   // permission requests waiting for the fill
+    int writers;
+    bool evicted;  // the cache dropped the line before the fill arrived
+} cacheLine;
+
+// Message a node sent itself, delivered on the next tick
+typedef struct _localMsg {
+    bus_req_type type;
+    uint64_t addr;
+    int node;
+    bool toHome;
+    struct _localMsg* next;
+} localMsg;
+
+tree_t** cacheLines = NULL;
+int processorCount = 1;
+int CADSS_VERBOSE = 0;
+int lineBits = 6;
+int dirPointers = 0;
+dirStats stats;
+coher* self = NULL;
+interconn* inter_sim = NULL;
+cacheCallbackFunc cacheCallback = NULL;
+localMsg* localHead = NULL;
+localMsg* localTail = NULL;
+
+uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum, int srcProc, int msgNum);
+uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum);
+uint8_t invlReq(uint64_t addr, int processorNum);
+void registerCacheInterface(void (*callback)(int, int, int64_t));
+
+coher* init(coher_sim_args* csa)
+{
+    int op;
+
+    while ((op = getopt(csa->arg_count, csa->arg_list, "b:l:")) != -1)
+    {
+        switch (op)
+        {
+            // Line size in bits, lines are interleaved across the homes
+            case 'b':
+                lineBits = atoi(optarg);
+                break;
+
+            // Limited pointer directory with this many sharer pointers,
+            //   0 keeps a full map
+            case 'l':
+                dirPointers = atoi(optarg);
+                break;
+        }
+    }
+
+    if (processorCount < 1 || processorCount > 256)
+    {
+        fprintf(stderr,
+                "Error: processorCount outside valid range - %d specified\n",
+                processorCount);
+        return NULL;
+    }
+    if (lineBits < 0 || lineBits > 32 || dirPointers < 0)
+    {
+        fprintf(stderr, "Error: invalid directory settings\n");
+        return NULL;
+    }
+    // On a bus every request is snooped by all caches, so messages never
+    //   reach just their home
+    if (processorCount > 1 && !csa->inter->pointToPoint)
+    {
+        fprintf(stderr, "Error: the directory needs a point-to-point "
+                        "interconnect (interconnectProj -t 1, 2 or 3)\n");
+        return NULL;
+    }
+
+    cacheLines = malloc(sizeof(tree_t*) * processorCount);
+    for (int i = 0; i < processorCount; i++)
+    {
+        cacheLines[i] = tree_new();
+    }
+    homeInit();
+
+    inter_sim = csa->inter;
+
+    self = malloc(sizeof(coher));
+    self->si.tick = tick;
+    self->si.finish = finish;
+    self->si.destroy = destroy;
+    self->permReq = permReq;
+    self->busReq = busReq;
+    self->invlReq = invlReq;
+    self->registerCacheInterface = registerCacheInterface;
+
+    inter_sim->registerCoher(self);
+
+    return self;
+}
+
+void registerCacheInterface(void (*callback)(int, int, int64_t))
+{
+    cacheCallback = callback;
+}
+
+int homeNode(uint64_t addr)
+{
+    return (addr >> lineBits) % processorCount;
+}
+
+void dirSend(bus_req_type type, uint64_t addr, int src, int dest, bool toHome)
+{
+    if (CADSS_VERBOSE) {
+        printf("Processor %d sending %d for address %lx to %d\n", src, type,
+               addr, dest);
+    }
+
+    if (src == dest) {
+        localMsg* m = malloc(sizeof(localMsg));
+        m->type = type;
+        m->addr = addr;
+        m->node = dest;
+        m->toHome = toHome;
+        m->next = NULL;
+        if (localTail != NULL) {
+            localTail->next = m;
+        }
+        else {
+            localHead = m;
+        }
+        localTail = m;
+        stats.localMessages++;
+        return;
+    }
+
+    stats.messages++;
+    inter_sim->req(type, addr, src, dest, false, -1);
+}
+
+static cacheLine* findLine(uint64_t addr, int processorNum)
+{
+    return tree_find(cacheLines[processorNum], addr);
+}
+
+static cacheLine* newLine(uint64_t addr, int processorNum, cache_state state)
+{
+    cacheLine* line = calloc(1, sizeof(cacheLine));
+    line->state = state;
+    tree_insert(cacheLines[processorNum], addr, line);
+    return line;
+}
+
+static void dropLine(uint64_t addr, int processorNum)
+{
+    free(tree_remove(cacheLines[processorNum], addr));
+}
+
+static void evictLine(cacheLine* line, uint64_t addr, int processorNum)
+{
+    // Clean copies are dropped silently, the home finds out on its next
+    //   forward or invalidation
+    if (line->state == MODIFIED) {
+        dirSend(BUSWB, addr, processorNum, homeNode(addr), true);
+    }
+    dropLine(addr, processorNum);
+}
+
+// The home's reply to this cache's request has arrived
+static void fill(cacheLine* line, bus_req_type type, uint64_t addr,
+                 int processorNum)
+{
+    switch (line->state)
+    {
+        case INVALID_SHARED_EXCLUSIVE:
+            line->state = (type == DATA) ? EXCLUSIVE : SHARE;
+            break;
+        case INVALID_MODIFIED:
+        case SHARED_MODIFIED:
+            assert(type == DATA);
+            line->state = MODIFIED;
+            break;
+        default:
+            fprintf(stderr, "Fill of %lx at processor %d in state %d\n", addr,
+                    processorNum, line->state);
+            return;
+    }
+
+    for (; line->readers > 0; line->readers--) {
+        cacheCallback(DATA_RECV, processorNum, addr);
+    }
+
+    // Writes that waited on a read fill need the line exclusively
+    if (line->writers > 0) {
+        if (line->state == SHARE) {
+            line->state = SHARED_MODIFIED;
+            dirSend(BUSUPGR, addr, processorNum, homeNode(addr), true);
+            return;
+        }
+        line->state = MODIFIED;
+        for (; line->writers > 0; line->writers--) {
+            cacheCallback(DATA_RECV, processorNum, addr);
+        }
+    }
+
+    if (line->evicted) {
+        evictLine(line, addr, processorNum);
+    }
+}
+
+// A message from the home to this processor's cache
+static void cacheReceive(bus_req_type type, uint64_t addr, int processorNum)
+{
+    cacheLine* line = findLine(addr, processorNum);
+    cache_state state = (line != NULL) ? line->state : INVALID;
+    int home = homeNode(addr);
+
+    switch (type)
+    {
+        // The home forwarding a GetS to the owner
+        case BUSRD:
+            if (state == EXCLUSIVE || state == MODIFIED) {
+                dirSend(DATA, addr, processorNum, home, true);
+                line->state = SHARE;
+            }
+            else {
+                dirSend(ACK, addr, processorNum, home, true);
+            }
+            break;
+
+        // The home taking the line for a writer
+        case BUSWR:
+            if (state == EXCLUSIVE || state == MODIFIED) {
+                dirSend(DATA, addr, processorNum, home, true);
+                dropLine(addr, processorNum);
+                cacheCallback(INVALIDATE, processorNum, addr);
+            }
+            else if (state == SHARE) {
+                dirSend(ACK, addr, processorNum, home, true);
+                dropLine(addr, processorNum);
+                cacheCallback(INVALIDATE, processorNum, addr);
+            }
+            else {
+                // An upgrade that lost the race now needs the data too
+                if (state == SHARED_MODIFIED) {
+                    line->state = INVALID_MODIFIED;
+                }
+                dirSend(ACK, addr, processorNum, home, true);
+            }
+            break;
+
+        case DATA:
+        case SHARED_DATA:
+            assert(line != NULL);
+            fill(line, type, addr, processorNum);
+            break;
+
+        // The home granting an upgrade, the shared copy is now writable
+        case ACK:
+            assert(line != NULL && state == SHARED_MODIFIED);
+            fill(line, DATA, addr, processorNum);
+            break;
+
+        default:
+            fprintf(stderr, "Processor %d: unexpected message %d for %lx\n",
+                    processorNum, type, addr);
+            break;
+    }
+
+    if (CADSS_VERBOSE) {
+        line = findLine(addr, processorNum);
+        printf("Proc %d Snoop Addr %p: %d -> %d via %d\n", processorNum,
+               (void*)addr, state, (line != NULL) ? line->state : INVALID,
+               type);
+    }
+}
+
+static void receive(bus_req_type type, uint64_t addr, int node, int src,
+                    bool toHome)
+{
+    if (toHome) {
+        homeReceive(type, addr, node, src);
+    }
+    else {
+        cacheReceive(type, addr, node);
+    }
+}
+
+uint8_t busReq(bus_req_type reqType, uint64_t addr, int processorNum, int srcProc, int msgNum)
+{
+    if (CADSS_VERBOSE) {
+        printf("Processor %d Bus Req Addr %p via %d from %d\n",
+               processorNum, (void*)addr, reqType, srcProc);
+    }
+
+    // Only the home sends to caches, and caches and memory only send to
+    //   the home, so the sender tells which role the message is for
+    receive(reqType, addr, processorNum, srcProc, srcProc != homeNode(addr));
+
+    return 0;
+}
+
+uint8_t permReq(uint8_t is_read, uint64_t addr, int processorNum)
+{
+    cacheLine* line = findLine(addr, processorNum);
+    cache_state state = (line != NULL) ? line->state : INVALID;
+
+    switch (state)
+    {
+        case INVALID:
+            if (is_read) {
+                line = newLine(addr, processorNum, INVALID_SHARED_EXCLUSIVE);
+                line->readers = 1;
+                dirSend(BUSRD, addr, processorNum, homeNode(addr), true);
+            }
+            else {
+                line = newLine(addr, processorNum, INVALID_MODIFIED);
+                line->writers = 1;
+                dirSend(BUSWR, addr, processorNum, homeNode(addr), true);
+            }
+            return 0;
+
+        case SHARE:
+            if (is_read) {
+                return 1;
+            }
+            line->state = SHARED_MODIFIED;
+            line->writers = 1;
+            dirSend(BUSUPGR, addr, processorNum, homeNode(addr), true);
+            return 0;
+
+        case EXCLUSIVE:
+            if (!is_read) {
+                line->state = MODIFIED;
+            }
+            return 1;
+
+        case MODIFIED:
+            return 1;
+
+        case SHARED_MODIFIED:
+            if (is_read) {
+                return 1;
+            }
+            line->writers++;
+            line->evicted = false;
+            return 0;
+
+        case INVALID_SHARED_EXCLUSIVE:
+        case INVALID_MODIFIED:
+            if (is_read) {
+                line->readers++;
+            }
+            else {
+                line->writers++;
+            }
+            line->evicted = false;
+            return 0;
+    }
+
+    return 0;
+}
+
+uint8_t invlReq(uint64_t addr, int processorNum)
+{
+    cacheLine* line = findLine(addr, processorNum);
+
+    if (line == NULL) {
+        return 0;
+    }
+
+    switch (line->state)
+    {
+        case SHARE:
+        case EXCLUSIVE:
+        case MODIFIED:
+            evictLine(line, addr, processorNum);
+            break;
+
+        // The request is already with the home; drop the line once it fills
+        default:
+            line->evicted = true;
+            break;
+    }
+
+    // Writebacks do not hold up the cache
+    return 0;
+}
+
+int tick()
+{
+    // Deliver the messages nodes sent themselves
+    localMsg* m = localHead;
+    localHead = NULL;
+    localTail = NULL;
+    while (m != NULL) {
+        localMsg* next = m->next;
+        receive(m->type, m->addr, m->node, m->node, m->toHome);
+        free(m);
+        m = next;
+    }
+
+    return inter_sim->si.tick();
+}
+
+int finish(int outFd)
+{
+    char buf[256];
+    int len;
+    uint64_t requests = stats.getS + stats.getM;
+
+    if (dirPointers > 0) {
+        len = snprintf(buf, sizeof(buf),
+                       "Directory - limited pointer (%d), line interleave %d bits\n",
+                       dirPointers, lineBits);
+    }
+    else {
+        len = snprintf(buf, sizeof(buf),
+                       "Directory - full map, line interleave %d bits\n",
+                       lineBits);
+    }
+    (void)!write(outFd, buf, len);
+
+    len = snprintf(buf, sizeof(buf),
+                   "Requests - %lu (GetS %lu, GetM %lu, %lu upgrades without data), waited on a busy line - %lu\n",
+                   requests, stats.getS, stats.getM, stats.upgrades,
+                   stats.queued);
+    (void)!write(outFd, buf, len);
+
+    len = snprintf(buf, sizeof(buf),
+                   "Forwards - %lu, invalidations - %lu (%.2f per GetM, %lu overflow broadcasts)\n",
+                   stats.forwards, stats.invalidations,
+                   stats.getM ? (double)stats.invalidations / stats.getM : 0.0,
+                   stats.broadcasts);
+    (void)!write(outFd, buf, len);
+
+    len = snprintf(buf, sizeof(buf),
+                   "Memory fetches - %lu, writebacks - %lu\n",
+                   stats.memoryFetches, stats.writebacks);
+    (void)!write(outFd, buf, len);
+
+    len = snprintf(buf, sizeof(buf),
+                   "Coherence messages - %lu (%.2f per request), local - %lu\n",
+                   stats.messages,
+                   requests ? (double)stats.messages / requests : 0.0,
+                   stats.localMessages);
+    (void)!write(outFd, buf, len);
+
+    return inter_sim->si.finish(outFd);
+}
+
+int destroy(void)
+{
+    while (localHead != NULL) {
+        localMsg* next = localHead->next;
+        free(localHead);
+        localHead = next;
+    }
+    for (int i = 0; i < processorCount; i++) {
+        tree_free(cacheLines[i], free);
+    }
+    free(cacheLines);
+    homeDestroy();
+    free(self);
+
+    return inter_sim->si.destroy();
+}
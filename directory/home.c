@@ -0,0 +1,335 @@
+#include "dir_internal.h"
+
+#include "stree.h"
+
+// Request waiting at the home for a line that is busy
+typedef struct _dirRequest {
+    bus_req_type type;
+    int requester;
+    struct _dirRequest* next;
+} dirRequest;
+
+typedef struct _dirEntry {
+    dir_state state;
+    int owner;
+    int pointers;        // limited pointer: sharers recorded in sharer[]
+    bool overflow;       // limited pointer: more sharers than pointers
+
+    // The transaction in progress.  The home blocks on it, later requests
+    //   for the line queue until it completes.
+    bool busy;
+    bus_req_type type;
+    int requester;
+    int replies;         // forward replies and invalidation acks outstanding
+    bool fetching;       // memory fetch outstanding
+    bool haveData;
+    bool ownerKept;      // a forwarded GetS found the owner's copy
+    dirRequest* waitHead;
+    dirRequest* waitTail;
+
+    uint64_t sharer[];   // full map bits, or limited pointer node ids
+} dirEntry;
+
+// Entries of every home, lines are only ever in their home's range
+static tree_t* entries = NULL;
+static int sharerWords = 0;
+static int* nodeList = NULL;
+
+void homeInit(void)
+{
+    entries = tree_new();
+    sharerWords = (dirPointers > 0) ? dirPointers : (processorCount + 63) / 64;
+    nodeList = malloc(sizeof(int) * processorCount);
+}
+
+void homeDestroy(void)
+{
+    tree_free(entries, free);
+    free(nodeList);
+}
+
+static dirEntry* findEntry(uint64_t addr)
+{
+    dirEntry* e = tree_find(entries, addr);
+    if (e == NULL) {
+        e = calloc(1, sizeof(dirEntry) + sizeof(uint64_t) * sharerWords);
+        e->state = DIR_INVALID;
+        e->owner = -1;
+        tree_insert(entries, addr, e);
+    }
+    return e;
+}
+
+static void sharersClear(dirEntry* e)
+{
+    memset(e->sharer, 0, sizeof(uint64_t) * sharerWords);
+    e->pointers = 0;
+    e->overflow = false;
+}
+
+static void sharersAdd(dirEntry* e, int node)
+{
+    if (dirPointers == 0) {
+        e->sharer[node / 64] |= 1ull << (node % 64);
+        return;
+    }
+
+    for (int i = 0; i < e->pointers; i++) {
+        if (e->sharer[i] == (uint64_t)node) {
+            return;
+        }
+    }
+    if (e->pointers < dirPointers) {
+        e->sharer[e->pointers++] = node;
+    }
+    else {
+        e->overflow = true;
+    }
+}
+
+// Whether node is recorded as a sharer, rather than only possibly one
+static bool sharersHas(dirEntry* e, int node)
+{
+    if (dirPointers == 0) {
+        return (e->sharer[node / 64] >> (node % 64)) & 1;
+    }
+
+    for (int i = 0; i < e->pointers; i++) {
+        if (e->sharer[i] == (uint64_t)node) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fill nodeList with every node that may hold the line
+static int sharersList(dirEntry* e)
+{
+    int count = 0;
+
+    if (e->overflow) {
+        for (int i = 0; i < processorCount; i++) {
+            nodeList[count++] = i;
+        }
+    }
+    else if (dirPointers == 0) {
+        for (int i = 0; i < processorCount; i++) {
+            if (e->sharer[i / 64] & (1ull << (i % 64))) {
+                nodeList[count++] = i;
+            }
+        }
+    }
+    else {
+        for (int i = 0; i < e->pointers; i++) {
+            nodeList[count++] = e->sharer[i];
+        }
+    }
+
+    return count;
+}
+
+static void fetchMemory(dirEntry* e, uint64_t addr, int home)
+{
+    e->fetching = true;
+    stats.memoryFetches++;
+    dirSend(MEMORY, addr, home, processorCount, true);
+}
+
+static void invalidateSharers(dirEntry* e, uint64_t addr, int home)
+{
+    int count = sharersList(e);
+
+    if (e->overflow) {
+        stats.broadcasts++;
+    }
+    for (int i = 0; i < count; i++) {
+        if (nodeList[i] == e->requester) {
+            continue;
+        }
+        e->replies++;
+        stats.invalidations++;
+        dirSend(BUSWR, addr, home, nodeList[i], false);
+    }
+}
+
+static void finishIfDone(dirEntry* e, uint64_t addr, int home);
+
+static void startRequest(dirEntry* e, uint64_t addr, int home,
+                         bus_req_type type, int requester)
+{
+    // An upgrade whose copy was taken by an earlier writer needs the data
+    if (type == BUSUPGR &&
+        !(e->state == DIR_SHARED && sharersHas(e, requester))) {
+        type = BUSWR;
+    }
+
+    e->busy = true;
+    e->type = type;
+    e->requester = requester;
+    e->replies = 0;
+    e->fetching = false;
+    e->haveData = false;
+    e->ownerKept = false;
+
+    switch (e->state)
+    {
+        case DIR_INVALID:
+            fetchMemory(e, addr, home);
+            break;
+
+        case DIR_SHARED:
+            // Memory is up to date while the line is shared
+            if (type == BUSWR || type == BUSUPGR) {
+                invalidateSharers(e, addr, home);
+            }
+            if (type == BUSUPGR) {
+                e->haveData = true;
+                finishIfDone(e, addr, home);
+            }
+            else {
+                fetchMemory(e, addr, home);
+            }
+            break;
+
+        case DIR_EXCLUSIVE:
+            if (e->owner == requester) {
+                // The owner dropped a clean copy and wants it back
+                fetchMemory(e, addr, home);
+            }
+            else {
+                e->replies++;
+                stats.forwards++;
+                dirSend(type, addr, home, e->owner, false);
+            }
+            break;
+    }
+}
+
+static void finishIfDone(dirEntry* e, uint64_t addr, int home)
+{
+    if (e->replies > 0 || e->fetching) {
+        return;
+    }
+
+    // The owner no longer had the line, so memory has it
+    if (!e->haveData) {
+        fetchMemory(e, addr, home);
+        return;
+    }
+
+    int requester = e->requester;
+    if (e->type == BUSRD && e->state == DIR_EXCLUSIVE && e->ownerKept) {
+        int owner = e->owner;
+        sharersClear(e);
+        sharersAdd(e, owner);
+        sharersAdd(e, requester);
+        e->state = DIR_SHARED;
+        e->owner = -1;
+        dirSend(SHARED_DATA, addr, home, requester, false);
+    }
+    else if (e->type == BUSRD && e->state == DIR_SHARED) {
+        sharersAdd(e, requester);
+        dirSend(SHARED_DATA, addr, home, requester, false);
+    }
+    else if (e->type == BUSUPGR) {
+        // The requester kept its copy, so the grant carries no data
+        sharersClear(e);
+        e->state = DIR_EXCLUSIVE;
+        e->owner = requester;
+        stats.upgrades++;
+        dirSend(ACK, addr, home, requester, false);
+    }
+    else {
+        // Writes, and reads of a line no one else holds, take it exclusively
+        sharersClear(e);
+        e->state = DIR_EXCLUSIVE;
+        e->owner = requester;
+        dirSend(DATA, addr, home, requester, false);
+    }
+    e->busy = false;
+
+    dirRequest* next = e->waitHead;
+    if (next != NULL) {
+        e->waitHead = next->next;
+        if (e->waitHead == NULL) {
+            e->waitTail = NULL;
+        }
+        startRequest(e, addr, home, next->type, next->requester);
+        free(next);
+    }
+}
+
+void homeReceive(bus_req_type type, uint64_t addr, int home, int src)
+{
+    dirEntry* e = findEntry(addr);
+
+    switch (type)
+    {
+        case BUSRD:
+        case BUSWR:
+        case BUSUPGR:
+            if (type == BUSRD) {
+                stats.getS++;
+            }
+            else {
+                stats.getM++;
+            }
+
+            if (e->busy) {
+                dirRequest* r = malloc(sizeof(dirRequest));
+                r->type = type;
+                r->requester = src;
+                r->next = NULL;
+                if (e->waitTail != NULL) {
+                    e->waitTail->next = r;
+                }
+                else {
+                    e->waitHead = r;
+                }
+                e->waitTail = r;
+                stats.queued++;
+            }
+            else {
+                startRequest(e, addr, home, type, src);
+            }
+            break;
+
+        case DATA:
+            assert(e->busy);
+            if (src < 0 || src == processorCount) {
+                assert(e->fetching);
+                e->fetching = false;
+            }
+            else {
+                // The owner's copy, in reply to a forward
+                assert(e->replies > 0);
+                e->replies--;
+                e->ownerKept = (e->type == BUSRD);
+            }
+            e->haveData = true;
+            finishIfDone(e, addr, home);
+            break;
+
+        case ACK:
+            assert(e->busy && e->replies > 0);
+            e->replies--;
+            finishIfDone(e, addr, home);
+            break;
+
+        case BUSWB:
+            stats.writebacks++;
+            // While busy, the transaction's forward to the old owner
+            //   finds no copy and the data is read back from memory
+            if (!e->busy && (e->state == DIR_INVALID ||
+                             (e->state == DIR_EXCLUSIVE && e->owner == src))) {
+                tree_remove(entries, addr);
+                free(e);
+            }
+            break;
+
+        default:
+            fprintf(stderr, "Home %d: unexpected message %d for %lx from %d\n",
+                    home, type, addr, src);
+            break;
+    }
+}
@@ -100,13 +100,15 @@ static void parseSettings()
             {
                 inComment = 1;
                 pos += 2;
+                continue;
             }
             else if (configContents[pos + 1] == '*')
             {
                 inMultiComment = 1;
                 pos += 2;
+                continue;
             }
-            continue;
+            // Otherwise an argument, such as an absolute path
         }
         
         while ( pos < length && isspace(configContents[pos]))
@@ -212,7 +214,8 @@ static void parseSettings()
             configContents[pos] = '\0';
             char* arg = strdup(&configContents[argPosStart]);
             
-            if (current->argCount == argSize)
+            // Leave room for the NULL terminator after the new argument
+            if (current->argCount + 1 == argSize)
             {
                 argSize += ARG_LIST_CHUNK_SIZE;
                 current->argList = realloc(current->argList, sizeof(char*) * argSize);
@@ -388,7 +388,11 @@ int main(int argc, char** argv)
     osa.arg_list = arg;
     osa.inter = inter_sim;
     optind = 1;
-    if ((coher_sim = osim->init(&osa)) == NULL) {}
+    if ((coher_sim = osim->init(&osa)) == NULL)
+    {
+        printf("Failed to initialize coherence!\n");
+        return 1;
+    }
 
     optind = 1;
     arg = getSettings("cache", &argCount);
@@ -398,6 +402,7 @@ int main(int argc, char** argv)
     csa.arg_count = argCount;
     csa.arg_list = arg;
     csa.coherComp = coher_sim;
+    csa.accessReq = dlsym(osim->handle, "accessReq");
     if ((cache_sim = csim->init(&csa)) == NULL) {}
 
     optind = 1;
@@ -407,7 +412,11 @@ int main(int argc, char** argv)
     branch_sim_args bsa;
     bsa.arg_count = argCount;
     bsa.arg_list = arg;
-    if ((branch_sim = bsim->init(&bsa)) == NULL) {}
+    if ((branch_sim = bsim->init(&bsa)) == NULL)
+    {
+        printf("Failed to initialize branch predictor!\n");
+        return 1;
+    }
 
     optind = 1;
     arg = getSettings("processor", &argCount);
@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# filter.sh ENGINE STRESSGEN - run each snooping protocol on the bus with a
+#   snoop filter too small for the trace's lines, so entries are evicted
+#   and lines go untracked, and check that the coherence invariants hold.
+#   Run from the build directory, where the components are found as
+#   <name>/lib<name>.so.
+#
+
+ENGINE=$1
+STRESSGEN=$2
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+"$STRESSGEN" -o "$DIR" -n 4 -k 3000 > /dev/null || exit 1
+
+status=0
+for scheme in 0 1 2 3 4 5
+do
+    for filter in "-f 2 -w 2" "-f 1 -w 1"
+    do
+        printf -- "__processor -f 4 -d 2 -m 2 -j 3 -k 2 -c 2\n__cache\n__branch\n__coherence -s %s -v\n__interconnect -t 0 %s\n__memory\n" \
+            "$scheme" "$filter" > "$DIR/test.config"
+        "$ENGINE" -n 4 -s "$DIR/test.config" -t "$DIR" -p simProcessor \
+            -c simpleCache -b branchSim -i interconnectProj \
+            > "$DIR/out" 2>&1
+
+        if ! grep -q "^Invariant checks - [0-9]*, violations - 0$" \
+                 "$DIR/out"
+        then
+            echo "Failed with -s $scheme $filter:"
+            grep -E "violation|Assertion" "$DIR/out" | head -5
+            status=1
+        fi
+    done
+done
+exit $status
@@ -4,6 +4,7 @@
 #include <memory.h>
 #include <interconnect.h>
 #include <math.h>
+#include <linetable.h>
 
 typedef enum _bus_req_state
 {
@@ -32,9 +33,20 @@ typedef struct _bus_req {
     int numAcks;
 } bus_req;
 
+// Ring buffer of queued requests.  It doubles when full, which only
+//   happens while the simulation warms up.
+typedef struct _req_queue {
+    bus_req** slots;
+    int head;
+    int count;
+    int capacity;       // power of two, 0 until first used
+} req_queue;
+
+#define QUEUE_SLOTS 16
+
 bus_req* pendingRequest = NULL;
 bus_req** activeRequests = NULL;
-bus_req** queuedRequests = NULL;
+req_queue* queuedRequests = NULL;
 coher* coherComp;
 memory* memComp;
 interconn* self = NULL;
@@ -54,7 +66,9 @@ static const char* req_state_map[] = {
 static const char* req_type_map[]
     = {[NO_REQ] = "None", [BUSRD] = "BusRd",   [BUSWR] = "BusRdX",
        [DATA] = "Data",   [SHARED] = "Shared", [MEMORY] = "Memory", [ACK] = "Ack",
-       [SHARED_DATA] = "Shared Data"};
+       [SHARED_DATA] = "Shared Data", [BUSWB] = "Writeback",
+       [BUSUPGR] = "BusUpgr", [BUSUPD] = "BusUpd",
+       [BUSINV] = "BusInv"};
 
 const int CACHE_DELAY = 1;
 const int CACHE_TRANSFER = 10;
@@ -67,11 +81,15 @@ void printInterconnState(void);
 void interconnNotifyState(void);
 void printInterconnForLineState(void);
 void printInterconnForRingState(void);
+static void buildRoutes(void);
+static void filterCountRequest(uint64_t addr, int delta);
 
 // Topology: 0 = bus, 1 = line, 2 = ring, 3 = mesh, 4 = crossbar
 int8_t t = 0;
 int64_t* perProcMsgCount;
 int64_t globalMsgCount = 0;
+int64_t msgsSent = 0;       // messages injected on point-to-point topologies
+int64_t linkTransfers = 0;  // hops taken by those messages
 
 
 // Link representing a connection between two nodes
@@ -80,8 +98,8 @@ typedef struct _link {
     int proc2;          // proc on link with higher ID
     int countDown;      // num ticks before reuse
     bus_req* pendingReq; // current request being sent on link
-    bus_req* linkQueue1; // queue of requests waiting to use link, one for each processor
-    bus_req* linkQueue2;
+    req_queue linkQueue1; // queue of requests waiting to use link, one for each processor
+    req_queue linkQueue2;
     bool p1Sent;        // used to alternate processor sending if both want to
 } link;
 
@@ -89,6 +107,20 @@ typedef struct _link {
 // Metadata needed for non-bus topologies
 link** links;            // array of links in the network (index is link)
 
+// Links at each node of a point-to-point topology, built once at init
+typedef struct _node_links {
+    int count;
+    link* adj[4];       // in link order
+    link* right;        // toward higher IDs in the row, line or ring
+    link* left;
+    link* down;         // mesh columns
+    link* up;
+} node_links;
+
+node_links* nodeLinks = NULL;
+link** routes = NULL;    // next link from each node to each destination
+int routeNodes = 0;      // processors and memory
+
 /**
  * 2D array of IDs of last msgs received
  * First index by processor receiving messages, then by processor who sent
@@ -100,7 +132,7 @@ link** links;            // array of links in the network (index is link)
  * Know all have received when broadcast reaches original sender
  */
 int** last_msgs;
-bus_req* memoryRequests = NULL;
+req_queue memoryRequests;
 int memoryCountdown = 0;
 
 // used in mesh
@@ -114,103 +146,183 @@ int memReqsReachedMemRing = 0;
 int memReqsMade = 0;
 int memResponses = 0;
 int memRecvs = 0;
-
-// Helper methods for per-processor request queues.
-static void enqBusRequest(bus_req* pr, int procNum)
+int64_t memWritebacks = 0;
+int64_t upgrades = 0;         // BusUpgr requests completed
+int64_t upgradesNoData = 0;   // of those, granted without a data transfer
+int64_t updates = 0;          // BusUpd requests completed
+
+// Inclusive snoop filter for the bus.  Each entry tracks a line that may be
+//   cached and a bitmask of the processors that may hold it, so a snoop goes
+//   only to those processors and a line with no entry is held by no one.
+//   Evicting an entry invalidates its line in every cache that may hold it.
+//   A line with requests outstanding is never evicted, and when a set has
+//   no other entry to evict the line goes untracked: it is kept in
+//   untrackedLines until it gets an entry again, which starts with every
+//   processor as a possible holder.
+#define FILTER_WORDS 4 // sharer bits for up to 256 processors
+
+typedef struct _filter_entry {
+    uint64_t addr;
+    uint64_t lastUse;
+    bool valid;
+    int requests; // bus requests outstanding for the line
+    uint64_t sharers[FILTER_WORDS];
+} filter_entry;
+
+filter_entry* snoopFilter = NULL;
+line_table* untrackedLines = NULL;
+int filterLogSets = 0; // 0 disables the filter
+int filterWays = 8;
+uint64_t filterClock = 0;
+
+int64_t filterHits = 0;
+int64_t filterMisses = 0;
+int64_t filterEvictions = 0;
+int64_t backInvalidations = 0;
+int64_t filterSpills = 0;
+int64_t snoopsSent = 0;
+int64_t snoopsFiltered = 0;
+
+// Requests come from slabs of POOL_SLAB and return to a free list, so once
+//   the slabs cover the requests in flight none are allocated
+#define POOL_SLAB 256
+
+static bus_req* freeReqs = NULL;
+static bus_req** slabs = NULL;
+static int slabCount = 0;
+
+static bus_req* reqAlloc(void)
 {
-    bus_req* iter;
-
-    // No items in the queue.
-    if (!queuedRequests[procNum])
+    if (freeReqs == NULL)
     {
-        queuedRequests[procNum] = pr;
-        return;
+        bus_req* slab = malloc(sizeof(bus_req) * POOL_SLAB);
+        slabs = realloc(slabs, sizeof(bus_req*) * (slabCount + 1));
+        if (slab == NULL || slabs == NULL)
+        {
+            fprintf(stderr, "ERROR.  Couldn't allocate interconnect requests\n");
+            exit(1);
+        }
+        slabs[slabCount++] = slab;
+        for (int i = 0; i < POOL_SLAB; i++)
+        {
+            slab[i].next = freeReqs;
+            freeReqs = &slab[i];
+        }
     }
 
-    // Add request to the end of the queue.
-    iter = queuedRequests[procNum];
-    while (iter->next)
-    {
-        iter = iter->next;
-    }
+    bus_req* br = freeReqs;
+    freeReqs = br->next;
+    memset(br, 0, sizeof(bus_req));
+    return br;
+}
 
-    pr->next = NULL;
-    iter->next = pr;
+static bus_req* reqCopy(bus_req* br)
+{
+    bus_req* copy = reqAlloc();
+    *copy = *br;
+    copy->next = NULL;
+    return copy;
 }
 
-static bus_req* deqBusRequest(int procNum)
+static void reqRelease(bus_req* br)
 {
-    bus_req* ret;
+    br->next = freeReqs;
+    freeReqs = br;
+}
 
-    ret = queuedRequests[procNum];
+static void queueInit(req_queue* q)
+{
+    q->slots = malloc(sizeof(bus_req*) * QUEUE_SLOTS);
+    q->head = 0;
+    q->count = 0;
+    q->capacity = QUEUE_SLOTS;
+}
 
-    // Move the head to the next request (if there is one).
-    if (ret)
+static void queuePush(req_queue* q, bus_req* br)
+{
+    if (q->count == q->capacity)
     {
-        queuedRequests[procNum] = ret->next;
+        // Unwrap into a buffer twice the size
+        int capacity = (q->capacity == 0) ? QUEUE_SLOTS : q->capacity * 2;
+        bus_req** slots = malloc(sizeof(bus_req*) * capacity);
+        for (int i = 0; i < q->count; i++)
+        {
+            slots[i] = q->slots[(q->head + i) & (q->capacity - 1)];
+        }
+        free(q->slots);
+        q->slots = slots;
+        q->head = 0;
+        q->capacity = capacity;
     }
 
-    return ret;
+    q->slots[(q->head + q->count) & (q->capacity - 1)] = br;
+    q->count++;
 }
 
-static int busRequestQueueSize(int procNum)
+static bus_req* queuePop(req_queue* q)
 {
-    int count = 0;
-    bus_req* iter;
-
-    if (!queuedRequests[procNum])
+    if (q->count == 0)
     {
-        return 0;
+        return NULL;
     }
 
-    iter = queuedRequests[procNum];
-    while (iter)
-    {
-        iter = iter->next;
-        count++;
-    }
+    bus_req* ret = q->slots[q->head];
+    q->head = (q->head + 1) & (q->capacity - 1);
+    q->count--;
+    return ret;
+}
+
+// The i-th request from the head
+static bus_req* queueAt(req_queue* q, int i)
+{
+    return q->slots[(q->head + i) & (q->capacity - 1)];
+}
 
-    return count;
+static void queueFree(req_queue* q)
+{
+    free(q->slots);
+    q->slots = NULL;
+    q->count = q->capacity = 0;
 }
 
-//helpers for link queues
-static void enqLinkRequest(bus_req* r, link* lnk)
+// Helper methods for per-processor request queues.
+static void enqBusRequest(bus_req* pr, int procNum)
+{
+    queuePush(&queuedRequests[procNum], pr);
+}
+
+static bus_req* deqBusRequest(int procNum)
+{
+    return queuePop(&queuedRequests[procNum]);
+}
+
+static int busRequestQueueSize(int procNum)
+{
+    return queuedRequests[procNum].count;
+}
+
+//helpers for link queues, a queued request belongs to the link until it
+//  is sent
+static void enqLinkRequest(bus_req* br, link* lnk)
 {
-    bus_req* br = malloc(sizeof(bus_req));
-    memcpy(br, r, sizeof(bus_req));
     if (CADSS_VERBOSE) {
         printf("Enqueuing request with ID %d from proc %d (created by proc %d) of type %s on link between proc %d and proc %d\n",
                br->msgNum, br->procNum, br->pSrc, req_type_map[br->brt], lnk->proc1, lnk->proc2);
     } 
-    bus_req* iter;
     int procNum = br->procNum;
     if (procNum != lnk->proc1 && procNum != lnk->proc2) {
         printf("Error: trying to enqueue request from proc %d on link between %d and %d\n",
                procNum, lnk->proc1, lnk->proc2);
+        reqRelease(br);
         return;
     }
+    br->next = NULL;
     if (procNum == lnk->proc1) {
-        if (lnk->linkQueue1 == NULL) {
-            lnk->linkQueue1 = br;
-            return;
-        }
-        iter = lnk->linkQueue1;
+        queuePush(&lnk->linkQueue1, br);
     }
     else {
-        if (lnk->linkQueue2 == NULL) {
-            lnk->linkQueue2 = br;
-            return;
-        }
-        iter = lnk->linkQueue2;
+        queuePush(&lnk->linkQueue2, br);
     }
-
-    while (iter->next)
-    {
-        iter = iter->next;
-    }
-
-    br->next = NULL;
-    iter->next = br;
 }
 
 static bus_req* deqLinkRequest(link* lnk)
@@ -218,91 +330,59 @@ static bus_req* deqLinkRequest(link* lnk)
     bus_req* ret;
     if (lnk->p1Sent) {
         //last time proc1 sent, so now proc2 gets to send if it has something
-        if (lnk->linkQueue2 == NULL) {
+        if (lnk->linkQueue2.count == 0) {
             //nothing to send, so let proc1 send again
             lnk->p1Sent = true;
-            ret = lnk->linkQueue1;
-            if (ret)
-            {
-                lnk->linkQueue1 = ret->next;
-            }
+            ret = queuePop(&lnk->linkQueue1);
         }
         else {
             //proc2 gets to send
             lnk->p1Sent = false;
-            ret = lnk->linkQueue2;
-            if (ret)
-            {
-                lnk->linkQueue2 = ret->next;
-            }
+            ret = queuePop(&lnk->linkQueue2);
         }
     }
     else {
         //last time proc2 sent, so now proc1 gets to send if it has something
-        if (lnk->linkQueue1 == NULL) {
+        if (lnk->linkQueue1.count == 0) {
             //nothing to send, so let proc2 send again
             lnk->p1Sent = false;
-            ret = lnk->linkQueue2;
-            if (ret)
-            {
-                lnk->linkQueue2 = ret->next;
-            }
+            ret = queuePop(&lnk->linkQueue2);
         }
         else {
             //proc1 gets to send
             lnk->p1Sent = true;
-            ret = lnk->linkQueue1;
-            if (ret)
-            {
-                lnk->linkQueue1 = ret->next;
-            }
+            ret = queuePop(&lnk->linkQueue1);
         }
     }
-    ret->next = NULL;
     return ret;
 }
 
 static int linkRequestQueueSize(link* lnk)
 {
-    int count = 0;
-    bus_req* iter;
-
-    if (!lnk->linkQueue1 && !lnk->linkQueue2)
-    {
-        // if (CADSS_VERBOSE) {
-        //     printf("Link between proc %d and proc %d has 0 queued requests\n",
-        //            lnk->proc1, lnk->proc2);
-        // }
-        return 0;
-    }
-
-    iter = lnk->linkQueue1;
-    while (iter)
-    {
-        iter = iter->next;
-        count++;
-    }
-    iter = lnk->linkQueue2;
-    while (iter)
-    {
-        iter = iter->next;
-        count++;
-    }
-
-    return count;
+    return lnk->linkQueue1.count + lnk->linkQueue2.count;
 }
 
 interconn* init(inter_sim_args* isa)
 {
     int op;
 
-    while ((op = getopt(isa->arg_count, isa->arg_list, "t:")) != -1)
+    while ((op = getopt(isa->arg_count, isa->arg_list, "t:f:w:")) != -1)
     {
         switch (op)
         {
             // Topology
             case 't':
                 t = atoi(optarg);
+                break;
+
+            // Snoop filter sets (log2) and ways, bus only
+            case 'f':
+                filterLogSets = atoi(optarg);
+                break;
+
+            case 'w':
+                filterWays = atoi(optarg);
+                break;
 
             default:
                 break;
@@ -310,10 +390,22 @@ interconn* init(inter_sim_args* isa)
     }
 
     if (t == 0 || processorCount == 1) {
-        queuedRequests = malloc(sizeof(bus_req*) * processorCount);
+        queuedRequests = malloc(sizeof(req_queue) * processorCount);
         for (int i = 0; i < processorCount; i++)
         {
-            queuedRequests[i] = NULL;
+            queueInit(&queuedRequests[i]);
+        }
+
+        if (filterLogSets > 0 && processorCount > 1) {
+            if (processorCount > 64 * FILTER_WORDS || filterWays < 1) {
+                fprintf(stderr, "Snoop filter disabled: %d processors, %d "
+                        "ways\n", processorCount, filterWays);
+            }
+            else {
+                snoopFilter = calloc((1ull << filterLogSets) * filterWays,
+                                     sizeof(filter_entry));
+                untrackedLines = line_table_new();
+            }
         }
     }
     if (t == 1 && processorCount > 1) {
@@ -325,18 +417,18 @@ interconn* init(inter_sim_args* isa)
             links[i]->proc2 = i+1;
             links[i]->countDown = 0;
             links[i]->pendingReq = NULL;
-            links[i]->linkQueue1 = NULL;
-            links[i]->linkQueue2 = NULL;
+            queueInit(&links[i]->linkQueue1);
+            queueInit(&links[i]->linkQueue2);
             links[i]->p1Sent = false;
         }
         // no live messages yet, so each list is NULL
-        perProcMsgCount = calloc(sizeof(int64_t), processorCount);
+        perProcMsgCount = calloc(sizeof(int64_t), processorCount + 1);
         activeRequests = calloc(sizeof(bus_req*), processorCount);
         globalMsgCount = 0;
     }
     if (t == 2 && processorCount > 1) {
         //n links for the ring topology (plus 1 because of memory)
-        links = malloc(sizeof(link*) * processorCount);
+        links = malloc(sizeof(link*) * (processorCount + 1));
         for (int i = 0; i < processorCount + 1; i++) {
             links[i] = malloc(sizeof(link));
             links[i]->proc1 = i;
@@ -348,12 +440,12 @@ interconn* init(inter_sim_args* isa)
             }
             links[i]->countDown = 0;
             links[i]->pendingReq = NULL;
-            links[i]->linkQueue1 = NULL;
-            links[i]->linkQueue2 = NULL;
-            links[i]->p1Sent - false;
+            queueInit(&links[i]->linkQueue1);
+            queueInit(&links[i]->linkQueue2);
+            links[i]->p1Sent = false;
         }
         // no live messages yet, so each list is NULL
-        perProcMsgCount = calloc(sizeof(int64_t), processorCount);
+        perProcMsgCount = calloc(sizeof(int64_t), processorCount + 1);
         activeRequests = calloc(sizeof(bus_req*), processorCount);
         globalMsgCount = 0;
         // last_msg numbers all 0 for each node, and memory
@@ -389,9 +481,9 @@ interconn* init(inter_sim_args* isa)
             }
             links[i]->countDown = 0;
             links[i]->pendingReq = NULL;
-            links[i]->linkQueue1 = NULL;
-            links[i]->linkQueue2 = NULL;
-            links[i]->p1Sent - false;
+            queueInit(&links[i]->linkQueue1);
+            queueInit(&links[i]->linkQueue2);
+            links[i]->p1Sent = false;
             if (p1Col < cols - 2) {
                 p1Col++;
             }
@@ -411,9 +503,9 @@ interconn* init(inter_sim_args* isa)
             }
             links[rowLinks + i]->countDown = 0;
             links[rowLinks + i]->pendingReq = NULL;
-            links[rowLinks + i]->linkQueue1 = NULL;
-            links[rowLinks + i]->linkQueue2 = NULL;
-            links[rowLinks + i]->p1Sent - false;
+            queueInit(&links[rowLinks + i]->linkQueue1);
+            queueInit(&links[rowLinks + i]->linkQueue2);
+            links[rowLinks + i]->p1Sent = false;
             if (p1Col < cols - 1) {
                 p1Col++;
             }
@@ -423,7 +515,7 @@ interconn* init(inter_sim_args* isa)
             }
         }
         // no live messages yet, so each list is NULL
-        perProcMsgCount = calloc(sizeof(int64_t), processorCount);
+        perProcMsgCount = calloc(sizeof(int64_t), processorCount + 1);
         activeRequests = calloc(sizeof(bus_req*), processorCount);
         globalMsgCount = 0;
         // last_msg numbers all 0 for each node, and memory
@@ -433,6 +525,10 @@ interconn* init(inter_sim_args* isa)
         }
     }
 
+    if (t >= 1 && t <= 3 && processorCount > 1) {
+        buildRoutes();
+    }
+
     self = malloc(sizeof(interconn));
     self->req = req;
     self->registerCoher = registerCoher;
@@ -440,6 +536,7 @@ interconn* init(inter_sim_args* isa)
     self->si.tick = tick;
     self->si.finish = finish;
     self->si.destroy = destroy;
+    self->pointToPoint = (t >= 1 && t <= 3 && processorCount > 1);
 
     memComp = isa->memory;
     memComp->registerInterconnect(self);
@@ -474,13 +571,47 @@ void memReqCallback(int procNum, uint64_t addr)
     }
 }
 
+// A writeback occupies memory but has no reply
+void memWritebackCallback(int procNum, uint64_t addr)
+{
+}
+
+// Upgrades and updates are answered by the other caches alone, as the
+//   requester already has the data
+static bool cacheOnly(bus_req_type brt)
+{
+    return brt == BUSUPGR || brt == BUSUPD;
+}
+
+static void countCacheOnly(bus_req_type brt, bool hadData)
+{
+    if (brt == BUSUPD) {
+        updates++;
+    }
+    else {
+        upgrades++;
+        upgradesNoData += !hadData;
+    }
+}
+
+// Start the memory access of a request that reached memory
+static int memoryAccess(bus_req* br)
+{
+    if (br->brt == BUSWB) {
+        memWritebacks++;
+        return memComp->busReq(br->addr, br->pSrc, memWritebackCallback);
+    }
+    memReqsMade++;
+    return memComp->busReq(br->addr, br->pSrc, memReqCallback);
+}
+
 void busReq(bus_req_type brt, uint64_t addr, int procNum)
 {
     if (pendingRequest == NULL)
     {
         assert(brt != SHARED);
 
-        bus_req* nextReq = calloc(1, sizeof(bus_req));
+        bus_req* nextReq = reqAlloc();
         nextReq->brt = brt;
         nextReq->currentState = WAITING_CACHE;
         nextReq->addr = addr;
@@ -489,6 +620,7 @@ void busReq(bus_req_type brt, uint64_t addr, int procNum)
 
         pendingRequest = nextReq;
         countDown = CACHE_DELAY;
+        filterCountRequest(addr, 1);
 
         return;
     }
@@ -497,9 +629,15 @@ void busReq(bus_req_type brt, uint64_t addr, int procNum)
         pendingRequest->shared = 1;
         return;
     }
-    else if (brt == DATA && pendingRequest->addr == addr)
+    else if ((brt == DATA || brt == SHARED_DATA) &&
+             pendingRequest->addr == addr &&
+             pendingRequest->currentState == WAITING_MEMORY &&
+             pendingRequest->brt != BUSWB)
     {
-        assert(pendingRequest->currentState == WAITING_MEMORY);
+        // A cache supplies the data while memory is still fetching it;
+        //   data sent at any other time is a bus transfer of its own
+        if (brt == SHARED_DATA)
+            pendingRequest->shared = 1;
         pendingRequest->data = 1;
         pendingRequest->currentState = TRANSFERING_CACHE;
         countDown = CACHE_TRANSFER;
@@ -509,7 +647,7 @@ void busReq(bus_req_type brt, uint64_t addr, int procNum)
     {
         assert(brt != SHARED);
 
-        bus_req* nextReq = calloc(1, sizeof(bus_req));
+        bus_req* nextReq = reqAlloc();
         nextReq->brt = brt;
         nextReq->currentState = QUEUED;
         nextReq->addr = addr;
@@ -517,80 +655,119 @@ void busReq(bus_req_type brt, uint64_t addr, int procNum)
         nextReq->dataAvail = 0;
 
         enqBusRequest(nextReq, procNum);
+        filterCountRequest(addr, 1);
     }
 }
 
-link* findLink(int procNum, int pDest){
+// Number of links in the point-to-point topologies
+static int linkCount(void)
+{
     if (t == 1) {
-        //pDest is not necessarily next to procNum, so find correct link in the direction of pDest
-        for (int i = 0; i < processorCount; i++) {
-            link* lnk = links[i];
-            if ((procNum == lnk->proc1 && pDest >= lnk->proc2) ||
-                (procNum == lnk->proc2 && pDest <= lnk->proc1)) {
-                return lnk;
-            }
-        }
+        return processorCount;
     }
     if (t == 2) {
-        for (int i = 0; i < processorCount+1; i++) {
-            link* lnk = links[i];
-            // go right if shorter to increase procNum than to decrease it
-            int distRight = pDest - procNum;
-            if (distRight < 0) {
-                distRight = processorCount - distRight;
-            }
-            int distLeft = procNum - pDest;
-            if (distLeft < 0) {
-                distLeft = distLeft * -1;
-            }
-            bool goRight = distRight < distLeft;
-            if ((procNum == lnk->proc1 && goRight) ||
-                (procNum == lnk->proc2 && !goRight)) {
-                return lnk;
-            }
+        return processorCount + 1;
+    }
+    if (t == 3) {
+        return numLinks;
+    }
+    return 0;
+}
+
+// Broadcast from procNum with the given message number that is still
+//   collecting acks, if any
+bus_req* findActiveRequest(int procNum, int msgNum)
+{
+    if (procNum < 0 || procNum >= processorCount) {
+        return NULL;
+    }
+    for (bus_req* iter = activeRequests[procNum]; iter != NULL; iter = iter->next) {
+        if (iter->msgNum == msgNum) {
+            return iter;
         }
     }
+    return NULL;
+}
+
+// The next link from procNum toward pDest, NULL if there is none
+static link* routeStep(int procNum, int pDest)
+{
+    node_links* nl = &nodeLinks[procNum];
+
+    if (t == 1) {
+        return (pDest > procNum) ? nl->right : nl->left;
+    }
+    if (t == 2) {
+        // go right if shorter to increase procNum than to decrease it,
+        //   memory closing the ring after the last processor
+        int distRight = (pDest - procNum + routeNodes) % routeNodes;
+        int distLeft = routeNodes - distRight;
+        return (distRight < distLeft) ? nl->right : nl->left;
+    }
     if (t == 3) {
         // prioritize going to the correct column, then to the correct row
-        if (procNum % cols < pDest % cols) {
-            // go right if possible
-            for (int i = 0; i < rowLinks; i++) {
-                link* lnk = links[i];
-                if (lnk->proc1 == procNum) {
-                    return lnk;
-                }
-            }
+        if (procNum % cols < pDest % cols && nl->right != NULL) {
+            return nl->right;
         }
-        if (procNum % cols > pDest % cols) {
-            // go left if possible
-            for (int i = 0; i < rowLinks; i++) {
-                link* lnk = links[i];
-                if (lnk->proc2 == procNum) {
-                    return lnk;
-                }
-            }
+        if (procNum % cols > pDest % cols && nl->left != NULL) {
+            return nl->left;
         }
-        if (procNum < pDest) {
-            // go down if possible
-            for (int i = rowLinks; i < numLinks; i++) {
-                link* lnk = links[i];
-                if (lnk->proc1 == procNum) {
-                    return lnk;
-                }
-            }
+        if (procNum < pDest && nl->down != NULL) {
+            return nl->down;
         }
-        if (procNum > pDest) {
-            // go up if possible
-            for (int i = rowLinks; i < numLinks; i++) {
-                link* lnk = links[i];
-                if (lnk->proc2 == procNum) {
-                    return lnk;
-                }
-            }
+        if (procNum > pDest && nl->up != NULL) {
+            return nl->up;
+        }
+    }
+    return NULL;
+}
+
+// Index each node's links and route every pair of nodes, so a hop costs
+//   one lookup
+static void buildRoutes(void)
+{
+    int count = linkCount();
+
+    routeNodes = processorCount + 1;
+    nodeLinks = calloc(routeNodes, sizeof(node_links));
+    for (int i = 0; i < count; i++) {
+        link* lnk = links[i];
+        node_links* n1 = &nodeLinks[lnk->proc1];
+        node_links* n2 = &nodeLinks[lnk->proc2];
+        n1->adj[n1->count++] = lnk;
+        n2->adj[n2->count++] = lnk;
+        if (t == 3 && i >= rowLinks) {
+            n1->down = lnk;
+            n2->up = lnk;
+        }
+        else {
+            n1->right = lnk;
+            n2->left = lnk;
         }
+    }
+
+    routes = malloc(sizeof(link*) * routeNodes * routeNodes);
+    for (int from = 0; from < routeNodes; from++) {
+        for (int to = 0; to < routeNodes; to++) {
+            routes[from * routeNodes + to]
+                = (from == to) ? NULL : routeStep(from, to);
+        }
+    }
+}
+
+link* findLink(int procNum, int pDest){
+    link* lnk = routes[procNum * routeNodes + pDest];
+    if (lnk == NULL) {
         printf("Could not find link in correct direction\n");
         assert(false);
     }
+    return lnk;
+}
+
+// The line's last link reaches memory and only carries memory traffic
+static bool memoryLink(link* lnk)
+{
+    return t == 1 && lnk == links[processorCount - 1];
 }
 
 void req(bus_req_type brt, uint64_t addr, int procNum, int pDest, bool broadcast, int msgNum) {
@@ -610,14 +787,15 @@ void req(bus_req_type brt, uint64_t addr, int procNum, int pDest, bool broadcast
                    (broadcast) ? "broadcast" : "unicast", pDest);
         }
         int numToUse;
-        if (brt == BUSRD || brt == BUSWR) {
+        if (broadcast && (brt == BUSRD || brt == BUSWR || cacheOnly(brt))) {
             globalMsgCount++;
             numToUse = globalMsgCount;
         }
         else {
             numToUse = msgNum;
         }
-        bus_req* nextReq = calloc(1, sizeof(bus_req));
+        msgsSent++;
+        bus_req* nextReq = reqAlloc();
         nextReq->brt = brt;
         nextReq->currentState = QUEUED;
         nextReq->addr = addr;
@@ -630,7 +808,10 @@ void req(bus_req_type brt, uint64_t addr, int procNum, int pDest, bool broadcast
         if (brt == ACK || brt == DATA || brt == SHARED || brt == SHARED_DATA) {
             //ACKs should not be broadcast
             nextReq->broadcast = false;
-            if (procNum != processorCount) {
+            // Replies to a broadcast are counted at its source, any other
+            //   reply is delivered to the coherence component
+            if (procNum != processorCount &&
+                findActiveRequest(pDest, msgNum) != NULL) {
                 nextReq->ack = true;
             }
         }
@@ -644,44 +825,33 @@ void req(bus_req_type brt, uint64_t addr, int procNum, int pDest, bool broadcast
         if (broadcast) {
             assert(brt != ACK); //ACKs should not be broadcast
             assert(brt != MEMORY); //memory requests should not be broadcast
-            //send both ways so add to queue of both links
-            if (t == 1) {
-                for (int i = 0; i < processorCount - 1; i++) {
-                    link* lnk = links[i];
-                    if (procNum == lnk->proc1 || procNum == lnk->proc2) {
-                        enqLinkRequest(nextReq, lnk);
-                    }
-                }
-            }
-            if (t == 2) {
-                // send on both links, even to memory (memory will ignore and forward)
-                for (int i = 0; i < processorCount + 1; i++) {
-                    link* lnk = links[i];
-                    if (procNum == lnk->proc1 || procNum == lnk->proc2) {
-                        enqLinkRequest(nextReq, lnk);
-                    }
+            //send on all of the node's links, on the ring even to memory
+            //  (memory will ignore and forward), each its own copy
+            node_links* nl = &nodeLinks[procNum];
+            link* last = NULL;
+            for (int i = 0; i < nl->count; i++) {
+                if (memoryLink(nl->adj[i])) {
+                    continue;
                 }
-            }
-            if (t == 3) {
-                // send on all links other than the one you received the message on
-                for (int i = 0; i < numLinks; i++) {
-                    link* lnk = links[i];
-                    if (procNum == lnk->proc1 || procNum == lnk->proc2) {
-                        enqLinkRequest(nextReq, lnk);
-                    }
+                if (last != NULL) {
+                    enqLinkRequest(reqCopy(nextReq), last);
                 }
+                last = nl->adj[i];
             }
+            enqLinkRequest(nextReq, last);
         }
         else {
             //send one way, find the direction that is shortest for current topology
             link* lnk = findLink(procNum, pDest);
             enqLinkRequest(nextReq, lnk);
         }
-        free(nextReq);
     }
 }
 
-int forwardIfNeeded(bus_req* br, link* lnk) {
+// Pass br on from the node it reached over lnk.  br itself moves to the
+//   next link, so *forwarded tells the caller it no longer owns br; other
+//   links of a mesh broadcast get copies.
+int forwardIfNeeded(bus_req* br, link* lnk, bool* forwarded) {
     int cameFrom = br->procNum;
     int goingTo;
     if (cameFrom == lnk->proc1) {
@@ -701,61 +871,41 @@ int forwardIfNeeded(bus_req* br, link* lnk) {
         printf("Link between proc %d and proc %d\n", lnk->proc1, lnk->proc2);
     }
     perProcMsgCount[goingTo] = br->msgNum;
-    bus_req* fwdReq = malloc(sizeof(bus_req));
-    memcpy(fwdReq, br, sizeof(bus_req));
-    fwdReq->procNum = goingTo;
     link* nextLink = NULL;
     if (br->pDest != goingTo || br->broadcast) {
-        if (t == 1) {
-            for (int i = 0; i < processorCount; i++) {
-                if (i == processorCount - 1 && br->brt != MEMORY) {
-                    break;
-                }
-                link* lnk2 = links[i];
-                if ((goingTo == lnk2->proc1 && cameFrom != lnk2->proc2) ||
-                    (goingTo == lnk2->proc2 && cameFrom != lnk2->proc1)) {
-                    nextLink = lnk2;
-                    break;
-                }
-            }
+        if (t == 3 && !br->broadcast) {
+            nextLink = findLink(goingTo, br->pDest);
         }
-        if (t == 2) {
-            for (int i = 0; i < processorCount + 1; i++) {
-                link* lnk2 = links[i];
-                if ((goingTo == lnk2->proc1 && cameFrom != lnk2->proc2) ||
-                    (goingTo == lnk2->proc2 && cameFrom != lnk2->proc1)) {
-                    nextLink = lnk2;
-                    break;
+        else {
+            // Carry on along the line or ring, or out of every other link of
+            //   a mesh node
+            node_links* nl = &nodeLinks[goingTo];
+            for (int i = 0; i < nl->count; i++) {
+                link* lnk2 = nl->adj[i];
+                if (lnk2->proc1 == cameFrom || lnk2->proc2 == cameFrom ||
+                    (memoryLink(lnk2) && br->brt != MEMORY &&
+                     br->brt != BUSWB)) {
+                    continue;
                 }
-            }
-        }
-        if (t == 3) {
-            if (br->broadcast) {
-                for (int i = 0; i < numLinks; i++) {
-                    link* lnk2 = links[i];
-                    if ((goingTo == lnk2->proc1 && cameFrom != lnk2->proc2) ||
-                        (goingTo == lnk2->proc2 && cameFrom != lnk2->proc1)) {
-                        if (nextLink == NULL) {
-                            nextLink = lnk2;
-                        }
-                        else {
-                            bus_req* fwdReq2 = malloc(sizeof(bus_req));
-                            memcpy(fwdReq2, fwdReq, sizeof(bus_req));
-                            enqLinkRequest(fwdReq2, lnk2);
-                            free(fwdReq2);
-                        }
+                if (nextLink == NULL) {
+                    nextLink = lnk2;
+                    if (t != 3) {
+                        break;
                     }
                 }
-            }
-            else {
-                nextLink = findLink(goingTo, br->pDest);
+                else {
+                    bus_req* fwdReq = reqCopy(br);
+                    fwdReq->procNum = goingTo;
+                    enqLinkRequest(fwdReq, lnk2);
+                }
             }
         }
     }
+    *forwarded = (nextLink != NULL);
     if (nextLink != NULL) {
-        enqLinkRequest(fwdReq, nextLink);
+        br->procNum = goingTo;
+        enqLinkRequest(br, nextLink);
     }
-    free(fwdReq);
     //if broadcast, goinTo should still act, otherwise just forward and ignore
     if (!br->broadcast && nextLink != NULL) {
         //not broadcast and we are also not the destination, so dont act on it
@@ -764,6 +914,150 @@ int forwardIfNeeded(bus_req* br, link* lnk) {
     return goingTo;
 }
 
+static bool filterHolds(filter_entry* fe, int proc)
+{
+    return (fe->sharers[proc / 64] >> (proc % 64)) & 1;
+}
+
+static uint64_t filterSet(uint64_t addr)
+{
+    return (addr * 0x9E3779B97F4A7C15ull) >> (64 - filterLogSets);
+}
+
+// addr's entry, without counting it as a use
+static filter_entry* filterLookup(uint64_t addr)
+{
+    filter_entry* ways = &snoopFilter[filterSet(addr) * filterWays];
+
+    for (int w = 0; w < filterWays; w++)
+    {
+        if (ways[w].valid && ways[w].addr == addr)
+            return &ways[w];
+    }
+    return NULL;
+}
+
+// A request for the line was put on the bus or queued for it (1), or has
+//   completed (-1).  Every cache in a transient state for the line is
+//   waiting on one of them, so an entry with requests is not evicted.
+static void filterCountRequest(uint64_t addr, int delta)
+{
+    if (snoopFilter == NULL)
+        return;
+
+    filter_entry* fe = filterLookup(addr);
+    if (fe != NULL)
+        fe->requests += delta;
+}
+
+// Requests outstanding for a line that had no entry to count them
+static int lineRequests(uint64_t addr)
+{
+    int requests = 0;
+
+    if (pendingRequest != NULL && pendingRequest->addr == addr)
+        requests++;
+    for (int i = 0; i < processorCount; i++)
+    {
+        for (int j = 0; j < queuedRequests[i].count; j++)
+        {
+            if (queueAt(&queuedRequests[i], j)->addr == addr)
+                requests++;
+        }
+    }
+    return requests;
+}
+
+// Find addr's entry, or else the LRU entry that can be replaced, NULL when
+//   every entry of the set has requests outstanding
+static filter_entry* filterFind(uint64_t addr, filter_entry** victim)
+{
+    filter_entry* ways = &snoopFilter[filterSet(addr) * filterWays];
+
+    filterClock++;
+    *victim = NULL;
+    for (int w = 0; w < filterWays; w++)
+    {
+        if (ways[w].valid && ways[w].addr == addr)
+        {
+            ways[w].lastUse = filterClock;
+            return &ways[w];
+        }
+        if (!ways[w].valid && *victim == NULL)
+            *victim = &ways[w];
+    }
+    if (*victim != NULL)
+        return NULL;
+
+    for (int w = 0; w < filterWays; w++)
+    {
+        if ((*victim == NULL || ways[w].lastUse < (*victim)->lastUse) &&
+            ways[w].requests == 0)
+        {
+            *victim = &ways[w];
+        }
+    }
+    return NULL;
+}
+
+// Replace the victim with an entry for addr.  The caches that may hold the
+//   victim's line are sent a BusInv, so they evict it and write it back if
+//   dirty; none of them is mid transaction on it, as the line has no
+//   requests outstanding.  Without a victim addr is left untracked, so NULL
+//   is returned.
+static filter_entry* filterAllocate(uint64_t addr, filter_entry* victim)
+{
+    if (victim == NULL)
+    {
+        filterSpills++;
+        line_table_set(untrackedLines, addr, 1);
+        return NULL;
+    }
+
+    if (victim->valid)
+    {
+        filterEvictions++;
+        for (int i = 0; i < processorCount; i++)
+        {
+            if (filterHolds(victim, i))
+            {
+                backInvalidations++;
+                coherComp->busReq(BUSINV, victim->addr, i, -1, -1);
+            }
+        }
+    }
+
+    memset(victim, 0, sizeof(filter_entry));
+    victim->valid = true;
+    victim->addr = addr;
+    victim->lastUse = filterClock;
+    victim->requests = lineRequests(addr);
+    if (line_table_find(untrackedLines, addr) != 0)
+    {
+        line_table_remove(untrackedLines, addr);
+        for (int i = 0; i < processorCount; i++)
+        {
+            victim->sharers[i / 64] |= 1ull << (i % 64);
+        }
+    }
+    return victim;
+}
+
+// Data delivered to proc makes it a possible holder of the line, whether
+//   or not it was the reply to a snooped request
+static void filterAddSharer(uint64_t addr, int proc)
+{
+    if (snoopFilter == NULL)
+        return;
+
+    filter_entry* victim;
+    filter_entry* fe = filterFind(addr, &victim);
+    if (fe == NULL)
+        fe = filterAllocate(addr, victim);
+    if (fe != NULL)
+        fe->sharers[proc / 64] |= 1ull << (proc % 64);
+}
+
 void busTick() {
     if (countDown > 0)
     {
@@ -783,20 +1077,96 @@ void busTick() {
         {
             if (pendingRequest->currentState == WAITING_CACHE)
             {
-                // Make a request to memory.
-                countDown
-                    = memComp->busReq(pendingRequest->addr,
-                                      pendingRequest->procNum, memReqCallback);
+                // Make a request to memory, unless the requester already
+                //   has the data
+                pendingRequest->pSrc = pendingRequest->procNum;
+                if (!cacheOnly(pendingRequest->brt))
+                    countDown = memoryAccess(pendingRequest);
 
                 pendingRequest->currentState = WAITING_MEMORY;
 
+                // Nothing snoops a writeback, it only occupies the bus
+                //   and memory
+                if (pendingRequest->brt == BUSWB)
+                {
+                    return;
+                }
+
                 // The processors will snoop for this request as well.
+                //   With the filter, only those that may hold the line do,
+                //   and all of them if the line cannot be tracked.
+                filter_entry* fe = NULL;
+                if (snoopFilter != NULL && (pendingRequest->brt == BUSRD ||
+                                            pendingRequest->brt == BUSWR ||
+                                            cacheOnly(pendingRequest->brt)))
+                {
+                    filter_entry* victim;
+                    fe = filterFind(pendingRequest->addr, &victim);
+                    if (fe != NULL)
+                    {
+                        filterHits++;
+                    }
+                    else
+                    {
+                        filterMisses++;
+                        fe = filterAllocate(pendingRequest->addr, victim);
+                    }
+                }
+
                 for (int i = 0; i < processorCount; i++)
                 {
-                    if (pendingRequest->procNum != i)
+                    if (pendingRequest->procNum == i)
+                        continue;
+                    if (fe != NULL && !filterHolds(fe, i))
+                    {
+                        snoopsFiltered++;
+                        continue;
+                    }
+
+                    snoopsSent++;
+                    coherComp->busReq(pendingRequest->brt,
+                                      pendingRequest->addr, i, -1, -1);
+                }
+
+                // Data on the bus fills any snooper that was waiting for
+                //   the line, so each becomes a possible holder
+                bus_req_type brt = pendingRequest->brt;
+                if (snoopFilter != NULL &&
+                    (brt == DATA || brt == SHARED || brt == SHARED_DATA))
+                {
+                    for (int i = 0; i < processorCount; i++)
                     {
-                        coherComp->busReq(pendingRequest->brt,
-                                          pendingRequest->addr, i, -1, -1);
+                        if (pendingRequest->procNum != i)
+                            filterAddSharer(pendingRequest->addr, i);
+                    }
+                }
+
+                if (fe != NULL)
+                {
+                    int p = pendingRequest->procNum;
+                    if (pendingRequest->brt == BUSWR ||
+                        pendingRequest->brt == BUSUPGR)
+                        memset(fe->sharers, 0, sizeof(fe->sharers));
+                    fe->sharers[p / 64] |= 1ull << (p % 64);
+                }
+
+                // Once the copies have seen an upgrade or update it is
+                //   done, unless an owner sent data for a stale upgrade
+                if (cacheOnly(pendingRequest->brt))
+                {
+                    countCacheOnly(pendingRequest->brt, pendingRequest->data);
+                    if (pendingRequest->data == 0)
+                    {
+                        // The bus is free again before the reply, so any
+                        //   request it prompts is queued
+                        bus_req* done = pendingRequest;
+                        interconnNotifyState();
+                        pendingRequest = NULL;
+                        filterCountRequest(done->addr, -1);
+                        coherComp->busReq(done->shared ? SHARED : ACK,
+                                          done->addr, done->procNum, -1, -1);
+                        reqRelease(done);
+                        return;
                     }
                 }
 
@@ -809,11 +1179,26 @@ void busTick() {
             {
                 bus_req_type brt
                     = (pendingRequest->shared == 1) ? SHARED : DATA;
-                coherComp->busReq(brt, pendingRequest->addr,
-                                  pendingRequest->procNum, -1, -1);
+                if (pendingRequest->brt != BUSWB)
+                {
+                    filterAddSharer(pendingRequest->addr,
+                                    pendingRequest->procNum);
+                    coherComp->busReq(brt, pendingRequest->addr,
+                                      pendingRequest->procNum, -1, -1);
+                }
 
                 interconnNotifyState();
-                free(pendingRequest);
+                filterCountRequest(pendingRequest->addr, -1);
+                reqRelease(pendingRequest);
+                pendingRequest = NULL;
+            }
+            else if (pendingRequest->currentState == WAITING_MEMORY &&
+                     pendingRequest->brt == BUSWB)
+            {
+                // The writeback has reached memory
+                interconnNotifyState();
+                filterCountRequest(pendingRequest->addr, -1);
+                reqRelease(pendingRequest);
                 pendingRequest = NULL;
             }
             else if (pendingRequest->currentState == TRANSFERING_CACHE)
@@ -822,11 +1207,13 @@ void busTick() {
                 if (pendingRequest->shared == 1)
                     brt = SHARED;
 
+                filterAddSharer(pendingRequest->addr, pendingRequest->procNum);
                 coherComp->busReq(brt, pendingRequest->addr,
                                   pendingRequest->procNum, -1, -1);
 
                 interconnNotifyState();
-                free(pendingRequest);
+                filterCountRequest(pendingRequest->addr, -1);
+                reqRelease(pendingRequest);
                 pendingRequest = NULL;
             }
         }
@@ -836,7 +1223,7 @@ void busTick() {
         for (int i = 0; i < processorCount; i++)
         {
             int pos = (i + lastProc) % processorCount;
-            if (queuedRequests[pos] != NULL)
+            if (queuedRequests[pos].count > 0)
             {
                 pendingRequest = deqBusRequest(pos);
                 countDown = CACHE_DELAY;
@@ -888,8 +1275,10 @@ void lineTick() {
             if (lnk->countDown == 0 && lnk->pendingReq->ack == false) {
                 bus_req* completedReq = lnk->pendingReq;
                 lnk->pendingReq = NULL;
-                int goingTo = forwardIfNeeded(completedReq, lnk);
-                assert(goingTo != completedReq->procNum);
+                int cameFrom = completedReq->procNum;
+                bool forwarded = false;
+                int goingTo = forwardIfNeeded(completedReq, lnk, &forwarded);
+                assert(goingTo != cameFrom);
                 assert(goingTo == lnk->proc1 || goingTo == lnk->proc2 || goingTo == -1);
                 if (!(goingTo == completedReq->pDest || goingTo == -1 ||
                        completedReq->broadcast == true)) {
@@ -909,23 +1298,23 @@ void lineTick() {
                                       goingTo, completedReq->pSrc, completedReq->msgNum);
                 }
                 else if (goingTo == processorCount) {
-                    assert(completedReq->brt == MEMORY);
+                    assert(completedReq->brt == MEMORY || completedReq->brt == BUSWB);
                     assert(completedReq->broadcast == false);
                     assert(completedReq->pDest == processorCount);
                     assert(completedReq->procNum == processorCount - 1);
-                    memReqsMade++;
-                    int memCountDown = memComp->busReq(completedReq->addr,
-                                      completedReq->pSrc, memReqCallback);
-                    lnk->countDown = memCountDown;
+                    lnk->countDown = memoryAccess(completedReq);
+                }
+                if (!forwarded) {
+                    reqRelease(completedReq);
                 }
-                free(completedReq);
 
             }
             else if (lnk->countDown == 0 && lnk->pendingReq->ack == true) {
                 bus_req* completedReq = lnk->pendingReq;
                 lnk->pendingReq = NULL;
                 assert(completedReq->pDest < processorCount); //no acks to memory
-                int goingTo = forwardIfNeeded(completedReq, lnk);
+                bool forwarded = false;
+                int goingTo = forwardIfNeeded(completedReq, lnk, &forwarded);
                 assert(goingTo != completedReq->procNum);
                 assert(goingTo == lnk->proc1 || goingTo == lnk->proc2 || goingTo == -1);
                 assert(completedReq->broadcast == false);
@@ -983,7 +1372,15 @@ void lineTick() {
                             else {
                                 activeRequests[completedReq->pDest] = iter->next;
                             }
-                            if (!iter->dataAvail) {
+                            if (cacheOnly(iter->brt)) {
+                                countCacheOnly(iter->brt, iter->dataAvail);
+                            }
+                            if (cacheOnly(iter->brt) && !iter->dataAvail) {
+                                //the requester has the data, only the copies had to answer
+                                coherComp->busReq(iter->shared ? SHARED : ACK, iter->addr,
+                                                  iter->pSrc, -1, -2);
+                            }
+                            else if (!iter->dataAvail) {
                                 memReqs++;
                                 req(MEMORY, iter->addr, iter->pSrc, processorCount, false, -2);
                             }
@@ -999,7 +1396,7 @@ void lineTick() {
                                                       iter->pSrc, -1, -2);
                                 }
                             }
-                            free(iter);
+                            reqRelease(iter);
                         }
                     }
                     else {
@@ -1012,9 +1409,12 @@ void lineTick() {
                         else {
                             activeRequests[completedReq->pDest] = iter->next;
                         }
-                        free(iter);
+                        reqRelease(iter);
                     }
                 }
+                if (!forwarded) {
+                    reqRelease(completedReq);
+                }
                 assert(checkActiveRequests());
             }
         }
@@ -1025,10 +1425,14 @@ void lineTick() {
             }
             lastProgressTick = tickCount;
             bus_req* nextReq = deqLinkRequest(lnk);
+            linkTransfers++;
             lnk->pendingReq = nextReq;
+            // Only broadcasts collect acks; unicast requests (as sent to a
+            //   directory) are answered by a single reply
             if (lnk->pendingReq->procNum == lnk->pendingReq->pSrc &&
-                lnk->pendingReq->ack == false &&
-                (lnk->pendingReq->brt == BUSRD || lnk->pendingReq->brt == BUSWR)) {
+                lnk->pendingReq->ack == false && lnk->pendingReq->broadcast &&
+                (lnk->pendingReq->brt == BUSRD || lnk->pendingReq->brt == BUSWR ||
+                 cacheOnly(lnk->pendingReq->brt))) {
                 //print we are waiting for acks for msg with msgnum:
                 if (CADSS_VERBOSE) {
                     printf("Tracking active request from proc %d of type %s for address %lx with msgNum %d\n",
@@ -1038,8 +1442,7 @@ void lineTick() {
                            lnk->pendingReq->msgNum);
                 }
                 assert(lnk->pendingReq->broadcast == true);
-                bus_req* copy = malloc(sizeof(bus_req));
-                memcpy(copy, lnk->pendingReq, sizeof(bus_req));
+                bus_req* copy = reqCopy(lnk->pendingReq);
                 copy->numAcks = 0;
                 if (activeRequests[lnk->pendingReq->pSrc] == NULL) {
                     activeRequests[lnk->pendingReq->pSrc] = copy;
@@ -1053,7 +1456,7 @@ void lineTick() {
                         if (iter->msgNum == copy->msgNum) {
                             //already tracking this request
                             shouldAdd = false;
-                            free(copy);
+                            reqRelease(copy);
                             break;
                         }
                         prev = iter;
@@ -1107,15 +1510,17 @@ void ringTick() {
                     assert(completedReq->procNum != lnk->proc2);
                     arrivedAt = lnk->proc2;
                 }
+                int cameFrom = completedReq->procNum;
+                bool forwarded = false;
                 int goingTo = -1;
                 if ((last_msgs[arrivedAt][completedReq->pSrc] < completedReq->msgNum && arrivedAt != completedReq->pSrc) || !completedReq->broadcast) {
-                    goingTo = forwardIfNeeded(completedReq, lnk);
+                    goingTo = forwardIfNeeded(completedReq, lnk, &forwarded);
                     if (completedReq->broadcast) {
                         last_msgs[arrivedAt][completedReq->pSrc] = completedReq->msgNum;
                     }
                     assert(goingTo == -1 || goingTo == arrivedAt);
                 }
-                assert(goingTo != completedReq->procNum);
+                assert(goingTo != cameFrom);
                 assert(goingTo == lnk->proc1 || goingTo == lnk->proc2 || goingTo == -1);
                 if (!(goingTo == completedReq->pDest || goingTo == -1 ||
                        completedReq->broadcast == true)) {
@@ -1135,35 +1540,25 @@ void ringTick() {
                                       goingTo, completedReq->pSrc, completedReq->msgNum);
                 }
                 else if (goingTo == processorCount && completedReq->pDest == processorCount) {
-                    assert(completedReq->brt == MEMORY);
+                    assert(completedReq->brt == MEMORY || completedReq->brt == BUSWB);
                     assert(completedReq->broadcast == false);
                     assert(completedReq->pDest == processorCount);
                     assert(completedReq->procNum == processorCount - 1 || completedReq->procNum == 0);
-                    // add to end of memory requests list
-                    bus_req* new_mem_req = memoryRequests;
-                    bus_req* prev_mem_req = NULL;
-                    while (new_mem_req != NULL) {
-                        prev_mem_req = new_mem_req;
-                        new_mem_req = new_mem_req->next;
-                    }
-                    new_mem_req = malloc(sizeof(bus_req));
-                    memcpy(new_mem_req, completedReq, sizeof(bus_req));
-                    new_mem_req->next = NULL;
-                    if (prev_mem_req != NULL) {
-                        prev_mem_req->next = new_mem_req;
-                    }
-                    else {
-                        memoryRequests = new_mem_req;
-                    }
+                    // add to end of memory requests queue, which now owns it
+                    queuePush(&memoryRequests, completedReq);
                     memReqsReachedMemRing++;
+                    forwarded = true;
+                }
+                if (!forwarded) {
+                    reqRelease(completedReq);
                 }
-                free(completedReq);
 
             }
             else if (lnk->countDown == 0 && lnk->pendingReq->ack == true) {
                 bus_req* completedReq = lnk->pendingReq;
                 lnk->pendingReq = NULL;
-                int goingTo = forwardIfNeeded(completedReq, lnk);
+                bool forwarded = false;
+                int goingTo = forwardIfNeeded(completedReq, lnk, &forwarded);
                 assert(goingTo != completedReq->procNum);
                 assert(goingTo == lnk->proc1 || goingTo == lnk->proc2 || goingTo == -1);
                 assert(completedReq->broadcast == false);
@@ -1222,7 +1617,15 @@ void ringTick() {
                             else {
                                 activeRequests[completedReq->pDest] = iter->next;
                             }
-                            if (!iter->dataAvail) {
+                            if (cacheOnly(iter->brt)) {
+                                countCacheOnly(iter->brt, iter->dataAvail);
+                            }
+                            if (cacheOnly(iter->brt) && !iter->dataAvail) {
+                                //the requester has the data, only the copies had to answer
+                                coherComp->busReq(iter->shared ? SHARED : ACK, iter->addr,
+                                                  iter->pSrc, -1, -2);
+                            }
+                            else if (!iter->dataAvail) {
                                 memReqs++;
                                 req(MEMORY, iter->addr, iter->pSrc, processorCount, false, -2);
                             }
@@ -1238,7 +1641,7 @@ void ringTick() {
                                                       iter->pSrc, -1, -2);
                                 }
                             }
-                            free(iter);
+                            reqRelease(iter);
                         }
                     }
                     else {
@@ -1251,9 +1654,12 @@ void ringTick() {
                         else {
                             activeRequests[completedReq->pDest] = iter->next;
                         }
-                        free(iter);
+                        reqRelease(iter);
                     }
                 }
+                if (!forwarded) {
+                    reqRelease(completedReq);
+                }
                 assert(checkActiveRequests());
             }
         }
@@ -1264,10 +1670,14 @@ void ringTick() {
             }
             lastProgressTick = tickCount;
             bus_req* nextReq = deqLinkRequest(lnk);
+            linkTransfers++;
             lnk->pendingReq = nextReq;
+            // Only broadcasts collect acks; unicast requests (as sent to a
+            //   directory) are answered by a single reply
             if (lnk->pendingReq->procNum == lnk->pendingReq->pSrc &&
-                lnk->pendingReq->ack == false &&
-                (lnk->pendingReq->brt == BUSRD || lnk->pendingReq->brt == BUSWR)) {
+                lnk->pendingReq->ack == false && lnk->pendingReq->broadcast &&
+                (lnk->pendingReq->brt == BUSRD || lnk->pendingReq->brt == BUSWR ||
+                 cacheOnly(lnk->pendingReq->brt))) {
                 //print we are waiting for acks for msg with msgnum:
                 if (CADSS_VERBOSE) {
                     printf("Tracking active request from proc %d of type %s for address %lx with msgNum %d\n",
@@ -1277,8 +1687,7 @@ void ringTick() {
                            lnk->pendingReq->msgNum);
                 }
                 assert(lnk->pendingReq->broadcast == true);
-                bus_req* copy = malloc(sizeof(bus_req));
-                memcpy(copy, lnk->pendingReq, sizeof(bus_req));
+                bus_req* copy = reqCopy(lnk->pendingReq);
                 copy->numAcks = 0;
                 if (activeRequests[lnk->pendingReq->pSrc] == NULL) {
                     activeRequests[lnk->pendingReq->pSrc] = copy;
@@ -1292,7 +1701,7 @@ void ringTick() {
                         if (iter->msgNum == copy->msgNum) {
                             //already tracking this request
                             shouldAdd = false;
-                            free(copy);
+                            reqRelease(copy);
                             break;
                         }
                         prev = iter;
@@ -1318,14 +1727,10 @@ void ringTick() {
     if (memoryCountdown > 0) {
         memoryCountdown--;
     }
-    if (memoryCountdown == 0 && memoryRequests != NULL) {
-        memReqsMade++;
-        bus_req* thisRequest = memoryRequests;
-        int memCountDown = memComp->busReq(thisRequest->addr,
-                        thisRequest->pSrc, memReqCallback);
-        memoryCountdown = memCountDown;
-        memoryRequests = memoryRequests->next;
-        free(thisRequest);
+    if (memoryCountdown == 0 && memoryRequests.count > 0) {
+        bus_req* thisRequest = queuePop(&memoryRequests);
+        memoryCountdown = memoryAccess(thisRequest);
+        reqRelease(thisRequest);
     }
     // if (tickCount - lastProgressTick > 10000) {
     //     printf("No progress made in 10000 ticks, possible deadlock in interconnect\n");
@@ -1358,15 +1763,17 @@ void meshTick() {
                     assert(completedReq->procNum != lnk->proc2);
                     arrivedAt = lnk->proc2;
                 }
+                int cameFrom = completedReq->procNum;
+                bool forwarded = false;
                 int goingTo = -1;
                 if ((last_msgs[arrivedAt][completedReq->pSrc] < completedReq->msgNum && arrivedAt != completedReq->pSrc) || !completedReq->broadcast) {
-                    goingTo = forwardIfNeeded(completedReq, lnk);
+                    goingTo = forwardIfNeeded(completedReq, lnk, &forwarded);
                     if (completedReq->broadcast) {
                         last_msgs[arrivedAt][completedReq->pSrc] = completedReq->msgNum;
                     }
                     assert(goingTo == -1 || goingTo == arrivedAt);
                 }
-                assert(goingTo != completedReq->procNum);
+                assert(goingTo != cameFrom);
                 assert(goingTo == lnk->proc1 || goingTo == lnk->proc2 || goingTo == -1);
                 if (!(goingTo == completedReq->pDest || goingTo == -1 ||
                        completedReq->broadcast == true)) {
@@ -1386,34 +1793,24 @@ void meshTick() {
                                       goingTo, completedReq->pSrc, completedReq->msgNum);
                 }
                 else if (goingTo == processorCount && completedReq->pDest == processorCount) {
-                    assert(completedReq->brt == MEMORY);
+                    assert(completedReq->brt == MEMORY || completedReq->brt == BUSWB);
                     assert(completedReq->broadcast == false);
                     assert(completedReq->pDest == processorCount);
-                    // add to end of memory requests list
-                    bus_req* new_mem_req = memoryRequests;
-                    bus_req* prev_mem_req = NULL;
-                    while (new_mem_req != NULL) {
-                        prev_mem_req = new_mem_req;
-                        new_mem_req = new_mem_req->next;
-                    }
-                    new_mem_req = malloc(sizeof(bus_req));
-                    memcpy(new_mem_req, completedReq, sizeof(bus_req));
-                    new_mem_req->next = NULL;
-                    if (prev_mem_req != NULL) {
-                        prev_mem_req->next = new_mem_req;
-                    }
-                    else {
-                        memoryRequests = new_mem_req;
-                    }
+                    // add to end of memory requests queue, which now owns it
+                    queuePush(&memoryRequests, completedReq);
                     memReqsReachedMemRing++;
+                    forwarded = true;
+                }
+                if (!forwarded) {
+                    reqRelease(completedReq);
                 }
-                free(completedReq);
 
             }
             else if (lnk->countDown == 0 && lnk->pendingReq->ack == true) {
                 bus_req* completedReq = lnk->pendingReq;
                 lnk->pendingReq = NULL;
-                int goingTo = forwardIfNeeded(completedReq, lnk);
+                bool forwarded = false;
+                int goingTo = forwardIfNeeded(completedReq, lnk, &forwarded);
                 assert(goingTo != completedReq->procNum);
                 assert(goingTo == lnk->proc1 || goingTo == lnk->proc2 || goingTo == -1);
                 assert(completedReq->broadcast == false);
@@ -1472,7 +1869,15 @@ void meshTick() {
                             else {
                                 activeRequests[completedReq->pDest] = iter->next;
                             }
-                            if (!iter->dataAvail) {
+                            if (cacheOnly(iter->brt)) {
+                                countCacheOnly(iter->brt, iter->dataAvail);
+                            }
+                            if (cacheOnly(iter->brt) && !iter->dataAvail) {
+                                //the requester has the data, only the copies had to answer
+                                coherComp->busReq(iter->shared ? SHARED : ACK, iter->addr,
+                                                  iter->pSrc, -1, -2);
+                            }
+                            else if (!iter->dataAvail) {
                                 memReqs++;
                                 req(MEMORY, iter->addr, iter->pSrc, processorCount, false, -2);
                             }
@@ -1488,7 +1893,7 @@ void meshTick() {
                                                       iter->pSrc, -1, -2);
                                 }
                             }
-                            free(iter);
+                            reqRelease(iter);
                         }
                     }
                     else {
@@ -1501,9 +1906,12 @@ void meshTick() {
                         else {
                             activeRequests[completedReq->pDest] = iter->next;
                         }
-                        free(iter);
+                        reqRelease(iter);
                     }
                 }
+                if (!forwarded) {
+                    reqRelease(completedReq);
+                }
                 assert(checkActiveRequests());
             }
         }
@@ -1514,10 +1922,14 @@ void meshTick() {
             }
             lastProgressTick = tickCount;
             bus_req* nextReq = deqLinkRequest(lnk);
+            linkTransfers++;
             lnk->pendingReq = nextReq;
+            // Only broadcasts collect acks; unicast requests (as sent to a
+            //   directory) are answered by a single reply
             if (lnk->pendingReq->procNum == lnk->pendingReq->pSrc &&
-                lnk->pendingReq->ack == false &&
-                (lnk->pendingReq->brt == BUSRD || lnk->pendingReq->brt == BUSWR)) {
+                lnk->pendingReq->ack == false && lnk->pendingReq->broadcast &&
+                (lnk->pendingReq->brt == BUSRD || lnk->pendingReq->brt == BUSWR ||
+                 cacheOnly(lnk->pendingReq->brt))) {
                 //print we are waiting for acks for msg with msgnum:
                 if (CADSS_VERBOSE) {
                     printf("Tracking active request from proc %d of type %s for address %lx with msgNum %d\n",
@@ -1527,8 +1939,7 @@ void meshTick() {
                            lnk->pendingReq->msgNum);
                 }
                 assert(lnk->pendingReq->broadcast == true);
-                bus_req* copy = malloc(sizeof(bus_req));
-                memcpy(copy, lnk->pendingReq, sizeof(bus_req));
+                bus_req* copy = reqCopy(lnk->pendingReq);
                 copy->numAcks = 0;
                 if (activeRequests[lnk->pendingReq->pSrc] == NULL) {
                     activeRequests[lnk->pendingReq->pSrc] = copy;
@@ -1542,7 +1953,7 @@ void meshTick() {
                         if (iter->msgNum == copy->msgNum) {
                             //already tracking this request
                             shouldAdd = false;
-                            free(copy);
+                            reqRelease(copy);
                             break;
                         }
                         prev = iter;
@@ -1568,14 +1979,10 @@ void meshTick() {
     if (memoryCountdown > 0) {
         memoryCountdown--;
     }
-    if (memoryCountdown == 0 && memoryRequests != NULL) {
-        memReqsMade++;
-        bus_req* thisRequest = memoryRequests;
-        int memCountDown = memComp->busReq(thisRequest->addr,
-                        thisRequest->pSrc, memReqCallback);
-        memoryCountdown = memCountDown;
-        memoryRequests = memoryRequests->next;
-        free(thisRequest);
+    if (memoryCountdown == 0 && memoryRequests.count > 0) {
+        bus_req* thisRequest = queuePop(&memoryRequests);
+        memoryCountdown = memoryAccess(thisRequest);
+        reqRelease(thisRequest);
     }
     // if (tickCount - lastProgressTick > 10000) {
     //     printf("No progress made in 10000 ticks, possible deadlock in interconnect\n");
@@ -1781,7 +2188,8 @@ void interconnNotifyState(void)
 int busReqCacheTransfer(uint64_t addr, int procNum)
 {
     //check every link's pending request and queue to see if any node that is not memory is transferring data for this addr and procNum
-    for (int i = 0; i < processorCount; i++) {
+    //the bus topology has no links
+    for (int i = 0; links != NULL && i < linkCount(); i++) {
         link* lnk = links[i];
         if (lnk->pendingReq != NULL) {
             if (lnk->pendingReq->addr == addr &&
@@ -1790,23 +2198,16 @@ int busReqCacheTransfer(uint64_t addr, int procNum)
                 return 1;
             }
         }
-        bus_req* iter = lnk->linkQueue1;
-        while (iter != NULL) {
-            if (iter->addr == addr &&
-                iter->pDest == procNum &&
-                iter->data == 1) {
-                return 1;
-            }
-            iter = iter->next;
-        }
-        iter = lnk->linkQueue2;
-        while (iter != NULL) {
-            if (iter->addr == addr &&
-                iter->pDest == procNum &&
-                iter->data == 1) {
-                return 1;
+        for (int q = 0; q < 2; q++) {
+            req_queue* queue = (q == 0) ? &lnk->linkQueue1 : &lnk->linkQueue2;
+            for (int j = 0; j < queue->count; j++) {
+                bus_req* iter = queueAt(queue, j);
+                if (iter->addr == addr &&
+                    iter->pDest == procNum &&
+                    iter->data == 1) {
+                    return 1;
+                }
             }
-            iter = iter->next;
         }
     }
 
@@ -1821,6 +2222,32 @@ int busReqCacheTransfer(uint64_t addr, int procNum)
 
 int finish(int outFd)
 {
+    // unistd.h is left out as its link() clashes with the link type
+    if (t != 0 && processorCount > 1) {
+        dprintf(outFd, "Interconnect messages - %ld, link transfers - %ld\n",
+                msgsSent, linkTransfers);
+    }
+    else if (processorCount > 1) {
+        dprintf(outFd, "Snoops - %ld, filtered - %ld\n", snoopsSent,
+                snoopsFiltered);
+    }
+    if (memWritebacks > 0) {
+        dprintf(outFd, "Memory writebacks - %ld\n", memWritebacks);
+    }
+    if (upgrades > 0) {
+        dprintf(outFd, "Upgrades - %ld, granted without data - %ld\n",
+                upgrades, upgradesNoData);
+    }
+    if (updates > 0) {
+        dprintf(outFd, "Updates - %ld\n", updates);
+    }
+    if (snoopFilter != NULL) {
+        dprintf(outFd,
+                "Snoop filter hits - %ld, misses - %ld, evictions - %ld, "
+                "back-invalidations - %ld, untracked misses - %ld\n",
+                filterHits, filterMisses, filterEvictions, backInvalidations,
+                filterSpills);
+    }
     memComp->si.finish(outFd);
     return 0;
 }
@@ -1828,6 +2255,26 @@ int finish(int outFd)
 int destroy(void)
 {
     // TODO
+    free(snoopFilter);
+    if (untrackedLines != NULL)
+        line_table_free(untrackedLines);
+    free(nodeLinks);
+    free(routes);
+    if (queuedRequests != NULL) {
+        for (int i = 0; i < processorCount; i++) {
+            queueFree(&queuedRequests[i]);
+        }
+        free(queuedRequests);
+    }
+    for (int i = 0; links != NULL && i < linkCount(); i++) {
+        queueFree(&links[i]->linkQueue1);
+        queueFree(&links[i]->linkQueue2);
+    }
+    queueFree(&memoryRequests);
+    for (int i = 0; i < slabCount; i++) {
+        free(slabs[i]);
+    }
+    free(slabs);
     memComp->si.destroy();
     return 0;
 }
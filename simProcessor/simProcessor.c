@@ -15,27 +15,48 @@ processor* self = NULL;
 
 typedef struct _functionUnit FU;
 
-typedef struct _functionalUnits {
-    FU* fastALUs;
-    FU* longALUs;
-} scoreboard;
-
-typedef struct _register {
+#define MAX_FU_CLASSES 8
+
+// One row of the function unit table.  A class has count identical units
+// that each take latency cycles per op and accept a new op every
+// issueInterval cycles, so an interval equal to the latency describes an
+// unpipelined unit.  opMask has bit (1 << op_type) set for each op the class
+// executes.
+typedef struct _fuClass {
+    char name[16];
+    int count;
+    int latency;
+    int issueInterval;
+    uint32_t opMask;
+    int sqSize;
+    int sqMaxSize;
+    FU* units;
+} fuClass;
+
+// Physical register in the renamed register file.  A register returns to
+// the free list once a younger op has remapped its architectural register,
+// its value has been produced, and no dispatched op still has to read it.
+typedef struct _physRegister {
     bool ready;
-    int num;
-    int64_t tag;
-} reg;
+    bool superseded;
+    int readers;
+} physReg;
 
 typedef struct _registerFile {
-    reg* regs;
+    physReg* regs;
+    int* renameMap;
+    int* freeList;
+    int freeCount;
 } RF;
 
 typedef struct _reservationStation {
     FU* FU;
+    fuClass* cls;
     int64_t tag;
-    reg** srcs;
-    reg* dest;
-    bool isLongALU;
+    int srcs[2];
+    int dest;
+    int core;
+    bool mispredicted;
     struct _reservationStation* next;
     struct _reservationStation* prev;
 } RS;
@@ -43,6 +64,7 @@ typedef struct _reservationStation {
 typedef struct _commonDataBus {
     bool busy;
     int64_t tag;
+    int preg;
     int64_t tickIssued;
 } CDB;
 
@@ -51,6 +73,8 @@ int CADSS_VERBOSE = 0;
 
 int* pendingMem = NULL;
 int* pendingBranch = NULL;
+bool* awaitingBranch = NULL;
+int redirectPenalty = 1;
 int64_t* memOpTag = NULL;
 
 int fetchRate = 0;
@@ -59,10 +83,121 @@ int scheduleWidth = 0;
 int numFastALU = 0;
 int numLongALU = 0;
 int numCDB = 0;
+int numFUClasses = 0;
+int numFUs = 0;
+fuClass fuClasses[MAX_FU_CLASSES];
+int numPhysRegs = 0;
 uint64_t tagCounter = 0;
+int64_t renameStallCycles = 0;
+
+const int ARCH_REGS = 33;
+
+// CPI stack.  Every cycle of every core is charged to exactly one category,
+//   checked in this order: the core committed an op, it is blocked on a
+//   memory op or a mispredicted branch, its ops are held up by a backend
+//   structure, its ops are still executing, or it has nothing to run.
+//   The cache interface does not report which level serviced a request,
+//   so memory stalls are split by access type.
+enum cpiCategory
+{
+    CPI_BASE,
+    CPI_MEM_LOAD,
+    CPI_MEM_STORE,
+    CPI_BRANCH,
+    CPI_CDB,
+    CPI_FU_BUSY,
+    CPI_RENAME,
+    CPI_SQ_FULL,
+    CPI_DQ_FULL,
+    CPI_EXECUTE,
+    CPI_FRONTEND,
+    CPI_CATEGORIES
+};
+
+const char* cpiNames[CPI_CATEGORIES] = {
+    "base",
+    "memory load",
+    "memory store",
+    "branch mispredict",
+    "CDB contention",
+    "FU busy",
+    "rename",
+    "schedule queue full",
+    "dispatch queue full",
+    "execution",
+    "frontend"};
+
+// Backend stalls seen by a core during the current tick
+#define STALL_CDB (1 << 0)
+#define STALL_FU (1 << 1)
+#define STALL_RENAME (1 << 2)
+#define STALL_SQ (1 << 3)
+#define STALL_DQ (1 << 4)
+
+typedef struct _coreAccounting {
+    int64_t cycles[CPI_CATEGORIES];
+    int64_t lastCycles[CPI_CATEGORIES];
+    int64_t ops;
+    int64_t mispredicts;
+    int64_t wastedSlots;
+    int inFlight;
+    int committed;
+    int stalls;
+    bool memIsStore;
+    bool branchStalled;
+    bool traceDone;
+} coreAccounting;
+
+coreAccounting* coreStats = NULL;
+int64_t cpiInterval = 0;
+
+// Decoupled front end.  With a fetch target queue, the branch predictor runs
+//   ahead of fetch and queues predicted ops in the FTQ; fetch then pulls them
+//   through a private I-cache, at most one cache line per cycle and never
+//   past a taken branch.  Lines named by queued ops are prefetched into the
+//   I-cache ahead of fetch (fetch directed instruction prefetch).
+typedef struct _ftqEntry {
+    trace_op* op;
+    uint64_t pc;
+    bool mispredicted;
+} ftqEntry;
+
+typedef struct _icacheLine {
+    bool valid;
+    bool prefetched;
+    uint64_t line;
+    int64_t readyTick;
+    int64_t lastUse;
+} icacheLine;
+
+typedef struct _frontEnd {
+    ftqEntry* ftq;
+    int ftqHead;
+    int ftqCount;
+    int mispredictsQueued;
+    uint64_t lastPC;
+    icacheLine* icache;
+} frontEnd;
+
+int ftqSize = 0;
+int icacheSets = 0;
+int icacheWays = 0;
+int icacheBlockSize = 64;
+int icacheMissTicks = 0;
+int prefetchDegree = 1;
+frontEnd* frontEnds = NULL;
+
+int64_t icacheHits = 0;
+int64_t icacheMisses = 0;
+int64_t icachePrefetches = 0;
+int64_t icacheUsefulPrefetches = 0;
+int64_t icacheStallCycles = 0;
+int64_t ftqEmptyCycles = 0;
 
 typedef struct _DQEntry {
     trace_op* op;
+    int core;
+    bool mispredicted;
     struct _DQEntry* next;
 } DQEntry;
 
@@ -73,27 +208,23 @@ typedef struct _dispatchQueue {
     int maxSize;
 } dispatchQueue;
 
+// Entries are shared by all FU classes, while occupancy is limited per class
 typedef struct scheduleQueue {
     RS* head;
-    int sizeFast;
-    int sizeLong;
-    int maxFastSize;
-    int maxLongSize;
+    int size;
 } scheduleQueue;
 
+// stages[0] holds the op issued most recently and stages[latency - 1] the
+// op that completes on the next execute.
 typedef struct _functionUnit {
-    bool busy;
-    bool isLongALU;
-    RS* executingEntry1;
-    RS* executingEntry2;
-    RS* executingEntry3;
-    RS* completedEntry;
+    fuClass* cls;
+    int64_t nextIssue;
+    RS** stages;
 } FU;
 
 
 dispatchQueue* DQ = NULL;
 scheduleQueue* SQ = NULL;
-scoreboard* sb = NULL;
 RF* rf = NULL;
 CDB* cdbs = NULL;
 CDB* cdbsIssued = NULL;
@@ -112,89 +243,122 @@ void freeDQEntry(DQEntry* entry) {
 }
 
 void freeRS(RS* rs) {
-    for (int i = 0; i < 2; i++) {
-        free(rs->srcs[i]);
-    }
-    free(rs->srcs);
-    free(rs->dest);
     free(rs);
 }
 
 void initialize() {
     //initialize functional units
-    sb = malloc(sizeof(scoreboard));
-    sb->fastALUs = calloc(numFastALU, sizeof(FU));
-    sb->longALUs = calloc(numLongALU, sizeof(FU));
-    for (int i = 0; i < numFastALU; i++) {
-        sb->fastALUs[i].busy = false;
-        sb->fastALUs[i].isLongALU = false;
-    }
-    for (int i = 0; i < numLongALU; i++) {
-        sb->longALUs[i].busy = false;
-        sb->longALUs[i].isLongALU = true;
-    }
-    //initialize register file
+    numFUs = 0;
+    for (int c = 0; c < numFUClasses; c++) {
+        fuClass* cls = &fuClasses[c];
+        cls->units = calloc(cls->count, sizeof(FU));
+        for (int i = 0; i < cls->count; i++) {
+            cls->units[i].cls = cls;
+            cls->units[i].nextIssue = 0;
+            cls->units[i].stages = calloc(cls->latency, sizeof(RS*));
+        }
+        cls->sqSize = 0;
+        cls->sqMaxSize = scheduleWidth * cls->count;
+        numFUs += cls->count;
+    }
+    //initialize register file, architectural register i starts in physical i
     rf = malloc(sizeof(RF));
-    rf->regs = malloc(33 * sizeof(reg));
-    for (int i = 0; i < 33; i++) {
+    rf->regs = calloc(numPhysRegs, sizeof(physReg));
+    rf->renameMap = malloc(ARCH_REGS * sizeof(int));
+    rf->freeList = malloc(numPhysRegs * sizeof(int));
+    rf->freeCount = 0;
+    for (int i = 0; i < numPhysRegs; i++) {
         rf->regs[i].ready = true;
-        rf->regs[i].num = i;
-        rf->regs[i].tag = -1;
+        rf->regs[i].superseded = false;
+        rf->regs[i].readers = 0;
+        if (i < ARCH_REGS) {
+            rf->renameMap[i] = i;
+        }
+        else {
+            rf->freeList[rf->freeCount++] = i;
+        }
     }
     //initialize dispatch queue
     DQ = malloc(sizeof(dispatchQueue));
     DQ->head = NULL;
     DQ->tail = NULL;
     DQ->size = 0;
-    DQ->maxSize = dispatchWidth * (scheduleWidth*numFastALU + scheduleWidth*numLongALU);
+    DQ->maxSize = dispatchWidth * scheduleWidth * numFUs;
     //initialize schedule queue
     SQ = malloc(sizeof(scheduleQueue));
     SQ->head = NULL;
-    SQ->sizeFast = 0;
-    SQ->sizeLong = 0;
-    SQ->maxFastSize = scheduleWidth * numFastALU;
-    SQ->maxLongSize = scheduleWidth * numLongALU;
+    SQ->size = 0;
     //initialize CDBs
     cdbs = malloc(numCDB * sizeof(CDB));
     cdbsIssued = malloc(numCDB * sizeof(CDB));
     for (int i = 0; i < numCDB; i++) {
         cdbs[i].busy = false;
         cdbs[i].tag = -1;
+        cdbs[i].preg = -1;
         cdbsIssued[i].busy = false;
         cdbsIssued[i].tag = -1;
+        cdbsIssued[i].preg = -1;
     }
 }
 
-//FU operations
-FU* getFreeFU(bool isLongALU) {
-    if (isLongALU) {
-        for (int i = 0; i < numLongALU; i++) {
-            if (!sb->longALUs[i].busy) {
-                return &sb->longALUs[i];
-            }
-        }
+//register renaming operations
+void tryFreePhysReg(int preg) {
+    physReg* r = &rf->regs[preg];
+    if (r->superseded && r->ready && r->readers == 0) {
+        r->superseded = false;
+        rf->freeList[rf->freeCount++] = preg;
     }
-    else {
-        for (int i = 0; i < numFastALU; i++) {
-            if (!sb->fastALUs[i].busy) {
-                return &sb->fastALUs[i];
-            }
+}
+
+int renameSrc(int archReg) {
+    if (archReg == -1) {
+        return -1;
+    }
+    int preg = rf->renameMap[archReg];
+    rf->regs[preg].readers++;
+    return preg;
+}
+
+int renameDest(int archReg) {
+    if (archReg == -1) {
+        return -1;
+    }
+    int preg = rf->freeList[--rf->freeCount];
+    int old = rf->renameMap[archReg];
+    rf->renameMap[archReg] = preg;
+    rf->regs[preg].ready = false;
+    rf->regs[old].superseded = true;
+    tryFreePhysReg(old);
+    return preg;
+}
+
+//FU operations
+FU* getFreeFU(fuClass* cls) {
+    for (int i = 0; i < cls->count; i++) {
+        if (cls->units[i].nextIssue <= tickCount) {
+            return &cls->units[i];
         }
     }
     return NULL;
 }
 
+bool fuClassAccepts(fuClass* cls, enum op_type type) {
+    return (cls->opMask & (1u << type)) != 0;
+}
+
 //dispatch stage operations
 bool isFullDQ() {
     return DQ->size >= DQ->maxSize;
 }
 
-bool addToDQ(trace_op* op) {
+bool addToDQ(trace_op* op, int core, bool mispredicted) {
     if (DQ->size >= DQ->maxSize) {
         return false;
     }
     DQEntry* newEntry = malloc(sizeof(DQEntry));
     newEntry->op = op;
+    newEntry->core = core;
+    newEntry->mispredicted = mispredicted;
     newEntry->next = NULL;
     if (DQ->tail == NULL) {
         DQ->head = newEntry;
@@ -208,12 +372,14 @@ bool addToDQ(trace_op* op) {
     return true;
 }
 
-trace_op* removeFromDQ() {
+trace_op* removeFromDQ(int* core, bool* mispredicted) {
     if (DQ->size == 0) {
         return NULL;
     }
     DQEntry* entry = DQ->head;
     trace_op* op = entry->op;
+    *core = entry->core;
+    *mispredicted = entry->mispredicted;
     DQ->head = entry->next;
     if (DQ->head == NULL) {
         DQ->tail = NULL;
@@ -231,220 +397,148 @@ trace_op* peekDQ() {
 }
 
 //schedule queue operations
-bool isFullSQ(bool isLongALU) {
-    if (isLongALU) {
-        return SQ->sizeLong >= SQ->maxLongSize;
-    }
-    else {
-        return SQ->sizeFast >= SQ->maxFastSize;
-    }
+bool isFullSQ(fuClass* cls) {
+    return cls->sqSize >= cls->sqMaxSize;
 }
 
-bool addToSQ(RS* newEntry, bool isLongALU) {
-    if (isLongALU) {
-        if (SQ->sizeLong >= SQ->maxLongSize) {
-            return false;
+// Steer an op to the first FU class that executes it and still has room in
+//   its share of the schedule queue.
+fuClass* steerOp(trace_op* op) {
+    for (int c = 0; c < numFUClasses; c++) {
+        if (fuClassAccepts(&fuClasses[c], op->op) && !isFullSQ(&fuClasses[c])) {
+            return &fuClasses[c];
         }
-        newEntry->next = SQ->head;
-        newEntry->prev = NULL;
-        if (SQ->head != NULL) {
-            SQ->head->prev = newEntry;
-        }
-        SQ->head = newEntry;
-        SQ->sizeLong++;
-        return true;
     }
-    else {
-        if (SQ->sizeFast >= SQ->maxFastSize) {
-            return false;
-        }
-        newEntry->next = SQ->head;
-        newEntry->prev = NULL;
-        if (SQ->head != NULL) {
-            SQ->head->prev = newEntry;
-        }
-        SQ->head = newEntry;
-        SQ->sizeFast++;
-        return true;
+    return NULL;
+}
+
+bool addToSQ(RS* newEntry) {
+    fuClass* cls = newEntry->cls;
+    if (isFullSQ(cls)) {
+        return false;
     }
+    newEntry->next = SQ->head;
+    newEntry->prev = NULL;
+    if (SQ->head != NULL) {
+        SQ->head->prev = newEntry;
+    }
+    SQ->head = newEntry;
+    SQ->size++;
+    cls->sqSize++;
+    return true;
 }
 
 void removeFromSQ(RS* entry){
-    if (entry->isLongALU) {
-        if (entry->prev != NULL) {
-            entry->prev->next = entry->next;
-        }
-        else {
-            SQ->head = entry->next;
-        }
-        if (entry->next != NULL) {
-            entry->next->prev = entry->prev;
-        }
-        SQ->sizeLong--;
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
     }
     else {
-        if (entry->prev != NULL) {
-            entry->prev->next = entry->next;
-        }
-        else {
-            SQ->head = entry->next;
-        }
-        if (entry->next != NULL) {
-            entry->next->prev = entry->prev;
-        }
-        SQ->sizeFast--;
+        SQ->head = entry->next;
     }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    }
+    SQ->size--;
+    entry->cls->sqSize--;
     freeRS(entry);
 }
 
 // Dispatch stage
 int dispatch() {
     int dispatched = 0;
+    bool renameStalled = false;
     while (dispatched < dispatchWidth) {
         trace_op* nextOp = peekDQ();
         if (nextOp == NULL) {
             break;
         }
-        //check if schedule queue has room
-        bool isLongALU = (nextOp->op == ALU_LONG);
-        if (isFullSQ(isLongALU)) {
+        //check if schedule queue has room for a class that executes the op
+        fuClass* cls = steerOp(nextOp);
+        if (cls == NULL) {
+            coreStats[DQ->head->core].stalls |= STALL_SQ;
+            break;
+        }
+        //stall if there is no physical register left to rename into
+        if (nextOp->dest_reg != -1 && rf->freeCount == 0) {
+            coreStats[DQ->head->core].stalls |= STALL_RENAME;
+            renameStalled = true;
             break;
         }
         //remove from dispatch queue
-        trace_op* op = removeFromDQ();
+        int core;
+        bool mispredicted;
+        trace_op* op = removeFromDQ(&core, &mispredicted);
         if (op == NULL) {
             break;
         }
         RS* rs = malloc(sizeof(RS));
         rs->FU = NULL;
-        rs->isLongALU = (op->op == ALU_LONG);
-        rs->srcs = malloc(2 * sizeof(reg*));
-        int reg1 = op->src_reg[0];
-        int reg2 = op->src_reg[1];
-        int regD = op->dest_reg;
-        reg* src1;
-        reg* src2;
-        if (reg1 == -1) {
-            src1 = NULL;
-        } else {
-            src1 = &rf->regs[reg1];
-        }
-        if (reg2 == -1) {
-            src2 = NULL;
-        } else {
-            src2 = &rf->regs[reg2];
-        }
-        reg* dest;
-        if (regD != -1) {
-            dest = &rf->regs[op->dest_reg];
-        }
-        else {
-            dest = NULL;
-        }
-        rs->dest = malloc(sizeof(reg));
-        if (dest != NULL) {
-            rs->dest->num = dest->num;
-        }
-        else {
-            rs->dest->num = -1;
-        }
-        //check source readiness/update tags
-        for (int i = 0; i < 2; i++) {
-            reg* src = (i == 0) ? src1 : src2;
-            if (src == NULL) {
-                rs->srcs[i] = malloc(sizeof(reg));
-                rs->srcs[i]->ready = true;
-                continue;
-            }
-            rs->srcs[i] = malloc(sizeof(reg));
-            rs->srcs[i]->num = src->num;
-            if (src->ready) {
-                rs->srcs[i]->ready = true;
-            }
-            else {
-                rs->srcs[i]->ready = false;
-                rs->srcs[i]->tag = src->tag;
-            }
-        }
-        int64_t tag = getNextTag();
-        if (dest != NULL) {
-            dest->tag = tag;
-            dest->ready = false;
-            rs->dest->tag = tag;
-            rs->dest->ready = false;
-        }
-        else {
-            rs->dest->tag = -1;
-            rs->dest->ready = true;
-        }
+        rs->cls = cls;
+        rs->core = core;
+        rs->mispredicted = mispredicted;
+        //sources are renamed before the destination so that an op
+        //reading its own destination sees the older mapping
+        rs->srcs[0] = renameSrc(op->src_reg[0]);
+        rs->srcs[1] = renameSrc(op->src_reg[1]);
+        rs->dest = renameDest(op->dest_reg);
+        rs->tag = getNextTag();
         //add to schedule queue(we know it has room if we get here)
         free(op);
-        addToSQ(rs, isLongALU);
+        addToSQ(rs);
         dispatched++;
     }
-    return dispatched;
-}
-
-RS* readyToFire[1024];
-
-void addReadyToFire(RS* rs) {
-    // if (!rs->isLongALU) {
-    //     rs->FU->executingEntry1 = rs;
-    //     return;
-    // }
-    for (int i = 0; i < 1024; i++) {
-        if (readyToFire[i] == NULL) {
-            readyToFire[i] = rs;
-            return;
-        }
+    if (renameStalled) {
+        renameStallCycles++;
     }
+    return dispatched;
 }
 
-void fireReadyToFire() {
-    for (int i = 0; i < 1024; i++) {
-        if (readyToFire[i] != NULL) {
-            RS* rs = readyToFire[i];
-            FU* fu = rs->FU;
-            fu->executingEntry1 = rs;
-            readyToFire[i] = NULL;
-        }
-    }
+//schedule stage
+bool srcReady(int preg) {
+    return preg == -1 || rf->regs[preg].ready;
 }
 
-//schedule stage
 int schedule() {
     int scheduled = 0;
+    //results broadcast on the CDBs last cycle mark their physical registers
+    //ready, waking up every op that sources them
+    for (int i = 0; i < numCDB; i++) {
+        if (cdbs[i].busy && cdbs[i].preg != -1) {
+            rf->regs[cdbs[i].preg].ready = true;
+            tryFreePhysReg(cdbs[i].preg);
+        }
+    }
     for (RS* rs = SQ->head; rs != NULL; rs = rs->next) {
-        //check if CDB broadcasted one of our dependencies
-        //set all CDBs to be not busy after we cal this function
         if (rs->FU != NULL) {
-            //printf("RS %p already has FU %p\n", rs, rs->FU);
             continue; //already scheduled
         }
-        //printf("Scheduling RS %p\n", rs);
-        for (int i = 0; i < numCDB; i++) {
-            if (cdbs[i].busy) {
+        if (srcReady(rs->srcs[0]) && srcReady(rs->srcs[1]) && scheduled < scheduleWidth) {
+            //wake up, FIFO selection
+            FU* fu = getFreeFU(rs->cls);
+            if (fu != NULL) {
+                //execute has already advanced this cycle, so the first
+                //stage is free for the newly issued op
+                rs->FU = fu;
+                fu->nextIssue = tickCount + rs->cls->issueInterval;
+                fu->stages[0] = rs;
+                scheduled++;
+                //operands are read from the register file on issue
                 for (int j = 0; j < 2; j++) {
-                    if (!rs->srcs[j]->ready && rs->srcs[j]->tag == cdbs[i].tag) {
-                        rs->srcs[j]->ready = true;
+                    if (rs->srcs[j] != -1) {
+                        rf->regs[rs->srcs[j]].readers--;
+                        tryFreePhysReg(rs->srcs[j]);
                     }
                 }
             }
-        }
-        if (rs->srcs[0]->ready && rs->srcs[1]->ready && scheduled < scheduleWidth) {
-            //wake up, FIFO selection
-            FU* fu = getFreeFU(rs->isLongALU);
-            if (fu != NULL) {
-                rs->FU = fu; 
-                fu->busy = true;
-                addReadyToFire(rs);
-                scheduled++;
+            else {
+                coreStats[rs->core].stalls |= STALL_FU;
             }
         }
     }
     for (int i = 0; i < numCDB; i++) {
         cdbs[i].busy = false;
         cdbs[i].tag = -1;
+        cdbs[i].preg = -1;
     }
     return scheduled;
 }
@@ -490,7 +584,7 @@ RS* removeByMinTag() {
     }
     completedNode* minEntry = completed;
     for (completedNode* entry = completed; entry != NULL; entry = entry->next) {
-        if (entry->rs->dest->tag < minEntry->rs->dest->tag) {
+        if (entry->rs->tag < minEntry->rs->tag) {
             minEntry = entry;
         }
     }
@@ -508,37 +602,36 @@ RS* removeByMinTag() {
     return returnEntry;
 }
 
+// A mispredicted branch has executed, the front end is redirected and
+//   takes redirectPenalty cycles to refill before fetch resumes.
+void resolveBranch(int core) {
+    awaitingBranch[core] = false;
+    pendingBranch[core] = redirectPenalty;
+}
+
 int execute() {
     //for each FU, if busy, execute
     int executed = 0;
-    for (int i = 0; i < numFastALU; i++) {
-        FU* fu = &sb->fastALUs[i];
-        if (fu->busy && fu->executingEntry1 != NULL) {
-            executed++;
-            //not pipelined, so complete in one cycle
-            fu->busy = false;
-            addToCompleted(fu->executingEntry1);
-            fu->executingEntry1 = NULL;
-        }
-    }
-    for (int i = 0; i < numLongALU; i++) {
-        FU* fu = &sb->longALUs[i];
-        //pipelined FU, so we can have up to 3 entries executing
-        if (fu->executingEntry3 != NULL) {
-            executed++;
-            addToCompleted(fu->executingEntry3);
-            fu->executingEntry3 = NULL;
-        }
-        if (fu->executingEntry2 != NULL) {
-            executed++;
-            fu->executingEntry3 = fu->executingEntry2;
-            fu->executingEntry2 = NULL;
-        }
-        if (fu->busy && fu->executingEntry1 != NULL) {
-            executed++;
-            fu->busy = false;
-            fu->executingEntry2 = fu->executingEntry1;
-            fu->executingEntry1 = NULL;
+    for (int c = 0; c < numFUClasses; c++) {
+        int last = fuClasses[c].latency - 1;
+        for (int i = 0; i < fuClasses[c].count; i++) {
+            RS** stages = fuClasses[c].units[i].stages;
+            //the op in the last stage completes, the rest advance one stage
+            if (stages[last] != NULL) {
+                executed++;
+                if (stages[last]->mispredicted) {
+                    resolveBranch(stages[last]->core);
+                }
+                addToCompleted(stages[last]);
+                stages[last] = NULL;
+            }
+            for (int s = last; s > 0; s--) {
+                if (stages[s - 1] != NULL) {
+                    executed++;
+                    stages[s] = stages[s - 1];
+                    stages[s - 1] = NULL;
+                }
+            }
         }
     }
     return executed;
@@ -565,6 +658,7 @@ int stateUpdate() {
     for (int i = 0; i < numCDB; i++) {
         cdbsIssued[i].busy = false;
         cdbsIssued[i].tag = -1;
+        cdbsIssued[i].preg = -1;
     }
     for (int i = 0; i < numCDB; i++) {
         RS* rs = removeByMinTag();
@@ -573,18 +667,16 @@ int stateUpdate() {
         }
         updated++;
         cdbsIssued[i].busy = true;
-        cdbsIssued[i].tag = rs->dest->tag;
-        if (rs->dest->num == -1) {
-            //no destination register
-            addToRemoveFromSQ(rs);
-            continue;
-        }
-        reg* destReg = &rf->regs[rs->dest->num];
-        if (destReg->tag == rs->dest->tag) {
-            destReg->ready = true;
-        }
+        cdbsIssued[i].tag = rs->tag;
+        cdbsIssued[i].preg = rs->dest;
+        coreStats[rs->core].committed++;
+        coreStats[rs->core].inFlight--;
         addToRemoveFromSQ(rs);
     }
+    //ops left in the completed list lost the CDBs to older ops
+    for (completedNode* n = completed; n != NULL; n = n->next) {
+        coreStats[n->rs->core].stalls |= STALL_CDB;
+    }
     return updated;
 }
 
@@ -592,9 +684,121 @@ void shiftCDBs()
 {
     for (int i = 0; i < numCDB; i++) {
         cdbs[i].tag = cdbsIssued[i].tag;
+        cdbs[i].preg = cdbsIssued[i].preg;
         cdbs[i].busy = cdbsIssued[i].busy;
         cdbsIssued[i].busy = false;
         cdbsIssued[i].tag = -1;
+        cdbsIssued[i].preg = -1;
+    }
+}
+
+// Parse one row of the function unit table, given as
+//   name:count:latency:issueInterval:ops
+//   where ops lists the accepted op types, A for ALU, L for ALU_LONG and
+//   B for BRANCH.
+int addFUClass(const char* desc)
+{
+    char ops[16];
+    fuClass* cls;
+
+    if (numFUClasses == MAX_FU_CLASSES)
+    {
+        fprintf(stderr, "Error: at most %d FU classes supported\n",
+                MAX_FU_CLASSES);
+        return -1;
+    }
+    cls = &fuClasses[numFUClasses];
+    if (sscanf(desc, "%15[^:]:%d:%d:%d:%15s", cls->name, &cls->count,
+               &cls->latency, &cls->issueInterval, ops)
+        != 5)
+    {
+        fprintf(stderr,
+                "Error: FU class '%s' is not name:count:latency:interval:ops\n",
+                desc);
+        return -1;
+    }
+    if (cls->count <= 0 || cls->latency <= 0 || cls->issueInterval <= 0)
+    {
+        fprintf(stderr, "Error: FU class '%s' needs positive values\n", desc);
+        return -1;
+    }
+    cls->opMask = 0;
+    for (char* c = ops; *c != '\0'; c++)
+    {
+        switch (*c)
+        {
+            case 'A':
+                cls->opMask |= 1u << ALU;
+                break;
+            case 'L':
+                cls->opMask |= 1u << ALU_LONG;
+                break;
+            case 'B':
+                cls->opMask |= 1u << BRANCH;
+                break;
+            default:
+                fprintf(stderr, "Error: unknown op type '%c' in FU class %s\n",
+                        *c, cls->name);
+                return -1;
+        }
+    }
+    numFUClasses++;
+    return 0;
+}
+
+// Charge the cycle that just ended to one CPI category for each core
+void accountCycle()
+{
+    for (int i = 0; i < processorCount; i++)
+    {
+        coreAccounting* a = &coreStats[i];
+        int stalls = a->stalls;
+        enum cpiCategory cat;
+
+        a->ops += a->committed;
+        if (a->committed > 0)
+            cat = CPI_BASE;
+        else if (pendingMem[i] == 1)
+            cat = a->memIsStore ? CPI_MEM_STORE : CPI_MEM_LOAD;
+        else if (a->branchStalled)
+            cat = CPI_BRANCH;
+        else if (stalls & STALL_CDB)
+            cat = CPI_CDB;
+        else if (stalls & STALL_FU)
+            cat = CPI_FU_BUSY;
+        else if (stalls & STALL_RENAME)
+            cat = CPI_RENAME;
+        else if (stalls & STALL_SQ)
+            cat = CPI_SQ_FULL;
+        else if (stalls & STALL_DQ)
+            cat = CPI_DQ_FULL;
+        else if (a->inFlight > 0)
+            cat = CPI_EXECUTE;
+        else
+            cat = CPI_FRONTEND;
+
+        // A core that has run out of trace stops accumulating cycles
+        if (cat != CPI_FRONTEND || !a->traceDone)
+            a->cycles[cat]++;
+
+        a->committed = 0;
+        a->stalls = 0;
+        a->branchStalled = false;
+    }
+
+    if (cpiInterval > 0 && tickCount % cpiInterval == 0)
+    {
+        for (int i = 0; i < processorCount; i++)
+        {
+            printf("CPI %ld core %d:", tickCount, i);
+            for (int c = 0; c < CPI_CATEGORIES; c++)
+            {
+                printf(" %s %ld%s", cpiNames[c],
+                       coreStats[i].cycles[c] - coreStats[i].lastCycles[c],
+                       (c == CPI_CATEGORIES - 1) ? "\n" : ",");
+                coreStats[i].lastCycles[c] = coreStats[i].cycles[c];
+            }
+        }
     }
 }
 
@@ -606,13 +810,14 @@ void shiftCDBs()
 processor* init(processor_sim_args* psa)
 {
     int op;
+    char defaultClass[64];
 
     tr = psa->tr;
     cs = psa->cache_sim;
     bs = psa->branch_sim;
 
     // TODO - get argument list from assignment
-    while ((op = getopt(psa->arg_count, psa->arg_list, "f:d:m:j:k:c:")) != -1)
+    while ((op = getopt(psa->arg_count, psa->arg_list, "f:d:m:j:k:c:r:u:t:q:i:P:R:")) != -1)
     {
         switch (op)
         {
@@ -645,12 +850,126 @@ processor* init(processor_sim_args* psa)
             case 'c':
                 numCDB = atoi(optarg);
                 break;
+
+            // Number of physical registers
+            case 'r':
+                numPhysRegs = atoi(optarg);
+                break;
+
+            // FU class, name:count:latency:interval:ops, may be repeated
+            case 'u':
+                if (addFUClass(optarg) != 0)
+                    return NULL;
+                break;
+
+            // Front end refill cycles after a mispredicted branch executes
+            case 'R':
+                redirectPenalty = atoi(optarg);
+                break;
+
+            // Print the CPI stack of each core every N ticks
+            case 't':
+                cpiInterval = atol(optarg);
+                break;
+
+            // Fetch target queue entries, enables the decoupled front end
+            case 'q':
+                ftqSize = atoi(optarg);
+                break;
+
+            // I-cache, sets:ways:blockSize:missTicks
+            case 'i':
+                if (sscanf(optarg, "%d:%d:%d:%d", &icacheSets, &icacheWays,
+                           &icacheBlockSize, &icacheMissTicks)
+                        != 4
+                    || icacheSets <= 0 || icacheWays <= 0
+                    || icacheBlockSize <= 0 || icacheMissTicks < 0)
+                {
+                    fprintf(stderr,
+                            "Error: I-cache '%s' is not sets:ways:block:missTicks\n",
+                            optarg);
+                    return NULL;
+                }
+                break;
+
+            // I-cache lines prefetched per cycle from the FTQ
+            case 'P':
+                prefetchDegree = atoi(optarg);
+                break;
+        }
+    }
+
+    // Without an FU table, -j and -k describe single cycle fast ALUs, which
+    //   also resolve branches, and 3 stage pipelined long ALUs.
+    if (numFUClasses == 0)
+    {
+        if (numFastALU > 0)
+        {
+            snprintf(defaultClass, sizeof(defaultClass), "fast:%d:1:1:AB",
+                     numFastALU);
+            addFUClass(defaultClass);
+        }
+        if (numLongALU > 0)
+        {
+            snprintf(defaultClass, sizeof(defaultClass), "long:%d:3:1:L",
+                     numLongALU);
+            addFUClass(defaultClass);
+        }
+    }
+    for (enum op_type t = BRANCH; t <= ALU_LONG; t++)
+    {
+        bool executed = false;
+        for (int c = 0; c < numFUClasses; c++)
+        {
+            executed |= fuClassAccepts(&fuClasses[c], t);
+        }
+        if (!executed)
+        {
+            fprintf(stderr, "Error: no FU class executes %s ops\n",
+                    (t == BRANCH) ? "BRANCH" : (t == ALU) ? "ALU" : "ALU_LONG");
+            return NULL;
+        }
+    }
+
+    // Without an explicit size, provide enough physical registers that
+    //   renaming never limits the window.
+    if (numPhysRegs == 0)
+    {
+        int units = 0;
+        for (int c = 0; c < numFUClasses; c++)
+        {
+            units += fuClasses[c].count;
         }
+        numPhysRegs = ARCH_REGS + 2 * scheduleWidth * units + numCDB;
+    }
+    if (numPhysRegs <= ARCH_REGS)
+    {
+        fprintf(stderr,
+                "Error: need more than %d physical registers - %d specified\n",
+                ARCH_REGS, numPhysRegs);
+        return NULL;
     }
 
     pendingBranch = calloc(processorCount, sizeof(int));
+    awaitingBranch = calloc(processorCount, sizeof(bool));
     pendingMem = calloc(processorCount, sizeof(int));
     memOpTag = calloc(processorCount, sizeof(int64_t));
+    coreStats = calloc(processorCount, sizeof(coreAccounting));
+    if (ftqSize > 0)
+    {
+        frontEnds = calloc(processorCount, sizeof(frontEnd));
+        for (int i = 0; i < processorCount; i++)
+        {
+            frontEnds[i].ftq = calloc(ftqSize, sizeof(ftqEntry));
+            if (icacheSets > 0)
+                frontEnds[i].icache
+                    = calloc(icacheSets * icacheWays, sizeof(icacheLine));
+        }
+    }
+    else if (icacheSets > 0)
+    {
+        fprintf(stderr, "Warning: the I-cache is only modeled with -q\n");
+    }
     initialize();
 
     self = calloc(1, sizeof(processor));
@@ -671,6 +990,7 @@ void memOpCallback(int procNum, int64_t tag)
     {
         //memOpTag[procNum]++;
         pendingMem[procNum] = 0;
+        coreStats[procNum].committed++;
         stallCount = tickCount + STALL_TIME;
     }
     else
@@ -679,6 +999,261 @@ void memOpCallback(int procNum, int64_t tag)
     }
 }
 
+// Hand a fetched op to the rest of the core
+void deliverOp(int core, trace_op* op, bool mispredicted)
+{
+    switch (op->op)
+    {
+        case MEM_LOAD:
+        case MEM_STORE:
+            pendingMem[core] = 1;
+            coreStats[core].memIsStore = (op->op == MEM_STORE);
+            cs->memoryRequest(op, core, makeTag(core, memOpTag[core]),
+                              memOpCallback);
+            break;
+
+        case BRANCH:
+            if (mispredicted)
+            {
+                awaitingBranch[core] = true;
+                coreStats[core].mispredicts++;
+            }
+            // fall through, branches resolve in the backend
+        case ALU:
+        case ALU_LONG:
+            addToDQ(op, core, mispredicted);
+            coreStats[core].inFlight++;
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool isMispredicted(trace_op* op, int core)
+{
+    return op->op == BRANCH
+           && bs->branchRequest(op, core) != op->nextPCAddress;
+}
+
+bool isTakenBranch(trace_op* op)
+{
+    return op->op == BRANCH && op->nextPCAddress != op->pcAddress + 4;
+}
+
+// A mispredicted branch blocks fetch until it has executed and the front
+//   end has been refilled.  Fetch slots lost meanwhile would have gone to
+//   wrong path ops, which the trace does not contain, so they are counted
+//   as wasted instead of being fetched and squashed.
+bool branchRecovering(int core)
+{
+    if (!awaitingBranch[core] && pendingBranch[core] == 0)
+        return false;
+
+    coreStats[core].branchStalled = true;
+    coreStats[core].wastedSlots += fetchRate;
+    if (!awaitingBranch[core])
+        pendingBranch[core]--;
+    return true;
+}
+
+// Look up a line in a core's I-cache, returns NULL if it is not cached
+//   or being filled
+icacheLine* icacheFind(frontEnd* fe, uint64_t line)
+{
+    icacheLine* set = &fe->icache[(line % icacheSets) * icacheWays];
+    for (int w = 0; w < icacheWays; w++)
+    {
+        if (set[w].valid && set[w].line == line)
+            return &set[w];
+    }
+    return NULL;
+}
+
+void icacheFill(frontEnd* fe, uint64_t line, bool prefetch)
+{
+    icacheLine* set = &fe->icache[(line % icacheSets) * icacheWays];
+    icacheLine* victim = &set[0];
+    for (int w = 0; w < icacheWays && victim->valid; w++)
+    {
+        if (!set[w].valid || set[w].lastUse < victim->lastUse)
+            victim = &set[w];
+    }
+    victim->valid = true;
+    victim->prefetched = prefetch;
+    victim->line = line;
+    victim->readyTick = tickCount + icacheMissTicks;
+    victim->lastUse = tickCount;
+}
+
+// Demand access from fetch, returns whether the line can be read this cycle
+bool icacheAccess(frontEnd* fe, uint64_t line)
+{
+    if (fe->icache == NULL)
+        return true;
+
+    icacheLine* l = icacheFind(fe, line);
+    if (l == NULL)
+    {
+        icacheMisses++;
+        icacheFill(fe, line, false);
+        return false;
+    }
+    if (l->readyTick > tickCount)
+        return false;
+
+    icacheHits++;
+    if (l->prefetched)
+    {
+        icacheUsefulPrefetches++;
+        l->prefetched = false;
+    }
+    l->lastUse = tickCount;
+    return true;
+}
+
+ftqEntry* ftqAt(frontEnd* fe, int pos)
+{
+    return &fe->ftq[(fe->ftqHead + pos) % ftqSize];
+}
+
+// Fetch stage, moves ops from the FTQ into the core
+int fetchFromFTQ(int core)
+{
+    frontEnd* fe = &frontEnds[core];
+    uint64_t firstLine = 0;
+    int fetched = 0;
+
+    if (fe->ftqCount == 0)
+    {
+        ftqEmptyCycles++;
+        return 0;
+    }
+
+    while (fetched < fetchRate && fe->ftqCount > 0)
+    {
+        ftqEntry* e = ftqAt(fe, 0);
+        uint64_t line = e->pc / icacheBlockSize;
+
+        if (isFullDQ())
+        {
+            coreStats[core].stalls |= STALL_DQ;
+            break;
+        }
+        if (fetched > 0 && line != firstLine)
+            break;
+        if (!icacheAccess(fe, line))
+        {
+            if (fetched == 0)
+                icacheStallCycles++;
+            break;
+        }
+
+        firstLine = line;
+        fe->ftqHead = (fe->ftqHead + 1) % ftqSize;
+        fe->ftqCount--;
+        fetched++;
+        if (e->mispredicted)
+            fe->mispredictsQueued--;
+        deliverOp(core, e->op, e->mispredicted);
+
+        // Fetch resumes next cycle after a redirect or a blocking op
+        if (isTakenBranch(e->op) || awaitingBranch[core]
+            || pendingMem[core] == 1)
+            break;
+    }
+    return 1;
+}
+
+// Predict stage, runs ahead of fetch filling the FTQ with one predicted
+//   block per cycle.  Prediction stops at a mispredicted branch until it
+//   has been resolved, as the trace holds no wrong path to follow.
+int predictIntoFTQ(int core)
+{
+    frontEnd* fe = &frontEnds[core];
+    int predicted = 0;
+
+    while (predicted < fetchRate && fe->ftqCount < ftqSize
+           && fe->mispredictsQueued == 0)
+    {
+        trace_op* op = tr->getNextOp(core);
+        if (op == NULL)
+        {
+            coreStats[core].traceDone = true;
+            break;
+        }
+
+        // Only ALU ops and branches carry a PC in the trace
+        ftqEntry* e = ftqAt(fe, fe->ftqCount);
+        e->op = op;
+        e->pc = (op->op == ALU || op->op == ALU_LONG || op->op == BRANCH)
+                    ? op->pcAddress
+                    : fe->lastPC;
+        e->mispredicted = isMispredicted(op, core);
+        fe->lastPC = e->pc;
+        fe->ftqCount++;
+        predicted++;
+
+        if (e->mispredicted)
+        {
+            fe->mispredictsQueued++;
+            break;
+        }
+        if (isTakenBranch(op))
+            break;
+    }
+    return predicted > 0;
+}
+
+// Prefetch the lines of queued ops that are missing from the I-cache
+void prefetchFromFTQ(int core)
+{
+    frontEnd* fe = &frontEnds[core];
+    uint64_t lastLine = UINT64_MAX;
+    int issued = 0;
+
+    if (fe->icache == NULL)
+        return;
+
+    for (int pos = 0; pos < fe->ftqCount && issued < prefetchDegree; pos++)
+    {
+        uint64_t line = ftqAt(fe, pos)->pc / icacheBlockSize;
+        if (line == lastLine)
+            continue;
+        lastLine = line;
+        if (icacheFind(fe, line) == NULL)
+        {
+            icacheFill(fe, line, true);
+            icachePrefetches++;
+            issued++;
+        }
+    }
+}
+
+int frontEndTick(int core)
+{
+    int progress = (frontEnds[core].ftqCount > 0);
+
+    if (pendingMem[core] == 1)
+    {
+        progress = 1;
+    }
+    else if (branchRecovering(core))
+    {
+        progress = 1;
+    }
+    else
+    {
+        fetchFromFTQ(core);
+    }
+
+    if (!awaitingBranch[core] && pendingBranch[core] == 0)
+        progress |= predictIntoFTQ(core);
+    prefetchFromFTQ(core);
+
+    return progress;
+}
+
 int instructionCount = 0;
 int tick(void)
 {
@@ -709,17 +1284,21 @@ int tick(void)
     int progress = 0;
     for (int i = 0; i < processorCount; i++)
     {
+        if (ftqSize > 0)
+        {
+            progress |= frontEndTick(i);
+            continue;
+        }
+
         if (pendingMem[i] == 1)
         {
             progress = 1;
             continue;
         }
 
-        // In the full processor simulator, the branch is pending until
-        //   it has executed.
-        if (pendingBranch[i] > 0)
+        // A mispredicted branch is pending until it has executed.
+        if (branchRecovering(i))
         {
-            pendingBranch[i]--;
             progress = 1;
             continue;
         }
@@ -729,45 +1308,32 @@ int tick(void)
         bool hasSpaceInDQ;
         for (int j = 0; j < fetchRate; j++) {
             if (isFullDQ()) {
+                coreStats[i].stalls |= STALL_DQ;
                 break;
             }
             trace_op* nextOp = tr->getNextOp(i);
             if (nextOp == NULL) {
+                coreStats[i].traceDone = true;
                 break;
             }
             progress = 1;
-            switch (nextOp->op)
-            {
-                case MEM_LOAD:
-                case MEM_STORE:
-                    pendingMem[i] = 1;
-                    cs->memoryRequest(nextOp, i, makeTag(i, memOpTag[i]),
-                                    memOpCallback);
-                    break;
-
-                case BRANCH:
-                    pendingBranch[i]
-                        = (bs->branchRequest(nextOp, i) == nextOp->nextPCAddress)
-                            ? 0
-                            : 1;
-                    break;
-
-                case ALU:
-                case ALU_LONG:
-                    addToDQ(nextOp);
-                    break;
+            deliverOp(i, nextOp, isMispredicted(nextOp, i));
+            // Fetch stops at a mispredict or a memory op, which blocks
+            //   the core until it completes
+            if (awaitingBranch[i] || pendingMem[i] == 1) {
+                break;
             }
         }
     }
     int updated = stateUpdate();
     int executed = execute();
     int scheduled = schedule();
-    fireReadyToFire();
     int dispatched = dispatch();
     shiftCDBs();
     removeAllFromSQ();
+    accountCycle();
     int inDQ = DQ->size;
-    int inSQ = SQ->sizeFast + SQ->sizeLong;
+    int inSQ = SQ->size;
     if (updated || executed || scheduled || dispatched || inDQ || inSQ) {
         progress = 1;
     }
@@ -830,10 +1396,40 @@ int finish(int outFd)
     int c = cs->si.finish(outFd);
     int b = bs->si.finish(outFd);
 
-    char buf[32];
-    size_t charCount = snprintf(buf, 32, "Ticks - %ld\n", tickCount);
+    dprintf(outFd, "Ticks - %ld\n", tickCount);
+    dprintf(outFd, "Rename stall cycles - %ld\n", renameStallCycles);
 
-    (void)!write(outFd, buf, charCount + 1);
+    if (frontEnds != NULL)
+    {
+        dprintf(outFd, "FTQ empty cycles - %ld\n", ftqEmptyCycles);
+    }
+    if (frontEnds != NULL && icacheSets > 0)
+    {
+        dprintf(outFd, "I-cache hits - %ld\n", icacheHits);
+        dprintf(outFd, "I-cache misses - %ld\n", icacheMisses);
+        dprintf(outFd, "I-cache prefetches - %ld (%ld useful)\n",
+                icachePrefetches, icacheUsefulPrefetches);
+        dprintf(outFd, "I-cache stall cycles - %ld\n", icacheStallCycles);
+    }
+
+    for (int i = 0; i < processorCount; i++)
+    {
+        int64_t cycles = 0;
+        for (int c = 0; c < CPI_CATEGORIES; c++)
+        {
+            cycles += coreStats[i].cycles[c];
+        }
+        dprintf(outFd, "Core %d - %ld ops, %ld cycles, CPI %.3f\n", i,
+                coreStats[i].ops, cycles,
+                coreStats[i].ops ? (double)cycles / coreStats[i].ops : 0.0);
+        for (int c = 0; c < CPI_CATEGORIES; c++)
+        {
+            dprintf(outFd, "  %s - %ld\n", cpiNames[c],
+                    coreStats[i].cycles[c]);
+        }
+        dprintf(outFd, "  mispredicts - %ld, wasted fetch slots - %ld\n",
+                coreStats[i].mispredicts, coreStats[i].wastedSlots);
+    }
 
     if (b || c)
         return 1;
@@ -842,15 +1438,32 @@ int finish(int outFd)
 
 int destroy(void)
 {
-    free(sb->fastALUs);
-    free(sb->longALUs);
-    free(sb);
+    for (int c = 0; c < numFUClasses; c++)
+    {
+        for (int i = 0; i < fuClasses[c].count; i++)
+        {
+            free(fuClasses[c].units[i].stages);
+        }
+        free(fuClasses[c].units);
+    }
     free(rf->regs);
+    free(rf->renameMap);
+    free(rf->freeList);
     free(rf);
     free(DQ);
     free(SQ);
     free(cdbs);
     free(cdbsIssued);
+    free(coreStats);
+    if (frontEnds != NULL)
+    {
+        for (int i = 0; i < processorCount; i++)
+        {
+            free(frontEnds[i].ftq);
+            free(frontEnds[i].icache);
+        }
+        free(frontEnds);
+    }
 
     int c = cs->si.destroy();
     int b = bs->si.destroy();
@@ -2,11 +2,11 @@
 #include <trace.h>
 
 #include <getopt.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 
 #include <coherence.h>
-#include "stree.h"
 
 cache* self = NULL;
 
@@ -15,6 +15,7 @@ int CADSS_VERBOSE = 0;
 int blockSize = 1;
 
 coher* coherComp = NULL;
+void (*accessReq)(uint8_t, uint64_t, int, int, int) = NULL;
 
 int64_t* pendingTag = NULL;
 
@@ -69,6 +70,7 @@ cache* init(cache_sim_args* csa)
     self->si.destroy = destroy;
 
     coherComp = csa->coherComp;
+    accessReq = csa->accessReq;
     coherComp->registerCacheInterface(coherCallback);
 
     memCallback = calloc(processorCount, sizeof(memCallbackFunc));
@@ -91,13 +93,14 @@ pendingRequest* pendReq = NULL;
 // type could be READ, WRITE, INVALIDATE, simple ignores this
 void coherCallback(int type, int processorNum, int64_t addr)
 {
-    assert(pendReq != NULL);
     assert(processorNum < processorCount);
 
     // "simpleCache" does not support invalidations.
     if (type != DATA_RECV)
         return;
 
+    assert(pendReq != NULL);
+
     if (pendReq->processorNum == processorNum && pendReq->addr == addr)
     {
         pendingRequest* pr = pendReq;
@@ -146,6 +149,13 @@ void memoryRequest(trace_op* op, int processorNum, int64_t tag,
 
     // As a simplifying assumption, requests do not cross cache lines
     uint64_t addr = (op->memAddress & ~(blockSize - 1));
+    if (accessReq != NULL)
+    {
+        int offset = op->memAddress - addr;
+        int size = (offset + op->size > blockSize) ? blockSize - offset
+                                                   : op->size;
+        accessReq((op->op == MEM_LOAD), addr, offset, size, processorNum);
+    }
     uint8_t perm
         = coherComp->permReq((op->op == MEM_LOAD), addr, processorNum);
 
@@ -188,7 +198,8 @@ int tick()
 
 int finish(int outFd)
 {
-    return 0;
+    // Coherence, interconnect and memory report after the cache
+    return coherComp->si.finish(outFd);
 }
 
 int destroy(void)